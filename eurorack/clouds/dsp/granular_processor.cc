@@ -53,6 +53,8 @@ void GranularProcessor::Init(
   num_channels_ = 2;
   low_fidelity_ = false;
   bypass_ = false;
+  defer_spectral_ = false;
+  spectral_ = false;
   
   src_down_.Init();
   src_up_.Init();
@@ -367,23 +369,32 @@ bool GranularProcessor::LoadPersistentData(const uint32_t* data) {
   return true;
 }
 
-void GranularProcessor::Prepare() {
+bool GranularProcessor::buffers_reset_pending() const {
   bool playback_mode_changed = previous_playback_mode_ != playback_mode_;
   bool benign_change = previous_playback_mode_ != PLAYBACK_MODE_SPECTRAL
       && playback_mode_ != PLAYBACK_MODE_SPECTRAL
       && previous_playback_mode_ != PLAYBACK_MODE_LAST;
+  return reset_buffers_ || (playback_mode_changed && !benign_change);
+}
+
+void GranularProcessor::BufferSpectral() {
+  if (spectral_) {
+    phase_vocoder_.Buffer();
+  }
+}
+
+void GranularProcessor::Prepare() {
+  bool playback_mode_changed = previous_playback_mode_ != playback_mode_;
+  bool reset = buffers_reset_pending();
   
-  if (!reset_buffers_ && playback_mode_changed && benign_change) {
+  if (playback_mode_changed && !reset) {
     ResetFilters();
     pitch_shifter_.Clear();
     previous_playback_mode_ = playback_mode_;
   }
   
-  if ((playback_mode_changed && !benign_change) || reset_buffers_) {
+  if (reset) {
     parameters_.freeze = false;
-  }
-  
-  if (reset_buffers_ || (playback_mode_changed && !benign_change)) {
     void* buffer[2];
     size_t buffer_size[2];
     void* workspace;
@@ -421,7 +432,8 @@ void GranularProcessor::Prepare() {
         &correlator_data[correlator_block_size]);
     pitch_shifter_.Init((uint16_t*)correlator_data);
     
-    if (playback_mode_ == PLAYBACK_MODE_SPECTRAL) {
+    spectral_ = playback_mode_ == PLAYBACK_MODE_SPECTRAL;
+    if (spectral_) {
       phase_vocoder_.Init(
           buffer, buffer_size,
           lut_sine_window_4096, 4096,
@@ -451,7 +463,9 @@ void GranularProcessor::Prepare() {
   }
   
   if (playback_mode_ == PLAYBACK_MODE_SPECTRAL) {
-    phase_vocoder_.Buffer();
+    if (!defer_spectral_) {
+      phase_vocoder_.Buffer();
+    }
   } else if (playback_mode_ == PLAYBACK_MODE_STRETCH) {
     if (resolution() == 8) {
       ws_player_.LoadCorrelator(buffer_8_);
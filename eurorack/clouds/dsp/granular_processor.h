@@ -83,6 +83,26 @@ class GranularProcessor {
 
   void Process(ShortFrame* input, ShortFrame* output, size_t size);
   void Prepare();
+
+  // In spectral mode, Prepare() computes the FFT/IFFT of the last hop unless
+  // asked to defer it to BufferSpectral(), which can then run on another
+  // thread. Its output is read back one hop later, so Process() must not be
+  // called while more than one hop is pending, and Prepare() must not run
+  // concurrently with BufferSpectral() when buffers_reset_pending(), as it
+  // then reallocates the memory of the phase vocoder.
+  inline void set_defer_spectral(bool defer_spectral) {
+    defer_spectral_ = defer_spectral;
+  }
+  void BufferSpectral();
+  bool buffers_reset_pending() const;
+
+  inline size_t num_spectral_hops() const {
+    return spectral_ ? phase_vocoder_.num_hops() : 0;
+  }
+
+  inline size_t num_pending_spectral_hops() const {
+    return spectral_ ? phase_vocoder_.num_pending_hops() : 0;
+  }
   
   inline Parameters* mutable_parameters() {
     return &parameters_;
@@ -169,6 +189,9 @@ class GranularProcessor {
   bool silence_;
   bool bypass_;
   bool reset_buffers_;
+  bool defer_spectral_;
+  // Set when the phase vocoder has been initialized for the current mode.
+  bool spectral_;
   float freeze_lp_;
   float dry_wet_;
   
@@ -59,6 +59,12 @@ class PhaseVocoder {
       FloatFrame* output,
       size_t size);
   void Buffer();
+
+  // All channels hop together.
+  inline size_t num_hops() const { return stft_[0].num_hops(); }
+  inline size_t num_pending_hops() const {
+    return stft_[0].num_pending_hops();
+  }
   
  private:
   FFT fft_;
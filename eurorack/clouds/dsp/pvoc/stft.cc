@@ -72,8 +72,6 @@ void STFT::Init(
   window_stride_ = LUT_SINE_WINDOW_4096_SIZE / fft_size;
   modifier_ = modifier;
   
-  parameters_ = NULL;
-  
   Reset();
 }
 
@@ -93,7 +91,6 @@ void STFT::Process(
     float* output,
     size_t size,
     size_t stride) {
-  parameters_ = &parameters;
   while (size) {
     size_t processed = min(size, hop_size_ - block_size_);
     for (size_t i = 0; i < processed; ++i) {
@@ -112,6 +109,7 @@ void STFT::Process(
     }
     if (block_size_ >= hop_size_) {
       block_size_ -= hop_size_;
+      parameters_[ready_ & 1] = parameters;
       ++ready_;
     }
   }
@@ -151,8 +149,8 @@ void STFT::Buffer() {
   }
 #endif  // USE_ARM_FFT
   // Process in the frequency domain.
-  if (modifier_ != NULL && parameters_ != NULL) {
-    modifier_->Process(*parameters_, &fft_out_[0], &ifft_in_[0]);
+  if (modifier_ != NULL) {
+    modifier_->Process(parameters_[done_ & 1], &fft_out_[0], &ifft_in_[0]);
   } else {
     copy(&fft_out_[0], &fft_out_[fft_size_], &ifft_in_[0]);
   }
@@ -200,11 +198,11 @@ void STFT::Buffer() {
     w += window_stride_;
   }
 
-  ++done_;
   process_ptr_ += hop_size_;
   if (process_ptr_ >= buffer_size_) {
     process_ptr_ -= buffer_size_;
   }
+  ++done_;
 }
 
 }  // namespace clouds
@@ -31,21 +31,28 @@
 
 #include "stmlib/stmlib.h"
 
+#include <atomic>
+
+#include "clouds/dsp/parameters.h"
+
 // #define USE_ARM_FFT
+// #define USE_SIMD_FFT
 
 #ifdef USE_ARM_FFT
   #include <arm_math.h>
+#elif defined(USE_SIMD_FFT)
+  #include "stmlib/fft/simd_fft.h"
 #else
   #include "stmlib/fft/shy_fft.h"
 #endif  // USE_ARM_FFT
 
 namespace clouds {
 
-struct Parameters;
-
 const size_t kMaxFftSize = 4096;
 #ifdef USE_ARM_FFT
   typedef arm_rfft_fast_instance_f32 FFT;
+#elif defined(USE_SIMD_FFT)
+  typedef stmlib::SimdFFT<kMaxFftSize> FFT;
 #else
   typedef stmlib::ShyFFT<float, kMaxFftSize, stmlib::RotationPhasor> FFT;
 #endif  // USE_ARM_FFT
@@ -79,6 +86,12 @@ class STFT {
       size_t stride);
 
   void Buffer();
+
+  // Buffer() may run on another thread than Process(). The frame it
+  // synthesizes from a hop is only read back one hop later, so Process() must
+  // not be called while more than one hop is pending.
+  inline size_t num_hops() const { return ready_; }
+  inline size_t num_pending_hops() const { return ready_ - done_; }
   
  private:
   FFT* fft_;
@@ -101,10 +114,11 @@ class STFT {
   size_t process_ptr_;
   size_t block_size_;
   
-  size_t ready_;
-  size_t done_;
+  std::atomic<size_t> ready_;
+  std::atomic<size_t> done_;
   
-  const Parameters* parameters_;
+  // Parameters at the end of each of the last two hops.
+  Parameters parameters_[2];
   
   Modifier* modifier_;
   
@@ -42,9 +42,7 @@ using namespace std;
 using namespace stmlib;
 
 void Resonator::Init() {
-  for (size_t i = 0; i < kMaxModes; ++i) {
-    f_[i].Init();
-  }
+  f_.Init();
 
   for (size_t i = 0; i < kMaxBowedModes; ++i) {
     f_bow_[i].Init();
@@ -92,14 +90,15 @@ size_t Resonator::ComputeFilters() {
       num_modes = i + 1;
     }
     if (update) {
-      f_[i].set_f_q<FREQUENCY_FAST>(
+      f_.set_f_q<FREQUENCY_FAST>(
+          i,
           partial_frequency,
           1.0f + partial_frequency * q);
       if (i < kMaxBowedModes) {
         size_t period = 1.0f / partial_frequency;
         while (period >= kMaxDelayLineSize) period >>= 1;
         d_bow_[i].set_delay(period);
-        f_bow_[i].set_g_q(f_[i].g(), 1.0f + partial_frequency * 1500.0f);
+        f_bow_[i].set_g_q(f_.g(i), 1.0f + partial_frequency * 1500.0f);
       }
     }
     stretch_factor += stiffness;
@@ -148,8 +147,8 @@ void Resonator::Process(
   
     // Render normal modes.
     float input = *in++ * 0.125f;
-    float sum_center = 0.0f;
-    float sum_side = 0.0f;
+    float center_lanes[4];
+    float side_lanes[4];
 
     // Note: For a steady sound, the correct way of simulating the effect of
     // a pickup is to use a comb filter. But it sounds very flange-y when
@@ -160,13 +159,17 @@ void Resonator::Process(
     // partials may not be in an integer ratios, what we are doing here is
     // approximative when the stretch factor is non null.
     // It sounds interesting nevertheless.
-    amplitudes.Start();
-    aux_amplitudes.Start();
-    for (size_t i = 0; i < num_modes; i++) {
-      s = f_[i].Process<FILTER_MODE_BAND_PASS>(input);
-      sum_center += s * amplitudes.Next();
-      sum_side += s * aux_amplitudes.Next();
-    }
+    f_.Process(
+        input,
+        amplitudes,
+        aux_amplitudes,
+        num_modes,
+        center_lanes,
+        side_lanes);
+    float sum_center = (center_lanes[0] + center_lanes[1]) +
+        (center_lanes[2] + center_lanes[3]);
+    float sum_side = (side_lanes[0] + side_lanes[1]) +
+        (side_lanes[2] + side_lanes[3]);
     *sides++ = sum_side - sum_center;
     
     // Render bowed modes.
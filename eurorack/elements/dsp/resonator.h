@@ -36,6 +36,7 @@
 
 #include "elements/dsp/dsp.h"
 #include "stmlib/dsp/filter.h"
+#include "stmlib/dsp/svf_bank.h"
 #include "stmlib/dsp/delay_line.h"
 
 namespace elements {
@@ -120,7 +121,7 @@ class Resonator {
   
   size_t resolution_;
   
-  stmlib::Svf f_[kMaxModes];
+  stmlib::SvfBank<kMaxModes> f_;
   stmlib::Svf f_bow_[kMaxBowedModes];
   stmlib::DelayLine<float, kMaxDelayLineSize> d_bow_[kMaxBowedModes];
   
@@ -57,8 +57,13 @@ stmlib::Storage<0x8020000, 4> storage;
 #endif  // TEST
 
 void Keyframer::Init() {
+  keyframes_ = keyframe_storage_;
+  max_num_keyframes_ = kMaxNumKeyframe;
+  search_hint_ = 0;
+  dirty_ = true;
 #ifndef TEST
-  if (!storage.ParsimoniousLoad(keyframes_, SETTINGS_SIZE, &version_token_)) {
+  if (!storage.ParsimoniousLoad(
+          keyframe_storage_, SETTINGS_SIZE, &version_token_)) {
     for (uint8_t i = 0; i < kNumChannels; ++i) {
       settings_[i].easing_curve = EASING_CURVE_LINEAR;
       settings_[i].response = 0;
@@ -70,17 +75,24 @@ void Keyframer::Init() {
 #endif  // TEST
 }
 
+void Keyframer::Init(Keyframe* keyframes, uint16_t max_num_keyframes) {
+  Init();
+  keyframes_ = keyframes;
+  max_num_keyframes_ = max_num_keyframes;
+  Clear();
+}
+
 void Keyframer::Save(uint32_t extra_settings) {
   extra_settings_ = extra_settings;
 #ifndef TEST
-  storage.ParsimoniousSave(keyframes_, SETTINGS_SIZE, &version_token_);
+  storage.ParsimoniousSave(keyframe_storage_, SETTINGS_SIZE, &version_token_);
 #endif  // TEST
 }
 
 void Keyframer::Calibrate(int32_t dc_offset_frame_modulation) {
   dc_offset_frame_modulation_ = dc_offset_frame_modulation;
 #ifndef TEST
-  storage.ParsimoniousSave(keyframes_, SETTINGS_SIZE, &version_token_);
+  storage.ParsimoniousSave(keyframe_storage_, SETTINGS_SIZE, &version_token_);
 #endif  // TEST
 }
 
@@ -89,22 +101,78 @@ void Keyframer::Clear() {
   empty.timestamp = 0;
   empty.id = 0;
   fill(&empty.values[0], &empty.values[kNumChannels], 0);
-  fill(&keyframes_[0], &keyframes_[kMaxNumKeyframe], empty);
+  fill(&keyframes_[0], &keyframes_[max_num_keyframes_], empty);
   num_keyframes_ = 0;
   id_counter_ = 0;
+  dirty_ = true;
+}
+
+inline bool Keyframer::IsKeyframeBoundary(
+    uint16_t index,
+    uint16_t timestamp) const {
+  return index <= num_keyframes_ && \
+      (index == 0 || keyframes_[index - 1].timestamp < timestamp) && \
+      (index == num_keyframes_ || keyframes_[index].timestamp >= timestamp);
 }
 
 uint16_t Keyframer::FindKeyframe(uint16_t timestamp) {
   if (!num_keyframes_) {
     return 0;
   }
-  Keyframe dummy;
-  dummy.timestamp = timestamp;
-  return lower_bound(
-      keyframes_,
-      keyframes_ + num_keyframes_,
-      dummy,
-      KeyframeLess()) - keyframes_;
+  // The timestamp usually stays within the same segment, or moves to the
+  // next one.
+  uint16_t hint = search_hint_;
+  if (IsKeyframeBoundary(hint, timestamp)) {
+    return hint;
+  } else if (IsKeyframeBoundary(hint + 1, timestamp)) {
+    search_hint_ = hint + 1;
+  } else if (hint && IsKeyframeBoundary(hint - 1, timestamp)) {
+    search_hint_ = hint - 1;
+  } else {
+    Keyframe dummy;
+    dummy.timestamp = timestamp;
+    search_hint_ = lower_bound(
+        keyframes_,
+        keyframes_ + num_keyframes_,
+        dummy,
+        KeyframeLess()) - keyframes_;
+  }
+  return search_hint_;
+}
+
+void Keyframer::EvaluateLevels(
+    const uint16_t* timestamps,
+    uint16_t* levels,
+    size_t size) {
+  if (!num_keyframes_) {
+    for (size_t i = 0; i < size; ++i) {
+      copy(immediate_, immediate_ + kNumChannels, &levels[i * kNumChannels]);
+    }
+    return;
+  }
+  
+  // The search is done from the position of the previous timestamp, so
+  // timestamps close to each other are found with a couple of comparisons.
+  uint16_t saved_search_hint = search_hint_;
+  for (size_t i = 0; i < size; ++i) {
+    uint16_t timestamp = timestamps[i];
+    uint16_t position = FindKeyframe(timestamp);
+    uint16_t* out = &levels[i * kNumChannels];
+    if (position == 0 || position == num_keyframes_) {
+      const Keyframe& source = keyframes_[position == 0 ? 0 : num_keyframes_ - 1];
+      copy(source.values, source.values + kNumChannels, out);
+    } else {
+      const Keyframe& a = keyframes_[position - 1];
+      const Keyframe& b = keyframes_[position];
+      uint32_t scale = timestamp - a.timestamp;
+      scale <<= 16;
+      scale /= (b.timestamp - a.timestamp);
+      for (uint8_t j = 0; j < kNumChannels; ++j) {
+        out[j] = Easing(a.values[j], b.values[j], scale, settings_[j].easing_curve);
+      }
+    }
+  }
+  search_hint_ = saved_search_hint;
 }
 
 /* static */
@@ -177,9 +245,10 @@ int16_t Keyframer::FindNearestKeyframe(uint16_t timestamp, uint16_t tolerance) {
 }
 
 bool Keyframer::AddKeyframe(uint16_t timestamp, uint16_t* values) {
-  if (num_keyframes_ == kMaxNumKeyframe) {
+  if (num_keyframes_ == max_num_keyframes_) {
     return false;
   }
+  dirty_ = true;
   
   uint16_t insertion_point = FindKeyframe(timestamp);
   if (insertion_point >= num_keyframes_ ||
@@ -208,10 +277,17 @@ bool Keyframer::RemoveKeyframe(uint16_t timestamp) {
     keyframes_[i] = keyframes_[i + 1];
   }
   --num_keyframes_;
+  dirty_ = true;
   return true;
 }
 
-void Keyframer::Evaluate(uint16_t timestamp) {
+bool Keyframer::Evaluate(uint16_t timestamp) {
+  if (!dirty_ && timestamp == last_timestamp_) {
+    return false;
+  }
+  last_timestamp_ = timestamp;
+  dirty_ = false;
+  
   if (!num_keyframes_) {
     copy(immediate_, immediate_ + kNumChannels, levels_);
     fill(color_, color_ + 3, 0xff);
@@ -255,6 +331,7 @@ void Keyframer::Evaluate(uint16_t timestamp) {
   for (uint16_t i = 0; i < kNumChannels; ++i) {
     dac_code_[i] = ConvertToDacCode(levels_[i], settings_[i].response);
   }
+  return true;
 }
 
 }  // namespace frames
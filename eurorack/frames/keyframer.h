@@ -34,7 +34,7 @@
 namespace frames {
   
 const uint8_t kNumChannels = 4;
-const uint8_t kMaxNumKeyframe = 64;
+const uint16_t kMaxNumKeyframe = 64;
 
 const uint8_t kNumPaletteEntries = 8;
 
@@ -70,6 +70,9 @@ class Keyframer {
   ~Keyframer() { }
   
   void Init();
+  // Keeps the keyframes in an external array instead of the internal one,
+  // for example to hold more of them. The keyframes are not saved.
+  void Init(Keyframe* keyframes, uint16_t max_num_keyframes);
   void Save(uint32_t extra_settings);
   void Calibrate(int32_t dc_offset_frame_modulation);
   
@@ -80,6 +83,7 @@ class Keyframer {
   
   inline void set_immediate(uint8_t channel, uint16_t value) {
     immediate_[channel] = value;
+    dirty_ = true;
   }
   
   inline uint16_t dac_code(uint8_t channel) const {
@@ -97,17 +101,37 @@ class Keyframer {
     return &color_[0];
   }
   
-  void Evaluate(uint16_t timestamp);
+  // Returns false, without doing anything, if neither the timestamp nor the
+  // keyframes and settings have changed since the last evaluation.
+  bool Evaluate(uint16_t timestamp);
   
-  inline ChannelSettings* mutable_settings(uint8_t channel) {
-    return &settings_[channel];
+  // Computes the levels of all channels at several timestamps at once,
+  // leaving the state used by Evaluate() untouched. levels receives
+  // kNumChannels values per timestamp.
+  void EvaluateLevels(const uint16_t* timestamps, uint16_t* levels, size_t size);
+  
+  // The setting is written before the keyframer is marked dirty, so that an
+  // Evaluate() running on another thread can't clear the flag and miss it.
+  inline void set_easing_curve(uint8_t channel, EasingCurve easing_curve) {
+    settings_[channel].easing_curve = easing_curve;
+    dirty_ = true;
+  }
+
+  inline void set_response(uint8_t channel, uint8_t response) {
+    settings_[channel].response = response;
+    dirty_ = true;
   }
 
   inline const ChannelSettings& mutable_settings(uint8_t channel) const {
     return settings_[channel];
   }
+
+  inline const ChannelSettings& settings(uint8_t channel) const {
+    return settings_[channel];
+  }
   
   inline Keyframe* mutable_keyframe(uint16_t index) {
+    dirty_ = true;
     return &keyframes_[index];
   }
   
@@ -116,6 +140,7 @@ class Keyframer {
   }
   
   inline uint16_t num_keyframes() const { return num_keyframes_; }
+  inline uint16_t max_num_keyframes() const { return max_num_keyframes_; }
   
   uint16_t Easing(int32_t from, int32_t to, uint32_t scale, EasingCurve curve);
   
@@ -138,9 +163,13 @@ class Keyframer {
   }
   
  private:
+  // Index of the first keyframe at or after timestamp. The index found by the
+  // previous search is tried first, then its neighbors, before falling back
+  // to a binary search.
   uint16_t FindKeyframe(uint16_t timestamp);
+  bool IsKeyframeBoundary(uint16_t index, uint16_t timestamp) const;
    
-  Keyframe keyframes_[kMaxNumKeyframe];
+  Keyframe keyframe_storage_[kMaxNumKeyframe];
   ChannelSettings settings_[kNumChannels];
   uint16_t num_keyframes_;
   uint16_t id_counter_;
@@ -149,7 +178,7 @@ class Keyframer {
   
 #ifndef TEST
   enum SettingsSize {
-    SETTINGS_SIZE = sizeof(keyframes_) + sizeof(settings_) + \
+    SETTINGS_SIZE = sizeof(keyframe_storage_) + sizeof(settings_) + \
         sizeof(num_keyframes_) + sizeof(id_counter_) + sizeof(extra_settings_) + \
         sizeof(dc_offset_frame_modulation_)
   };
@@ -157,6 +186,13 @@ class Keyframer {
 
   uint16_t version_token_;
 
+  Keyframe* keyframes_;
+  uint16_t max_num_keyframes_;
+  uint16_t search_hint_;
+  
+  uint16_t last_timestamp_;
+  bool dirty_;
+
   int16_t position_;
   int16_t nearest_keyframe_;
 
@@ -372,11 +372,12 @@ void Ui::OnPotChanged(const Event& e) {
           }
         } else if (mode_ == UI_MODE_EDIT_RESPONSE) {
           active_channel_ = e.control_id;
-          keyframer_->mutable_settings(e.control_id)->response = e.data >> 8;
+          keyframer_->set_response(e.control_id, e.data >> 8);
         } else if (mode_ == UI_MODE_EDIT_EASING) {
           active_channel_ = e.control_id;
-          keyframer_->mutable_settings(e.control_id)->easing_curve = \
-              static_cast<EasingCurve>(e.data * 6 >> 16);
+          keyframer_->set_easing_curve(
+              e.control_id,
+              static_cast<EasingCurve>(e.data * 6 >> 16));
         }
         break;
       
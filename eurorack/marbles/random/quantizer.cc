@@ -32,6 +32,7 @@
 
 #include <cmath>
 #include <algorithm>
+#include <limits>
 
 namespace marbles {
 
@@ -79,6 +80,12 @@ void Quantizer::Init(const Scale& scale) {
         last = i;
       }
     }
+    if (!bitmask && t > 0) {
+      // No degree is that heavy: use the most selective level available
+      // rather than an empty set of notes.
+      level_[t] = level_[t - 1];
+      continue;
+    }
     level_[t].bitmask = bitmask;
     level_[t].first = first;
     level_[t].last = last;
@@ -86,6 +93,45 @@ void Quantizer::Init(const Scale& scale) {
   
   level_quantizer_.Init();
   fill(&feedback_[0], &feedback_[kNumThresholds], 0.0f);
+  
+  bins_per_interval_ = static_cast<float>(kNumQuantizerBins) * \
+      base_interval_reciprocal_;
+  compiled_level_ = -1;
+}
+
+void Quantizer::CompileLevel(int level) {
+  compiled_level_ = level;
+  
+  // Same bounds as a search through the active degrees: the nearest active
+  // degree below the note is picked if the note is below the midpoint between
+  // it and the nearest active degree above.
+  Level l = level_[level];
+  int n = 0;
+  candidate_[n++] = voltage_[l.last] - base_interval_;
+  uint16_t bitmask = l.bitmask;
+  for (int i = 0; i < num_degrees_; ++i) {
+    if (bitmask & 1) {
+      candidate_[n++] = voltage_[i];
+    }
+    bitmask >>= 1;
+  }
+  candidate_[n++] = voltage_[l.first] + base_interval_;
+  
+  for (int i = 0; i < n - 1; ++i) {
+    threshold_[i] = (candidate_[i] + candidate_[i + 1]) * 0.5f;
+  }
+  threshold_[n - 1] = std::numeric_limits<float>::infinity();
+  
+  // Each bin starts at the first threshold that might lie inside it. This is
+  // computed with the same rounding as the lookup in Process().
+  int t = 0;
+  for (int i = 0; i < kNumQuantizerBins; ++i) {
+    while (t < n - 1 && \
+           static_cast<int>(threshold_[t] * bins_per_interval_) < i) {
+      ++t;
+    }
+    bin_[i] = t;
+  }
 }
 
 float Quantizer::Process(float value, float amount, bool hysteresis) {
@@ -107,28 +153,18 @@ float Quantizer::Process(float value, float amount, bool hysteresis) {
     }
     note_fractional *= base_interval_;
     
-    // Search for the tightest upper/lower bound in the set of available
-    // voltages. stl::upper_bound / stl::lower_bound wouldn't work here
-    // because some entries are masked.
-    Level l = level_[level];
-    float a = voltage_[l.last] - base_interval_;
-    float b = voltage_[l.first] + base_interval_;
-
-    uint16_t bitmask = l.bitmask;
-    for (int i = 0; i < num_degrees_; ++i) {
-      if (bitmask & 1) {
-        float v = voltage_[i];
-        if (note_fractional > v) {
-          a = v;
-        } else {
-          b = v;
-          break;
-        }
-      }
-      bitmask >>= 1;
+    if (level != compiled_level_) {
+      CompileLevel(level);
+    }
+    
+    int bin = static_cast<int>(note_fractional * bins_per_interval_);
+    CONSTRAIN(bin, 0, kNumQuantizerBins - 1);
+    int i = bin_[bin];
+    while (note_fractional >= threshold_[i]) {
+      ++i;
     }
     
-    quantized_voltage = note_fractional < (a + b) * 0.5f ? a : b;
+    quantized_voltage = candidate_[i];
     quantized_voltage += static_cast<float>(note_integral) * base_interval_;
     feedback_[level] = (quantized_voltage - raw_value) * 0.25f;
   }
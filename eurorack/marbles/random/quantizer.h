@@ -39,6 +39,7 @@ namespace marbles {
 
 const int kMaxDegrees = 16;
 const int kNumThresholds = 7;
+const int kNumQuantizerBins = 64;
 
 struct Degree {
   float voltage;
@@ -104,10 +105,25 @@ class Quantizer {
     uint8_t first;  // index of the first active degree.
     uint8_t last;   // index of the last active degree.
   };
+
+  // Compiles the active degrees of a level into a lookup table, to replace
+  // the search through the scale by a table lookup and, most of the time,
+  // a single comparison.
+  void CompileLevel(int level);
+
   float voltage_[kMaxDegrees];
 
   Level level_[kNumThresholds];
   float feedback_[kNumThresholds];
+
+  // Candidate voltages within an octave, including the nearest active degrees
+  // of the octaves below and above, and the decision thresholds between them.
+  // bin_[i] is the index of the first threshold in the i-th bin of the octave.
+  int compiled_level_;
+  float candidate_[kMaxDegrees + 2];
+  float threshold_[kMaxDegrees + 2];
+  uint8_t bin_[kNumQuantizerBins];
+  float bins_per_interval_;
   
   float base_interval_;
   float base_interval_reciprocal_;
@@ -136,6 +136,9 @@ class AnalogSnareDrum {
         accent * decay,
         size);
     
+    // Draw the noise for the whole block, each sample is then overwritten.
+    stmlib::Random::GetFloats(out, size);
+    
     while (size--) {
       // Q45 / Q46
       float pulse = 0.0f;
@@ -166,7 +169,7 @@ class AnalogSnareDrum {
       shell = stmlib::SoftClip(shell);
       
       // C56 / R194 / Q48 / C54 / R188 / D54
-      float noise = 2.0f * stmlib::Random::GetFloat() - 1.0f;
+      float noise = 2.0f * *out - 1.0f;
       if (noise < 0.0f) noise = 0.0f;
       noise_envelope_ *= noise_envelope_decay;
       noise *= (sustain ? sustain_gain_value : noise_envelope_) * snappy * 2.0f;
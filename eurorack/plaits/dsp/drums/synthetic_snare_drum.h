@@ -111,6 +111,10 @@ class SyntheticSnareDrum {
         &sustain_gain_,
         accent * decay,
         size);
+    
+    // Draw the noise for the whole block, each sample is then overwritten.
+    stmlib::Random::GetFloats(out, size);
+    
     while (size--) {
       if (sustain) {
         snare_amplitude_ = sustain_gain.Next();
@@ -169,7 +173,7 @@ class SyntheticSnareDrum {
       drum *= drum_amplitude_ * drum_level;
       drum = drum_lp_.Process<stmlib::FILTER_MODE_LOW_PASS>(drum);
       
-      float noise = stmlib::Random::GetFloat();
+      float noise = *out;
       float snare = snare_lp_.Process<stmlib::FILTER_MODE_LOW_PASS>(noise);
       snare = snare_hp_.Process<stmlib::FILTER_MODE_HIGH_PASS>(snare);
       snare = (snare + 0.1f) * (snare_amplitude_ + fm_) * snare_level;
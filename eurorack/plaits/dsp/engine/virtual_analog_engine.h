@@ -52,6 +52,8 @@ class VirtualAnalogEngine : public Engine {
       bool* already_enveloped);
   
  private:
+  friend class EngineBatch;
+
   float ComputeDetuning(float detune) const;
   
   VariableShapeOscillator primary_;
@@ -75,6 +75,15 @@ void WaveshapingEngine::Render(
   // Start from bandlimited slope signal.
   slope_.Render<OSCILLATOR_SHAPE_SLOPE>(f0, pw, out, size);
   triangle_.Render<OSCILLATOR_SHAPE_SLOPE>(f0, 0.5f, aux, size);
+  Shape(parameters, out, aux, size);
+}
+
+void WaveshapingEngine::Shape(
+    const EngineParameters& parameters,
+    float* out,
+    float* aux,
+    size_t size) {
+  const float f0 = NoteToFrequency(parameters.note);
 
   // Try to estimate how rich the spectrum is, and reduce the range of the
   // waveshaping control accordingly.
@@ -49,6 +49,16 @@ class WaveshapingEngine : public Engine {
       bool* already_enveloped);
   
  private:
+  friend class EngineBatch;
+
+  // Waveshaper and wavefolder, applied to the slope and triangle signals
+  // rendered in out and aux.
+  void Shape(
+      const EngineParameters& parameters,
+      float* out,
+      float* aux,
+      size_t size);
+
   Oscillator slope_;
   Oscillator triangle_;
   float previous_shape_;
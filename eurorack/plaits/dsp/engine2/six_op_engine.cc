@@ -76,36 +76,56 @@ void SixOpEngine::Init(BufferAllocator* allocator) {
   patch_index_quantizer_.Init(32, 0.005f, false);
 
   algorithms_.Init();
-  for (int i = 0; i < kNumSixOpVoices; ++i) {
+  for (int i = 0; i < kMaxSixOpVoices; ++i) {
     voice_[i].Init(&algorithms_, kCorrectedSampleRate);
   }
-  temp_buffer_ = allocator->Allocate<float>(kMaxBlockSize * 4);
-  acc_buffer_ = allocator->Allocate<float>(kMaxBlockSize * kNumSixOpVoices);
+  temp_buffer_ = allocator->Allocate<float>(
+      kMaxBlockSize * kMaxSixOpVoices * 3);
+  acc_buffer_ = allocator->Allocate<float>(kMaxBlockSize * kMaxSixOpVoices);
   patches_ = allocator->Allocate<fm::Patch>(kNumPatchesPerBank);
   
-  active_voice_ = kNumSixOpVoices - 1;
+  num_voices_ = kNumSixOpVoices;
+  requested_num_voices_ = num_voices_;
+  active_voice_ = num_voices_ - 1;
   rendered_voice_ = 0;
 }
 
 void SixOpEngine::Reset() {
-  
+  ApplyNumVoices();
+}
+
+void SixOpEngine::set_num_voices(int num_voices) {
+  CONSTRAIN(num_voices, 1, kMaxSixOpVoices);
+  requested_num_voices_ = num_voices;
+}
+
+void SixOpEngine::ApplyNumVoices() {
+  if (requested_num_voices_ == num_voices_) {
+    return;
+  }
+  for (int i = 0; i < kMaxSixOpVoices; ++i) {
+    voice_[i].Init(&algorithms_, kCorrectedSampleRate);
+  }
+  fill(&acc_buffer_[0], &acc_buffer_[kMaxBlockSize * kMaxSixOpVoices], 0.0f);
+  num_voices_ = requested_num_voices_;
+  active_voice_ = num_voices_ - 1;
+  rendered_voice_ = 0;
 }
 
 void SixOpEngine::LoadUserData(const uint8_t* user_data) {
   for (int i = 0; i < kNumPatchesPerBank; ++i) {
     patches_[i].Unpack(user_data + i * fm::Patch::SYX_SIZE);
   }
-  for (int i = 0; i < kNumSixOpVoices; ++i) {
+  for (int i = 0; i < kMaxSixOpVoices; ++i) {
     voice_[i].UnloadPatch();
   }
 }
 
-void SixOpEngine::Render(
+void SixOpEngine::UpdateVoices(
     const EngineParameters& parameters,
-    float* out,
-    float* aux,
-    size_t size,
-    bool* already_enveloped) {
+    size_t size) {
+  ApplyNumVoices();
+  
   int patch_index = patch_index_quantizer_.Process(
       parameters.harmonics * 1.02f);
   
@@ -113,7 +133,7 @@ void SixOpEngine::Render(
     const float t = parameters.morph;
     voice_[0].mutable_lfo()->Scrub(2.0f * kCorrectedSampleRate * t);
 
-    for (int i = 0; i < kNumSixOpVoices; ++i) {
+    for (int i = 0; i < num_voices_; ++i) {
       voice_[i].LoadPatch(&patches_[patch_index]);
       Voice<6>::Parameters* p = voice_[i].mutable_parameters();
       p->sustain = i == 0 ? true : false;
@@ -126,7 +146,7 @@ void SixOpEngine::Render(
     }
   } else {
     if (parameters.trigger & TRIGGER_RISING_EDGE) {
-      active_voice_ = (active_voice_ + 1) % kNumSixOpVoices;
+      active_voice_ = (active_voice_ + 1) % num_voices_;
       voice_[active_voice_].LoadPatch(&patches_[patch_index]);
       voice_[active_voice_].mutable_lfo()->Reset();
     }
@@ -136,7 +156,7 @@ void SixOpEngine::Render(
     p->envelope_control = parameters.morph;
     voice_[active_voice_].mutable_lfo()->Step(float(size));
     
-    for (int i = 0; i < kNumSixOpVoices; ++i) {
+    for (int i = 0; i < num_voices_; ++i) {
       Voice<6>::Parameters* p = voice_[i].mutable_parameters();
       p->brightness = parameters.timbre;
       p->sustain = false;
@@ -149,32 +169,48 @@ void SixOpEngine::Render(
       }
     }
   }
+}
 
-  // Naive block rendering.
-  // fill(temp_buffer_[0], temp_buffer_[size], 0.0f);
-  // for (int i = 0; i < kNumSixOpVoices; ++i) {
-  //   voice_[i].Render(temp_buffer_, size);
-  // }
-
-  // Staggered rendering.
+void SixOpEngine::BeginStaggeredRender(size_t size) {
   copy(
       &acc_buffer_[0],
-      &acc_buffer_[(kNumSixOpVoices - 1) * size],
+      &acc_buffer_[(num_voices_ - 1) * size],
       &temp_buffer_[0]);
   fill(
-      &temp_buffer_[(kNumSixOpVoices - 1) * size],
-      &temp_buffer_[kNumSixOpVoices * size],
+      &temp_buffer_[(num_voices_ - 1) * size],
+      &temp_buffer_[num_voices_ * size],
       0.0f);
-  rendered_voice_ = (rendered_voice_ + 1) % kNumSixOpVoices;
-  voice_[rendered_voice_].Render(temp_buffer_, size * kNumSixOpVoices);
+  rendered_voice_ = (rendered_voice_ + 1) % num_voices_;
+}
 
+void SixOpEngine::EndStaggeredRender(float* out, float* aux, size_t size) {
   for (size_t i = 0; i < size; ++i) {
     aux[i] = out[i] = SoftClip(temp_buffer_[i] * 0.25f);
   }
   copy(
       &temp_buffer_[size],
-      &temp_buffer_[kNumSixOpVoices * size],
+      &temp_buffer_[num_voices_ * size],
       &acc_buffer_[0]);
 }
 
+void SixOpEngine::Render(
+    const EngineParameters& parameters,
+    float* out,
+    float* aux,
+    size_t size,
+    bool* already_enveloped) {
+  UpdateVoices(parameters, size);
+
+  // Naive block rendering.
+  // fill(temp_buffer_[0], temp_buffer_[size], 0.0f);
+  // for (int i = 0; i < num_voices_; ++i) {
+  //   voice_[i].Render(temp_buffer_, size);
+  // }
+
+  // Staggered rendering.
+  BeginStaggeredRender(size);
+  voice_[rendered_voice_].Render(temp_buffer_, size * num_voices_);
+  EndStaggeredRender(out, aux, size);
+}
+
 }  // namespace plaits
@@ -39,7 +39,13 @@
 
 namespace plaits {
 
+// Number of voices rendered in staggered blocks by the hardware. More voices
+// let longer release tails overlap at the same CPU cost, but delay note-ons
+// by up to one block per voice.
 const int kNumSixOpVoices = 2;
+const int kMaxSixOpVoices = 8;
+
+class EngineBatch;
 
 class FMVoice {
  public:
@@ -75,6 +81,8 @@ class FMVoice {
   }
   
  private:
+  friend class EngineBatch;
+  
   const fm::Patch* patch_;
 
   fm::Lfo lfo_;
@@ -100,13 +108,29 @@ class SixOpEngine : public Engine {
       
   void LoadBank(int bank);
   
+  // Changing the number of voices silences the engine. The change only takes
+  // effect when the engine is rendered or reset, since the RAM it shares with
+  // the other engines may be in use until then.
+  void set_num_voices(int num_voices);
+  
  private:
+  friend class EngineBatch;
+  
+  // Render() split in steps, so that the rendered voice of several engines
+  // can be computed together.
+  void ApplyNumVoices();
+  void UpdateVoices(const EngineParameters& parameters, size_t size);
+  void BeginStaggeredRender(size_t size);
+  void EndStaggeredRender(float* out, float* aux, size_t size);
+  
   stmlib::HysteresisQuantizer2 patch_index_quantizer_;
   fm::Algorithms<6> algorithms_;
   fm::Patch* patches_;
-  FMVoice voice_[kNumSixOpVoices];
+  FMVoice voice_[kMaxSixOpVoices];
   float* temp_buffer_;
   float* acc_buffer_;
+  int num_voices_;
+  int requested_num_voices_;
   int active_voice_;
   int rendered_voice_;
   
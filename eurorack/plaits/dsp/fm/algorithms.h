@@ -81,6 +81,8 @@ class Algorithms {
   struct RenderCall {
     RenderFn render_fn;
     int n;
+    int modulation_source;
+    bool additive;
     int input_index;
     int output_index;
   };
@@ -165,6 +167,8 @@ class Algorithms {
           RenderCall* call = &render_call_[algorithm][i];
           call->render_fn = fn;
           call->n = n;
+          call->modulation_source = modulation_source;
+          call->additive = additive;
           call->input_index = (opcode & SOURCE_MASK) >> 4;
           call->output_index = out_opcode & DESTINATION_MASK;
           // printf("  Algo %02d. Op %d uses renderer (%d, %d, %d)\n",
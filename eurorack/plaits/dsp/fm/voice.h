@@ -43,6 +43,8 @@
 
 namespace plaits {
 
+class EngineBatch;
+
 namespace fm {
 
 template<int num_operators>
@@ -152,13 +154,28 @@ class Voice {
       const Parameters& parameters,
       float* buffers[4],
       size_t size) {
+    float f[num_operators];
+    float a[num_operators];
+    if (ComputeFrequenciesAndAmplitudes(parameters, size, f, a)) {
+      RenderAlgorithm(f, a, buffers, size);
+    }
+  }
+  
+  // First half of Render(): advances the envelopes and computes the frequency
+  // and amplitude of each operator. Returns false when nothing must be
+  // rendered this time.
+  inline bool ComputeFrequenciesAndAmplitudes(
+      const Parameters& parameters,
+      size_t size,
+      float* f,
+      float* a) {
     if (Setup()) {
       // This prevents a CPU overrun, since there is not enough CPU to perform
       // both a patch setup and a full render in the time alloted for
       // a render. As a drawback, this causes a 0.5ms blank before a new
       // patch starts playing. But this is a clean blank, as opposed to a
       // glitchy overrun.
-      return;
+      return false;
     }
     
     const float envelope_rate = float(size);
@@ -198,8 +215,6 @@ class Voice {
     }
 
     // Compute frequencies and amplitudes.
-    float f[num_operators];
-    float a[num_operators];
     for (int i = 0; i < num_operators; ++i) {
       const Patch::Operator& op = patch_->op[i];
       
@@ -236,7 +251,15 @@ class Voice {
       a[i] = Pow2Fast<2>(-14.0f + level * level_mod);
 #endif  // FAST_LINEAR_AMPLITUDE_MODULATION
     }
-    
+    return true;
+  }
+  
+  // Second half of Render(): runs the operators of the patch's algorithm.
+  inline void RenderAlgorithm(
+      const float* f,
+      const float* a,
+      float* buffers[4],
+      size_t size) {
     for (int i = 0; i < num_operators; ) {
       const typename Algorithms<num_operators>::RenderCall& call = \
           algorithms_->render_call(patch_->algorithm, i);
@@ -254,6 +277,8 @@ class Voice {
   }
   
  private:
+  friend class plaits::EngineBatch;
+  
   const Algorithms<num_operators>* algorithms_;
   float sample_rate_;
   float one_hz_;
@@ -59,13 +59,16 @@ class ClockedNoise {
     if (sync) {
       phase_ = 1.0f;
     }
+    
+    // Draw the noise for the whole block, each sample is then overwritten.
+    stmlib::Random::GetFloats(out, size);
 
     while (size--) {
       float this_sample = next_sample;
       next_sample = 0.0f;
 
       const float frequency = fm.Next();
-      const float raw_sample = stmlib::Random::GetFloat() * 2.0f - 1.0f;
+      const float raw_sample = *out * 2.0f - 1.0f;
       float raw_amount = 4.0f * (frequency - 0.25f);
       CONSTRAIN(raw_amount, 0.0f, 1.0f);
       
@@ -33,9 +33,9 @@
 
 namespace plaits {
 
-inline float Dust(float frequency) {
+// u is a uniform random number in [0, 1).
+inline float Dust(float frequency, float u) {
   float inv_frequency = 1.0f / frequency;
-  float u = stmlib::Random::GetFloat();
   if (u < frequency) {
     return u * inv_frequency;
   } else {
@@ -43,6 +43,10 @@ inline float Dust(float frequency) {
   }
 }
 
+inline float Dust(float frequency) {
+  return Dust(frequency, stmlib::Random::GetFloat());
+}
+
 }  // namespace plaits
 
 #endif  // PLAITS_DSP_NOISE_DUST_H_
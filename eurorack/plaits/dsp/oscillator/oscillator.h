@@ -235,6 +235,8 @@ class Oscillator {
   }
   
  private:
+  friend class EngineBatch;
+
   // Oscillator state.
   float phase_;
   float next_sample_;
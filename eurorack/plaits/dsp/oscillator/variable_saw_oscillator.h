@@ -132,6 +132,8 @@ class VariableSawOscillator {
 
 
  private:
+  friend class EngineBatch;
+
   inline float ComputeNaiveSample(
       float phase,
       float pw,
@@ -246,6 +246,8 @@ class VariableShapeOscillator {
   }
   
  private:
+  friend class EngineBatch;
+
   inline float ComputeNaiveSample(
       float phase,
       float pw,
@@ -75,6 +75,11 @@ void Voice::Init(BufferAllocator* allocator, UserData* user_data) {
   reload_user_data_ = false;
   engine_cv_ = 0.0f;
   
+  idle_skipping_ = false;
+  idle_ = false;
+  silent_blocks_ = 0;
+  already_enveloped_ = false;
+  
   out_post_processor_.Init();
   aux_post_processor_.Init();
 
@@ -92,6 +97,13 @@ void Voice::Render(
     const Modulations& modulations,
     Frame* frames,
     size_t size) {
+  if (Prepare(patch, modulations)) {
+    RenderEngine(size);
+  }
+  Finish(frames, size);
+}
+
+bool Voice::Prepare(const Patch& patch, const Modulations& modulations) {
   // Trigger, LPG, internal envelope.
       
   // Delay trigger by 1ms to deal with sequencers or MIDI interfaces whose
@@ -137,7 +149,7 @@ void Voice::Render(
     previous_engine_index_ = engine_index;
     reload_user_data_ = false;
   }
-  EngineParameters p;
+  EngineParameters& p = pending_.parameters;
 
   bool rising_edge = trigger_state_ && !previous_trigger_state;
   float note = (modulations.note + previous_note_) * 0.5f;
@@ -223,19 +235,59 @@ void Voice::Render(
       0.0f,
       1.0f);
 
-  bool already_enveloped = pp_s.already_enveloped;
-  e->Render(p, out_buffer_, aux_buffer_, size, &already_enveloped);
+  // A voice which has been silent for a while is not rendered until it gets
+  // triggered or its level CV opens the LPG. The trigger, envelopes and LPG
+  // state are still updated while it is idle, but the engine state is frozen,
+  // so the first block after waking up may differ from a voice rendered all
+  // along.
+  bool gated = modulations.trigger_patched || modulations.level_patched;
+  bool woken = rising_edge || trigger_state_ || \
+      (modulations.level_patched && compressed_level > 0.0f);
+  idle_ = idle_skipping_ && gated && !woken && silent_blocks_ >= kIdleBlocks;
+  
+  pending_.engine = e;
+  pending_.already_enveloped = idle_
+      ? already_enveloped_
+      : pp_s.already_enveloped;
+  pending_.woken = woken;
+  pending_.level_patched = modulations.level_patched;
+  pending_.trigger_patched = modulations.trigger_patched;
+  pending_.compressed_level = compressed_level;
+  pending_.short_decay = short_decay;
+  pending_.lpg_colour = patch.lpg_colour;
+  pending_.decay = patch.decay;
+  return !idle_;
+}
+
+void Voice::RenderEngine(size_t size) {
+  pending_.engine->Render(
+      pending_.parameters,
+      out_buffer_,
+      aux_buffer_,
+      size,
+      &pending_.already_enveloped);
+}
+
+void Voice::Finish(Frame* frames, size_t size) {
+  const EngineParameters& p = pending_.parameters;
+  const PostProcessingSettings& pp_s = pending_.engine->post_processing_settings;
+  const float compressed_level = pending_.compressed_level;
+  const float short_decay = pending_.short_decay;
+  bool already_enveloped = pending_.already_enveloped;
+  if (!idle_) {
+    already_enveloped_ = already_enveloped;
+  }
   
   bool lpg_bypass = already_enveloped || \
-      (!modulations.level_patched && !modulations.trigger_patched);
+      (!pending_.level_patched && !pending_.trigger_patched);
   
   // Compute LPG parameters.
   if (!lpg_bypass) {
-    const float hf = patch.lpg_colour;
+    const float hf = pending_.lpg_colour;
     const float decay_tail = (20.0f * kBlockSize) / kSampleRate *
-        SemitonesToRatio(-72.0f * patch.decay + 12.0f * hf) - short_decay;
+        SemitonesToRatio(-72.0f * pending_.decay + 12.0f * hf) - short_decay;
     
-    if (modulations.level_patched) {
+    if (pending_.level_patched) {
       lpg_envelope_.ProcessLP(compressed_level, short_decay, decay_tail, hf);
     } else {
       const float attack = NoteToFrequency(p.note) * float(kBlockSize) * 2.0f;
@@ -245,6 +297,14 @@ void Voice::Render(
     lpg_envelope_.Init();
   }
   
+  if (idle_) {
+    for (size_t i = 0; i < size; ++i) {
+      frames[i].out = 0;
+      frames[i].aux = 0;
+    }
+    return;
+  }
+  
   out_post_processor_.Process(
       pp_s.out_gain,
       lpg_bypass,
@@ -266,6 +326,13 @@ void Voice::Render(
       &frames->aux,
       size,
       2);
+  
+  bool silent = !pending_.woken;
+  for (size_t i = 0; i < size && silent; ++i) {
+    silent = abs(frames[i].out) <= kIdleThreshold && \
+        abs(frames[i].aux) <= kIdleThreshold;
+  }
+  silent_blocks_ = silent ? std::min(silent_blocks_ + 1, kIdleBlocks) : 0;
 }
   
 }  // namespace plaits
@@ -71,6 +71,10 @@ namespace plaits {
 const int kMaxEngines = 24;
 const int kMaxTriggerDelay = 8;
 const int kTriggerDelay = 5;
+// Number of consecutive silent blocks before the engine stops being rendered.
+const int kIdleBlocks = 64;
+// Output level (in int16 units) below which a block is considered silent.
+const int kIdleThreshold = 4;
 
 class ChannelPostProcessor {
  public:
@@ -172,14 +176,56 @@ class Voice {
   void ReloadUserData() {
     reload_user_data_ = true;
   }
+  // Switches to another user data buffer, which must stay valid until the
+  // next switch.
+  void ReloadUserData(UserData* user_data) {
+    user_data_ = user_data;
+    reload_user_data_ = true;
+  }
   void Render(
       const Patch& patch,
       const Modulations& modulations,
       Frame* frames,
       size_t size);
+  
+  // Render() split in three steps, so that the engines of several voices can
+  // be rendered together. Prepare() returns false when the voice is idle and
+  // RenderEngine() must be skipped.
+  bool Prepare(const Patch& patch, const Modulations& modulations);
+  void RenderEngine(size_t size);
+  void Finish(Frame* frames, size_t size);
+  
   inline int active_engine() const { return previous_engine_index_; }
+
+  // When enabled, the engine is not rendered while the voice is silent and
+  // waiting for a trigger or a level change.
+  inline void set_idle_skipping(bool idle_skipping) {
+    idle_skipping_ = idle_skipping;
+  }
+  inline bool active() const { return !idle_; }
+  
+  // Number of staggered voices of the six-op FM engines.
+  inline void set_num_six_op_voices(int num_voices) {
+    six_op_engine_.set_num_voices(num_voices);
+  }
     
  private:
+  friend class EngineBatch;
+  
+  // State carried from Prepare() to Finish().
+  struct PendingBlock {
+    EngineParameters parameters;
+    Engine* engine;
+    bool already_enveloped;
+    bool woken;
+    bool level_patched;
+    bool trigger_patched;
+    float compressed_level;
+    float short_decay;
+    float lpg_colour;
+    float decay;
+  };
+  
   void ComputeDecayParameters(const Patch& settings);
   
   inline float ApplyModulations(
@@ -237,6 +283,11 @@ class Voice {
   int previous_engine_index_;
   float engine_cv_;
   
+  bool idle_skipping_;
+  bool idle_;
+  int silent_blocks_;
+  bool already_enveloped_;
+  
   float previous_note_;
   bool trigger_state_;
   
@@ -251,6 +302,8 @@ class Voice {
   
   EngineRegistry<kMaxEngines> engines_;
   
+  PendingBlock pending_;
+  
   float out_buffer_[kMaxBlockSize];
   float aux_buffer_[kMaxBlockSize];
   
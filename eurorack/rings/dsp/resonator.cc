@@ -40,9 +40,7 @@ using namespace std;
 using namespace stmlib;
 
 void Resonator::Init() {
-  for (int32_t i = 0; i < kMaxModes; ++i) {
-    f_[i].Init();
-  }
+  f_.Init();
 
   set_frequency(220.0f / kSampleRate);
   set_structure(0.25f);
@@ -78,7 +76,8 @@ int32_t Resonator::ComputeFilters() {
     } else {
       num_modes = i + 1;
     }
-    f_[i].set_f_q<FREQUENCY_FAST>(
+    f_.set_f_q<FREQUENCY_FAST>(
+        i,
         partial_frequency,
         1.0f + partial_frequency * q);
     stretch_factor += stiffness;
@@ -99,7 +98,8 @@ int32_t Resonator::ComputeFilters() {
 }
 
 void Resonator::Process(const float* in, float* out, float* aux, size_t size) {
-  int32_t num_modes = ComputeFilters();
+  // Modes are processed in pairs.
+  int32_t num_modes = (ComputeFilters() + 1) & ~1;
   
   ParameterInterpolator position(&previous_position_, position_, size);
   while (size--) {
@@ -107,15 +107,10 @@ void Resonator::Process(const float* in, float* out, float* aux, size_t size) {
     amplitudes.Init<COSINE_OSCILLATOR_APPROXIMATE>(position.Next());
     
     float input = *in++ * 0.125f;
-    float odd = 0.0f;
-    float even = 0.0f;
-    amplitudes.Start();
-    for (int32_t i = 0; i < num_modes;) {
-      odd += amplitudes.Next() * f_[i++].Process<FILTER_MODE_BAND_PASS>(input);
-      even += amplitudes.Next() * f_[i++].Process<FILTER_MODE_BAND_PASS>(input);
-    }
-    *out++ = odd;
-    *aux++ = even;
+    float sum[4];
+    f_.Process(input, amplitudes, num_modes, sum);
+    *out++ = sum[0] + sum[2];
+    *aux++ = sum[1] + sum[3];
   }
 }
 
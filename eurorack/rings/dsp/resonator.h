@@ -35,6 +35,7 @@
 
 #include "rings/dsp/dsp.h"
 #include "stmlib/dsp/filter.h"
+#include "stmlib/dsp/svf_bank.h"
 #include "stmlib/dsp/delay_line.h"
 
 namespace rings {
@@ -89,7 +90,7 @@ class Resonator {
   
   int32_t resolution_;
   
-  stmlib::Svf f_[kMaxModes];
+  stmlib::SvfBank<kMaxModes> f_;
   
   DISALLOW_COPY_AND_ASSIGN(Resonator);
 };
@@ -212,6 +212,147 @@ void SegmentGenerator::ProcessMultiSegment(
   value_ = value;
 }
 
+/* static */
+void SegmentGenerator::ProcessChannels(
+    SegmentGenerator* const* generators,
+    const GateFlags* const* gate_flags,
+    SegmentGenerator::Output* const* out,
+    size_t num_channels,
+    size_t size) {
+  const ProcessFn multi_segment = &SegmentGenerator::ProcessMultiSegment;
+  size_t i = 0;
+  for (; i + 4 <= num_channels; i += 4) {
+    if (generators[i]->process_fn_ == multi_segment &&
+        generators[i + 1]->process_fn_ == multi_segment &&
+        generators[i + 2]->process_fn_ == multi_segment &&
+        generators[i + 3]->process_fn_ == multi_segment) {
+      ProcessMultiSegmentLanes(&generators[i], &gate_flags[i], &out[i], size);
+    } else {
+      for (size_t j = i; j < i + 4; ++j) {
+        generators[j]->Process(gate_flags[j], out[j], size);
+      }
+    }
+  }
+  for (; i < num_channels; ++i) {
+    generators[i]->Process(gate_flags[i], out[i], size);
+  }
+}
+
+/* static */
+void SegmentGenerator::ProcessMultiSegmentLanes(
+    SegmentGenerator* const* generators,
+    const GateFlags* const* gate_flags,
+    SegmentGenerator::Output* const* out,
+    size_t size) {
+  const Lanes one = { 1.0f, 1.0f, 1.0f, 1.0f };
+  
+  Lanes phase;
+  Lanes start;
+  Lanes lp;
+  Lanes value;
+  for (int i = 0; i < 4; ++i) {
+    phase[i] = generators[i]->phase_;
+    start[i] = generators[i]->start_;
+    lp[i] = generators[i]->lp_;
+    value[i] = generators[i]->value_;
+  }
+  
+  // The parameters don't change during a block, so everything
+  // ProcessMultiSegment() reads from the active segment is only looked up when
+  // the segment changes.
+  Lanes increment;
+  Lanes follow_phase;
+  Lanes fixed_phase;
+  Mask flip;
+  Lanes warp_amount;
+  Lanes end;
+  Lanes coefficient;
+  Lanes track_coefficient;
+  Lanes track_target;
+  
+  auto load_segment = [&](int i) {
+    SegmentGenerator* g = generators[i];
+    const Segment& segment = g->segments_[g->active_segment_];
+    float curve = *segment.curve - 0.5f;
+    increment[i] = segment.time ? g->RateToFrequency(*segment.time) : 0.0f;
+    follow_phase[i] = segment.phase ? 0.0f : 1.0f;
+    fixed_phase[i] = segment.phase ? *segment.phase : 0.0f;
+    flip[i] = curve < 0.0f ? -1 : 0;
+    warp_amount[i] = 128.0f * curve * curve;
+    end[i] = *segment.end;
+    coefficient[i] = g->PortamentoRateToLPCoefficient(*segment.portamento);
+    track_coefficient[i] = 0.0f;
+    track_target[i] = 0.0f;
+#ifdef TRACK_PREVIOUS_SEGMENT
+    const Segment& previous = g->segments_[g->previous_segment_];
+    if (!segment.start && previous.phase && segment.end != previous.end) {
+      track_coefficient[i] = g->PortamentoRateToLPCoefficient(
+          *previous.portamento);
+      track_target[i] = *previous.end;
+    }
+#endif  // TRACK_PREVIOUS_SEGMENT
+  };
+  
+  for (int i = 0; i < 4; ++i) {
+    load_segment(i);
+  }
+  
+  for (size_t n = 0; n < size; ++n) {
+    start += track_coefficient * (track_target - start);
+    phase += increment;
+    Mask complete = phase >= one;
+    phase = Select(complete, one, phase);
+    
+    // Same as WarpPhase() and Crossfade().
+    Lanes t = phase * follow_phase + fixed_phase;
+    t = Select(flip, one - t, t);
+    t = (one + warp_amount) * t / (one + warp_amount * t);
+    t = Select(flip, one - t, t);
+    value = start + (end - start) * t;
+    lp += coefficient * (value - lp);
+    
+    for (int i = 0; i < 4; ++i) {
+      SegmentGenerator* g = generators[i];
+      const GateFlags flags = gate_flags[i][n];
+      if ((flags & (GATE_FLAG_RISING | GATE_FLAG_FALLING)) || complete[i]) {
+        const Segment& segment = g->segments_[g->active_segment_];
+        int go_to_segment = -1;
+        if (flags & GATE_FLAG_RISING) {
+          go_to_segment = segment.if_rising;
+        } else if (flags & GATE_FLAG_FALLING) {
+          go_to_segment = segment.if_falling;
+        } else {
+          go_to_segment = segment.if_complete;
+        }
+        
+        if (go_to_segment != -1) {
+          phase[i] = 0.0f;
+          const Segment& destination = g->segments_[go_to_segment];
+          start[i] = destination.start
+              ? *destination.start
+              : (go_to_segment == g->active_segment_ ? start[i] : value[i]);
+          if (go_to_segment != g->active_segment_) {
+            g->previous_segment_ = g->active_segment_;
+          }
+          g->active_segment_ = go_to_segment;
+          load_segment(i);
+        }
+      }
+      
+      out[i][n].value = lp[i];
+      out[i][n].phase = phase[i];
+      out[i][n].segment = g->active_segment_;
+    }
+  }
+  
+  for (int i = 0; i < 4; ++i) {
+    generators[i]->phase_ = phase[i];
+    generators[i]->start_ = start[i];
+    generators[i]->lp_ = lp[i];
+    generators[i]->value_ = value[i];
+  }
+}
+
 void SegmentGenerator::ProcessDecayEnvelope(
     const GateFlags* gate_flags, SegmentGenerator::Output* out, size_t size) {
   const float frequency = RateToFrequency(parameters_[0].primary);
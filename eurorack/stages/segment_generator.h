@@ -120,6 +120,17 @@ class SegmentGenerator {
     (this->*process_fn_)(gate_flags, out, size);
     return active_segment_ == 0;
   }
+
+  // Processes the generators of several channels, which have been given the
+  // same configuration. Multi-segment envelopes are processed four channels
+  // at a time: the segment transitions are decided per channel, but the
+  // ramps, curves and smoothing are evaluated in SIMD lanes.
+  static void ProcessChannels(
+      SegmentGenerator* const* generators,
+      const stmlib::GateFlags* const* gate_flags,
+      Output* const* out,
+      size_t num_channels,
+      size_t size);
   
   void Configure(
       bool has_trigger,
@@ -175,6 +186,19 @@ class SegmentGenerator {
   DECLARE_PROCESS_FN(ClockedSampleAndHold);
   DECLARE_PROCESS_FN(Slave);
   
+  typedef float Lanes __attribute__((vector_size(16)));
+  typedef int32_t Mask __attribute__((vector_size(16)));
+  
+  static inline Lanes Select(Mask mask, Lanes a, Lanes b) {
+    return (Lanes)(((Mask)a & mask) | ((Mask)b & ~mask));
+  }
+  
+  static void ProcessMultiSegmentLanes(
+      SegmentGenerator* const* generators,
+      const stmlib::GateFlags* const* gate_flags,
+      Output* const* out,
+      size_t size);
+  
   void ProcessOscillator(bool audio_rate, const stmlib::GateFlags* gate_flags,
       Output* out,size_t size);
   
@@ -82,6 +82,10 @@ class CosineOscillator {
     return y1_ + 0.5f;
   }
 
+  inline float iir_coefficient() const {
+    return iir_coefficient_;
+  }
+
   inline float Next() {
     float temp = y0_;
     y0_ = iir_coefficient_ * y0_ - y1_;
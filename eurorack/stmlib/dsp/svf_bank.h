@@ -0,0 +1,226 @@
+// Copyright 2014 Emilie Gillet.
+//
+// Author: Emilie Gillet (emilie.o.gillet@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// Bank of band-pass state variable filters, as used by the modal resonators.
+// Coefficients and state are stored as arrays of 4-float vectors, so that
+// each step of the Svf recursion updates four filters at once.
+//
+// The outputs are mixed with amplitudes following the sequence of a
+// CosineOscillator. Four consecutive terms of such a sequence obey the same
+// recurrence as single terms, with the coefficient c4 = T4(c), so the
+// amplitudes are also computed four at a time.
+
+#ifndef STMLIB_DSP_SVF_BANK_H_
+#define STMLIB_DSP_SVF_BANK_H_
+
+#include "stmlib/stmlib.h"
+
+#include "stmlib/dsp/cosine_oscillator.h"
+#include "stmlib/dsp/filter.h"
+
+namespace stmlib {
+
+template<size_t max_num_filters>
+class SvfBank {
+ public:
+  SvfBank() { }
+  ~SvfBank() { }
+
+  void Init() {
+    for (size_t i = 0; i < max_num_filters; ++i) {
+      set_f_q<FREQUENCY_DIRTY>(i, 0.01f, 100.0f);
+    }
+    Reset();
+  }
+
+  void Reset() {
+    for (size_t i = 0; i < kNumGroups; ++i) {
+      state_1_[i] = Broadcast(0.0f);
+      state_2_[i] = Broadcast(0.0f);
+    }
+  }
+
+  template<FrequencyApproximation approximation>
+  inline void set_f_q(size_t i, float f, float resonance) {
+    float g = OnePole::tan<approximation>(f);
+    float r = 1.0f / resonance;
+    g_[i >> 2][i & 3] = g;
+    r_[i >> 2][i & 3] = r;
+    h_[i >> 2][i & 3] = 1.0f / (1.0f + r * g + g * g);
+  }
+
+  inline float g(size_t i) const {
+    return g_[i >> 2][i & 3];
+  }
+
+  // Band-passes in through the first num_filters filters. The output of
+  // filter i is weighted by the i-th value of amplitudes (freshly initialized
+  // or restarted) and accumulated into sum[i % 4].
+  inline void Process(
+      float in,
+      const CosineOscillator& amplitudes,
+      size_t num_filters,
+      float* sum) {
+    ProcessLanes<false>(in, amplitudes, amplitudes, num_filters, sum, NULL);
+  }
+
+  // Same as above, with a second set of amplitudes mixed into sum_b.
+  inline void Process(
+      float in,
+      const CosineOscillator& amplitudes_a,
+      const CosineOscillator& amplitudes_b,
+      size_t num_filters,
+      float* sum_a,
+      float* sum_b) {
+    ProcessLanes<true>(
+        in, amplitudes_a, amplitudes_b, num_filters, sum_a, sum_b);
+  }
+
+ private:
+  typedef float Lanes __attribute__((vector_size(16)));
+
+  static const size_t kNumGroups = (max_num_filters + 3) / 4;
+
+  static inline Lanes Broadcast(float x) {
+    Lanes v = { x, x, x, x };
+    return v;
+  }
+
+  // Tracks four consecutive terms of a CosineOscillator sequence, offset by
+  // -0.5. The first two groups are computed serially, exactly as
+  // CosineOscillator::Next() does.
+  class AmplitudeLanes {
+   public:
+    inline void Init(const CosineOscillator& oscillator) {
+      float c = oscillator.iir_coefficient();
+      float y1 = c * 0.25f;
+      float y0 = 0.5f;
+      float t[8];
+      for (size_t i = 0; i < 8; ++i) {
+        t[i] = y0;
+        float temp = y0;
+        y0 = c * y0 - y1;
+        y1 = temp;
+      }
+      float c2 = c * c - 2.0f;
+      coefficient_ = Broadcast(c2 * c2 - 2.0f);
+      Lanes current = { t[0], t[1], t[2], t[3] };
+      Lanes next = { t[4], t[5], t[6], t[7] };
+      current_ = current;
+      next_ = next;
+    }
+
+    inline Lanes Next() {
+      Lanes value = current_;
+      current_ = next_;
+      next_ = coefficient_ * current_ - value;
+      return value + Broadcast(0.5f);
+    }
+
+   private:
+    Lanes coefficient_;
+    Lanes current_;
+    Lanes next_;
+  };
+
+  template<bool dual>
+  inline void ProcessLanes(
+      float in,
+      const CosineOscillator& amplitudes_a,
+      const CosineOscillator& amplitudes_b,
+      size_t num_filters,
+      float* sum_a,
+      float* sum_b) {
+    AmplitudeLanes a;
+    AmplitudeLanes b;
+    a.Init(amplitudes_a);
+    if (dual) {
+      b.Init(amplitudes_b);
+    }
+
+    const Lanes input = Broadcast(in);
+    Lanes accumulator_a = Broadcast(0.0f);
+    Lanes accumulator_b = Broadcast(0.0f);
+    size_t num_groups = num_filters >> 2;
+    for (size_t i = 0; i < num_groups; ++i) {
+      Lanes g = g_[i];
+      Lanes state_1 = state_1_[i];
+      Lanes state_2 = state_2_[i];
+      Lanes hp = (input - r_[i] * state_1 - g * state_1 - state_2) * h_[i];
+      Lanes bp = g * hp + state_1;
+      state_1_[i] = g * hp + bp;
+      Lanes lp = g * bp + state_2;
+      state_2_[i] = g * bp + lp;
+      accumulator_a += bp * a.Next();
+      if (dual) {
+        accumulator_b += bp * b.Next();
+      }
+    }
+
+    // The filters beyond num_filters keep their state, as they would if
+    // processed one at a time, so the last group is finished serially.
+    size_t remainder = num_filters & 3;
+    if (remainder) {
+      size_t i = num_groups;
+      Lanes amplitude_a = a.Next();
+      Lanes amplitude_b = dual ? b.Next() : amplitude_a;
+      for (size_t j = 0; j < remainder; ++j) {
+        float g = g_[i][j];
+        float state_1 = state_1_[i][j];
+        float state_2 = state_2_[i][j];
+        float hp = in - r_[i][j] * state_1 - g * state_1 - state_2;
+        hp *= h_[i][j];
+        float bp = g * hp + state_1;
+        state_1_[i][j] = g * hp + bp;
+        float lp = g * bp + state_2;
+        state_2_[i][j] = g * bp + lp;
+        accumulator_a[j] += bp * amplitude_a[j];
+        if (dual) {
+          accumulator_b[j] += bp * amplitude_b[j];
+        }
+      }
+    }
+
+    for (size_t j = 0; j < 4; ++j) {
+      sum_a[j] = accumulator_a[j];
+      if (dual) {
+        sum_b[j] = accumulator_b[j];
+      }
+    }
+  }
+
+  Lanes g_[kNumGroups];
+  Lanes r_[kNumGroups];
+  Lanes h_[kNumGroups];
+  Lanes state_1_[kNumGroups];
+  Lanes state_2_[kNumGroups];
+
+  DISALLOW_COPY_AND_ASSIGN(SvfBank);
+};
+
+}  // namespace stmlib
+
+#endif  // STMLIB_DSP_SVF_BANK_H_
@@ -0,0 +1,408 @@
+// Copyright 2014 Emilie Gillet.
+//
+// Author: Emilie Gillet (emilie.o.gillet@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// Real FFT for desktop processors, with the same interface and data layout as
+// ShyFFT, so that either can be used by the same client code.
+//
+// A real transform of size N is computed as a complex transform of size N / 2
+// on the even/odd samples, followed by a split step. The complex transform is
+// a radix-4 Stockham FFT (with a final radix-2 pass for odd powers of 2) on
+// separate arrays of real and imaginary parts, processing 4 butterflies per
+// instruction. The input and output buffers are used as the two work arrays,
+// in any alignment. Twiddle factors are computed once, in double precision,
+// and shared by all instances of the same size.
+
+#ifndef STMLIB_FFT_SIMD_FFT_H_
+#define STMLIB_FFT_SIMD_FFT_H_
+
+#include "stmlib/stmlib.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "stmlib/fft/shy_fft.h"
+
+namespace stmlib {
+
+template<size_t size=16>
+class SimdFFT {
+ public:
+  enum {
+    num_passes = Log2<size>::value,
+    max_size = size
+  };
+
+  SimdFFT() { }
+  ~SimdFFT() { }
+
+  void Init() {
+    twiddles_ = &twiddles();
+  }
+
+  // Output: real parts of bins 0 to N / 2 in output[0] to output[N / 2], and
+  // imaginary parts of bins 1 to N / 2 - 1 in output[N / 2 + 1] to
+  // output[N - 1], with the sign convention of ShyFFT. input is used as a
+  // workspace.
+  void Direct(float* input, float* output) {
+    Direct(input, output, num_passes);
+  }
+
+  // Inverse of Direct(), scaled by N. input is used as a workspace.
+  void Inverse(float* input, float* output) {
+    Inverse(input, output, num_passes);
+  }
+
+  void Direct(float* input, float* output, size_t n) {
+    size_t m = (1 << n) >> 1;
+    for (size_t i = 0; i < m; ++i) {
+      output[i] = input[2 * i];
+      output[m + i] = input[2 * i + 1];
+    }
+    float* result = ComplexTransform(output, input, m);
+    Split(result, output, m);
+  }
+
+  void Inverse(float* input, float* output, size_t n) {
+    size_t m = (1 << n) >> 1;
+    Merge(input, m);
+    float* result = ComplexTransform(input, output, m);
+    if (result == output) {
+      std::copy(&output[0], &output[2 * m], &input[0]);
+    }
+    // The inverse transform is the conjugate of the direct transform of the
+    // conjugate.
+    for (size_t i = 0; i < m; ++i) {
+      output[2 * i] = input[i];
+      output[2 * i + 1] = -input[m + i];
+    }
+  }
+
+ private:
+  typedef float Lanes __attribute__((vector_size(16)));
+
+  enum {
+    complex_size = size >> 1
+  };
+
+  struct Twiddles {
+    // Factors of the radix-4 pass of length l, for l = 4, 8... complex_size:
+    // w^p, w^2p, w^3p with w = exp(-2i pi / l), as 6 arrays of l / 4 floats
+    // (re, im, re, im, re, im) starting at index 6 * (l / 4 - 1).
+    float radix_4[6 * (complex_size / 2)];
+    // exp(-2i pi k / size), for k = 0 to size / 4.
+    float split_re[size / 4 + 1];
+    float split_im[size / 4 + 1];
+
+    Twiddles() {
+      for (size_t l = 4; l <= complex_size; l <<= 1) {
+        float* t = &radix_4[6 * (l / 4 - 1)];
+        size_t q = l / 4;
+        for (size_t p = 0; p < q; ++p) {
+          for (size_t k = 1; k <= 3; ++k) {
+            double phase = -2.0 * M_PI * static_cast<double>(k * p) / l;
+            t[(2 * k - 2) * q + p] = static_cast<float>(std::cos(phase));
+            t[(2 * k - 1) * q + p] = static_cast<float>(std::sin(phase));
+          }
+        }
+      }
+      for (size_t k = 0; k <= size / 4; ++k) {
+        double phase = -2.0 * M_PI * static_cast<double>(k) / size;
+        split_re[k] = static_cast<float>(std::cos(phase));
+        split_im[k] = static_cast<float>(std::sin(phase));
+      }
+    }
+  };
+
+  static const Twiddles& twiddles() {
+    static Twiddles t;
+    return t;
+  }
+
+  static inline Lanes Broadcast(float x) {
+    Lanes v = { x, x, x, x };
+    return v;
+  }
+
+  static inline Lanes Load(const float* p) {
+    Lanes v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+  }
+
+  static inline void Store(float* p, Lanes v) {
+    memcpy(p, &v, sizeof(v));
+  }
+
+  // Complex transform of size m, with real parts in x[0] to x[m - 1] and
+  // imaginary parts in x[m] to x[2m - 1]. y is a workspace of the same size.
+  // Returns the buffer holding the result.
+  float* ComplexTransform(float* x, float* y, size_t m) {
+    size_t l = m;
+    size_t s = 1;
+    while (l >= 4) {
+      if (s >= 4) {
+        Radix4<true>(x, y, m, l, s);
+      } else {
+        Radix4<false>(x, y, m, l, s);
+      }
+      std::swap(x, y);
+      l >>= 2;
+      s <<= 2;
+    }
+    if (l == 2) {
+      Radix2(x, y, m, s);
+      std::swap(x, y);
+    }
+    return x;
+  }
+
+  // One pass of the Stockham FFT. When the stride s is at least 4,
+  // consecutive butterflies share their twiddle factors and are computed
+  // four at a time. Otherwise (first pass, s = 1), the twiddle factors are
+  // different for each butterfly, and their outputs are scattered.
+  template<bool vectorized_stride>
+  void Radix4(const float* x, float* y, size_t m, size_t l, size_t s) {
+    const float* x_re = x;
+    const float* x_im = x + m;
+    float* y_re = y;
+    float* y_im = y + m;
+    size_t q = l / 4;
+    const float* t = &twiddles_->radix_4[6 * (q - 1)];
+    const float* w1_re = t;
+    const float* w1_im = t + q;
+    const float* w2_re = t + 2 * q;
+    const float* w2_im = t + 3 * q;
+    const float* w3_re = t + 4 * q;
+    const float* w3_im = t + 5 * q;
+
+    if (vectorized_stride) {
+      for (size_t p = 0; p < q; ++p) {
+        Lanes w[6] = {
+          Broadcast(w1_re[p]), Broadcast(w1_im[p]),
+          Broadcast(w2_re[p]), Broadcast(w2_im[p]),
+          Broadcast(w3_re[p]), Broadcast(w3_im[p])
+        };
+        size_t in = s * p;
+        size_t out = s * 4 * p;
+        for (size_t i = 0; i < s; i += 4) {
+          Lanes r[4];
+          Lanes im[4];
+          Butterfly(x_re + in + i, x_im + in + i, s * q, w, r, im);
+          for (size_t k = 0; k < 4; ++k) {
+            Store(y_re + out + k * s + i, r[k]);
+            Store(y_im + out + k * s + i, im[k]);
+          }
+        }
+      }
+    } else if (s == 1 && q >= 4) {
+      for (size_t p = 0; p < q; p += 4) {
+        Lanes w[6] = {
+          Load(w1_re + p), Load(w1_im + p),
+          Load(w2_re + p), Load(w2_im + p),
+          Load(w3_re + p), Load(w3_im + p)
+        };
+        Lanes r[4];
+        Lanes im[4];
+        Butterfly(x_re + p, x_im + p, q, w, r, im);
+        for (size_t j = 0; j < 4; ++j) {
+          Lanes r_j = { r[0][j], r[1][j], r[2][j], r[3][j] };
+          Lanes im_j = { im[0][j], im[1][j], im[2][j], im[3][j] };
+          Store(y_re + 4 * (p + j), r_j);
+          Store(y_im + 4 * (p + j), im_j);
+        }
+      }
+    } else {
+      // Small transforms.
+      for (size_t p = 0; p < q; ++p) {
+        for (size_t i = 0; i < s; ++i) {
+          float r[4];
+          float im[4];
+          for (size_t k = 0; k < 4; ++k) {
+            r[k] = x_re[s * (p + k * q) + i];
+            im[k] = x_im[s * (p + k * q) + i];
+          }
+          float a_re = r[0] + r[2];
+          float a_im = im[0] + im[2];
+          float b_re = r[0] - r[2];
+          float b_im = im[0] - im[2];
+          float c_re = r[1] + r[3];
+          float c_im = im[1] + im[3];
+          float d_re = -(im[1] - im[3]);
+          float d_im = r[1] - r[3];
+          float out_re[4] = {
+            a_re + c_re, b_re - d_re, a_re - c_re, b_re + d_re
+          };
+          float out_im[4] = {
+            a_im + c_im, b_im - d_im, a_im - c_im, b_im + d_im
+          };
+          float w_re[4] = { 1.0f, w1_re[p], w2_re[p], w3_re[p] };
+          float w_im[4] = { 0.0f, w1_im[p], w2_im[p], w3_im[p] };
+          for (size_t k = 0; k < 4; ++k) {
+            y_re[s * (4 * p + k) + i] = \
+                out_re[k] * w_re[k] - out_im[k] * w_im[k];
+            y_im[s * (4 * p + k) + i] = \
+                out_re[k] * w_im[k] + out_im[k] * w_re[k];
+          }
+        }
+      }
+    }
+  }
+
+  // Radix-4 butterflies on the 4 inputs spaced by stride, starting at x_re
+  // and x_im. w holds the real and imaginary parts of the twiddle factors of
+  // outputs 1, 2 and 3.
+  static inline void Butterfly(
+      const float* x_re,
+      const float* x_im,
+      size_t stride,
+      const Lanes* w,
+      Lanes* r,
+      Lanes* im) {
+    Lanes r0 = Load(x_re);
+    Lanes i0 = Load(x_im);
+    Lanes r1 = Load(x_re + stride);
+    Lanes i1 = Load(x_im + stride);
+    Lanes r2 = Load(x_re + 2 * stride);
+    Lanes i2 = Load(x_im + 2 * stride);
+    Lanes r3 = Load(x_re + 3 * stride);
+    Lanes i3 = Load(x_im + 3 * stride);
+
+    Lanes a_re = r0 + r2;
+    Lanes a_im = i0 + i2;
+    Lanes b_re = r0 - r2;
+    Lanes b_im = i0 - i2;
+    Lanes c_re = r1 + r3;
+    Lanes c_im = i1 + i3;
+    // d = i * (x1 - x3)
+    Lanes d_re = i3 - i1;
+    Lanes d_im = r1 - r3;
+
+    r[0] = a_re + c_re;
+    im[0] = a_im + c_im;
+
+    Lanes v_re = b_re - d_re;
+    Lanes v_im = b_im - d_im;
+    r[1] = v_re * w[0] - v_im * w[1];
+    im[1] = v_re * w[1] + v_im * w[0];
+
+    v_re = a_re - c_re;
+    v_im = a_im - c_im;
+    r[2] = v_re * w[2] - v_im * w[3];
+    im[2] = v_re * w[3] + v_im * w[2];
+
+    v_re = b_re + d_re;
+    v_im = b_im + d_im;
+    r[3] = v_re * w[4] - v_im * w[5];
+    im[3] = v_re * w[5] + v_im * w[4];
+  }
+
+  // Last pass for odd powers of 2, where s = m / 2.
+  void Radix2(const float* x, float* y, size_t m, size_t s) {
+    for (size_t i = 0; i < 2 * m; i += m) {
+      const float* a = x + i;
+      float* b = y + i;
+      if (s >= 4) {
+        for (size_t j = 0; j < s; j += 4) {
+          Lanes u = Load(a + j);
+          Lanes v = Load(a + s + j);
+          Store(b + j, u + v);
+          Store(b + s + j, u - v);
+        }
+      } else {
+        for (size_t j = 0; j < s; ++j) {
+          float u = a[j];
+          float v = a[s + j];
+          b[j] = u + v;
+          b[s + j] = u - v;
+        }
+      }
+    }
+  }
+
+  // Computes the spectrum of the real signal from the complex transform z of
+  // its even and odd samples. z and output can be the same buffer.
+  void Split(const float* z, float* output, size_t m) {
+    size_t stride = complex_size / m;
+    float z_re = z[0];
+    float z_im = z[m];
+    output[0] = z_re + z_im;
+    output[m] = z_re - z_im;
+    for (size_t k = 1; k <= m / 2; ++k) {
+      float a = z[k];
+      float b = z[m + k];
+      float c = z[m - k];
+      float d = z[2 * m - k];
+      float e_re = 0.5f * (a + c);
+      float e_im = 0.5f * (b - d);
+      float o_re = 0.5f * (b + d);
+      float o_im = -0.5f * (a - c);
+      float w_re = twiddles_->split_re[k * stride];
+      float w_im = twiddles_->split_im[k * stride];
+      float t_re = w_re * o_re - w_im * o_im;
+      float t_im = w_re * o_im + w_im * o_re;
+      output[k] = e_re + t_re;
+      output[m + k] = -(e_im + t_im);
+      output[m - k] = e_re - t_re;
+      output[2 * m - k] = e_im - t_im;
+    }
+  }
+
+  // Inverse of Split(), in place, scaled by 2 and conjugated.
+  void Merge(float* x, size_t m) {
+    size_t stride = complex_size / m;
+    float x_0 = x[0];
+    float x_m = x[m];
+    x[0] = x_0 + x_m;
+    x[m] = -(x_0 - x_m);
+    for (size_t k = 1; k <= m / 2; ++k) {
+      float p = x[k];
+      float q = -x[m + k];
+      float r = x[m - k];
+      float s = -x[2 * m - k];
+      float a_re = p + r;
+      float a_im = q - s;
+      float b_re = p - r;
+      float b_im = q + s;
+      float w_re = twiddles_->split_re[k * stride];
+      float w_im = -twiddles_->split_im[k * stride];
+      float v_re = w_re * b_re - w_im * b_im;
+      float v_im = w_re * b_im + w_im * b_re;
+      x[k] = a_re - v_im;
+      x[m + k] = -(a_im + v_re);
+      x[m - k] = a_re + v_im;
+      x[2 * m - k] = a_im - v_re;
+    }
+  }
+
+  const Twiddles* twiddles_;
+
+  DISALLOW_COPY_AND_ASSIGN(SimdFFT);
+};
+
+}  // namespace stmlib
+
+#endif  // STMLIB_FFT_SIMD_FFT_H_
@@ -30,7 +30,6 @@
 
 namespace stmlib {
 
-/* static */
-uint32_t Random::rng_state_ = 0x21;
+// The state of the generator is a thread_local of Random::mutable_state().
 
 }  // namespace stmlib
@@ -25,25 +25,70 @@
 // -----------------------------------------------------------------------------
 //
 // Fast 16-bit pseudo random number generator.
+//
+// Each thread has its own generator state, so that modules rendered on
+// different threads neither race on nor share a single cache line. Until
+// Seed() is called, the state of each thread is seeded from its address, so
+// that threads draw different sequences.
+//
+// In a shared object, a thread_local is normally reached through a call to
+// __tls_get_addr on every access. The initial-exec model turns this into a
+// load relative to the thread pointer, which matters on the per-sample path.
 
 #ifndef STMLIB_UTILS_RANDOM_H_
 #define STMLIB_UTILS_RANDOM_H_
 
 #include "stmlib/stmlib.h"
 
+#if defined(__ELF__)
+#define STMLIB_TLS_INITIAL_EXEC __attribute__((tls_model("initial-exec")))
+#else
+#define STMLIB_TLS_INITIAL_EXEC
+#endif
+
 namespace stmlib {
 
 class Random {
  public:
-  static inline uint32_t state() { return rng_state_; }
+  // The generator state of a thread.
+  struct State {
+    uint32_t value;
+    bool seeded;
+  };
+
+  static inline uint32_t state() {
+    State& s = mutable_state();
+    // A branch rather than a conditional move keeps the seeding out of the
+    // dependency chain between consecutive numbers.
+    if (__builtin_expect(!s.seeded, 0)) {
+      const uintptr_t address = reinterpret_cast<uintptr_t>(&s);
+      s.value = static_cast<uint32_t>(address >> 3) * 0x9e3779b9 | 1;
+      s.seeded = true;
+    }
+    return s.value;
+  }
 
+  // Any value is a valid seed, 0 included, and applies to the calling thread.
   static inline void Seed(uint32_t seed) {
-    rng_state_ = seed;
+    State& s = mutable_state();
+    s.value = seed;
+    s.seeded = true;
+  }
+
+  // Exchanges the state of the calling thread with *state. An object which may
+  // be rendered on any thread can keep its own state and swap it in and out
+  // around its processing, so the numbers it draws don't depend on the thread.
+  static inline void SwapState(State* state) {
+    State& s = mutable_state();
+    State t = s;
+    s = *state;
+    *state = t;
   }
 
   static inline uint32_t GetWord() {
-    rng_state_ = rng_state_ * 1664525L + 1013904223L;
-    return state();
+    const uint32_t rng_state = state() * kMultiplier + kIncrement;
+    mutable_state().value = rng_state;
+    return rng_state;
   }
   
   static inline int16_t GetSample() {
@@ -53,9 +98,66 @@ class Random {
   static inline float GetFloat() {
     return static_cast<float>(GetWord()) / 4294967296.0f;
   }
+  
+  // Same values as size calls to GetWord().
+  static inline void GetWords(uint32_t* out, size_t size) {
+    Generate(out, size);
+  }
+  
+  // Same values as size calls to GetFloat().
+  static inline void GetFloats(float* out, size_t size) {
+    Generate(out, size);
+  }
 
  private:
-  static uint32_t rng_state_;
+  static const uint32_t kMultiplier = 1664525;
+  static const uint32_t kIncrement = 1013904223;
+  
+  static inline void Convert(uint32_t word, uint32_t* out) {
+    *out = word;
+  }
+  
+  static inline void Convert(uint32_t word, float* out) {
+    *out = static_cast<float>(word) / 4294967296.0f;
+  }
+  
+  // Four consecutive steps of the generator are computed independently, each
+  // one jumping four steps ahead, so the loop vectorizes.
+  template<typename T>
+  static inline void Generate(T* out, size_t size) {
+    const uint32_t multiplier_2 = kMultiplier * kMultiplier;
+    const uint32_t multiplier_4 = multiplier_2 * multiplier_2;
+    const uint32_t increment_4 = kIncrement * \
+        (1 + kMultiplier + multiplier_2 + multiplier_2 * kMultiplier);
+    
+    uint32_t state = Random::state();
+    uint32_t word[4];
+    for (int i = 0; i < 4; ++i) {
+      state = state * kMultiplier + kIncrement;
+      word[i] = state;
+    }
+    state = mutable_state().value;
+    while (size >= 4) {
+      state = word[3];
+      for (int i = 0; i < 4; ++i) {
+        Convert(word[i], out++);
+        word[i] = word[i] * multiplier_4 + increment_4;
+      }
+      size -= 4;
+    }
+    for (size_t i = 0; i < size; ++i) {
+      state = word[i];
+      Convert(word[i], out++);
+    }
+    mutable_state().value = state;
+  }
+  
+  // Not seeded until the first number is drawn by the thread, or Seed() is
+  // called on it.
+  static inline State& mutable_state() {
+    static thread_local State state STMLIB_TLS_INITIAL_EXEC = { 0, false };
+    return state;
+  }
 
   DISALLOW_COPY_AND_ASSIGN(Random);
 };
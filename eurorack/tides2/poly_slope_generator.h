@@ -40,6 +40,8 @@
 
 namespace tides2 {
 
+class SlopeGeneratorBatch;
+
 #define INSTANTIATE(x, y, z) \
   render_fn_table_[x][y][z] = &PolySlopeGenerator::RenderInternal<x, y, z>;
 
@@ -159,40 +161,62 @@ class PolySlopeGenerator {
       const float* ramp,
       OutputSample* out,
       size_t size) {
+    AdjustParameters(
+        ramp_mode, range, ramp != NULL, &frequency, &pw, &shape, &smoothness);
+
+    (this->*render_fn_table_[ramp_mode][output_mode][range])(
+        frequency, pw, shape, smoothness, shift, gate_flags, ramp, out, size);
     
+    Smooth(output_mode, smoothness, out, size);
+  }
+  
+ private:
+  friend class SlopeGeneratorBatch;
+
+  inline void AdjustParameters(
+      RampMode ramp_mode,
+      Range range,
+      bool has_ramp,
+      float* frequency,
+      float* pw,
+      float* shape,
+      float* smoothness) {
     // const float max_ratio = output_mode == OUTPUT_MODE_FREQUENCY
     //     ? (range == RANGE_CONTROL ? 0.125f : 0.25f)
     //     : 1.0f;
     const float max_ratio = 1.0f;
-    frequency = std::min(frequency, 0.25f * max_ratio);
+    *frequency = std::min(*frequency, 0.25f * max_ratio);
     
-    if (range == RANGE_CONTROL && pw < 0.5f) {
+    if (range == RANGE_CONTROL && *pw < 0.5f) {
       // Skew the response of the pulse width parameter, so that a more
       // interesting range of attack times can be set.
-      pw = 0.5f + 0.6f * (pw - 0.5f) / (fabsf(pw - 0.5f) + 0.1f);
+      *pw = 0.5f + 0.6f * (*pw - 0.5f) / (fabsf(*pw - 0.5f) + 0.1f);
     }
 
-    if (ramp && ramp_mode == RAMP_MODE_AR) {
+    if (has_ramp && ramp_mode == RAMP_MODE_AR) {
       // When locking unto an external ramp, adjust the frequency to get
       // interesting trapezoidal shapes.
-      frequency *= 1.0f + 2.0f * fabsf(pw - 0.5f);
+      *frequency *= 1.0f + 2.0f * fabsf(*pw - 0.5f);
     }
     
-    const float slope = 3.0f + fabsf(pw - 0.5f) * 5.0f;
-    const float shape_amount = fabsf(shape - 0.5f) * 2.0f;
-    const float shape_amount_attenuation = Tame(frequency, slope, 16.0f);
-    shape = 0.5f + (shape - 0.5f) * shape_amount_attenuation;
+    const float slope = 3.0f + fabsf(*pw - 0.5f) * 5.0f;
+    const float shape_amount = fabsf(*shape - 0.5f) * 2.0f;
+    const float shape_amount_attenuation = Tame(*frequency, slope, 16.0f);
+    *shape = 0.5f + (*shape - 0.5f) * shape_amount_attenuation;
 
-    if (smoothness > 0.5f) {
-      smoothness = 0.5f + (smoothness - 0.5f) * Tame(
-          frequency,
+    if (*smoothness > 0.5f) {
+      *smoothness = 0.5f + (*smoothness - 0.5f) * Tame(
+          *frequency,
           slope * (3.0f + shape_amount * shape_amount_attenuation * 5.0f),
           12.0f);
     }
-
-    (this->*render_fn_table_[ramp_mode][output_mode][range])(
-        frequency, pw, shape, smoothness, shift, gate_flags, ramp, out, size);
-    
+  }
+  
+  inline void Smooth(
+      OutputMode output_mode,
+      float smoothness,
+      OutputSample* out,
+      size_t size) {
     if (smoothness < 0.5f) {
       float ratio = smoothness * 2.0f;
       ratio *= ratio;
@@ -213,7 +237,6 @@ class PolySlopeGenerator {
     }
   }
   
- private:
   template<RampMode ramp_mode, OutputMode output_mode, Range range>
   inline void RenderInternal(
       float frequency,
@@ -39,6 +39,8 @@
 #include "tides2/ramp/ratio.h"
 
 namespace tides2 {
+
+class SlopeGeneratorBatch;
   
 enum RampMode {
   RAMP_MODE_AD,
@@ -222,6 +224,8 @@ class RampGenerator {
   }
   
  private:
+  friend class SlopeGeneratorBatch;
+
   const Ratio* next_ratio_;
 
   float master_phase_;
@@ -195,6 +195,8 @@ class RampShaper {
     return phase < pw ? phase * slope_up : (phase - pw) * slope_down + 0.5f;
   }
 
+  friend class SlopeGeneratorBatch;
+
   float next_sample_;
   float previous_phase_shift_;
 
@@ -29,6 +29,7 @@
 #include "warps/dsp/filter_bank.h"
 
 #include <algorithm>
+#include <cmath>
 
 #include "warps/resources.h"
 
@@ -37,7 +38,27 @@ namespace warps {
 using namespace std;
 using namespace stmlib;
 
+// Moves the pole pair of a filter section designed at one sample rate to
+// another (z' = z ^ ratio), so that its frequency and damping stay the same
+// in Hz. ratio is the design rate divided by the new rate.
+static void RemapPoles(float ratio, float* f, float* fq) {
+  // The section's characteristic polynomial is z^2 - (2 - fq - f^2) z + 1 - fq
+  double r = sqrt(1.0 - *fq);
+  double c = (2.0 - *fq - *f * *f) / (2.0 * r);
+  CONSTRAIN(c, -1.0, 1.0);
+  double theta = acos(c) * ratio;
+  // Keep bands above the new Nyquist frequency from folding back.
+  CONSTRAIN(theta, 0.0, 0.95 * M_PI);
+  r = pow(r, static_cast<double>(ratio));
+  double fq_remapped = 1.0 - r * r;
+  double f_remapped = sqrt(max(2.0 - fq_remapped - 2.0 * r * cos(theta), 0.0));
+  *f = static_cast<float>(*f < 0.0f ? -f_remapped : f_remapped);
+  *fq = static_cast<float>(fq_remapped);
+}
+
 void FilterBank::Init(float sample_rate) {
+  float ratio = kFilterBankDesignSampleRate / sample_rate;
+  
   low_src_down_.Init();
   low_src_up_.Init();
   mid_src_down_.Init();
@@ -67,18 +88,26 @@ void FilterBank::Init(float sample_rate) {
     
     b.delay = static_cast<int32_t>(coefficients[1]);
     b.delay *= b.decimation_factor;
+    b.delay = static_cast<int32_t>(b.delay / ratio + 0.5f);
     b.post_gain = coefficients[2];
 
     max_delay = max(max_delay, b.delay);
     for (int32_t pass = 0; pass < 2; ++pass) {
       b.svf[pass].Init();
-      b.svf[pass].set_f_fq(
-          coefficients[pass * 2 + 3],
-          coefficients[pass * 2 + 4]);
+      float f = coefficients[pass * 2 + 3];
+      float fq = coefficients[pass * 2 + 4];
+      if (ratio != 1.0f) {
+        RemapPoles(ratio, &f, &fq);
+      }
+      b.svf[pass].set_f_fq(f, fq);
     }
   }
   band_[kNumBands].group = band_[kNumBands - 1].group + 1;
-  max_delay = min(max_delay, int32_t(256));
+  // The delay limit scales with the sample rate, up to what fits in
+  // delay_buffer_.
+  int32_t max_delay_limit = min(
+      static_cast<int32_t>(256.0f / ratio), int32_t(1024));
+  max_delay = min(max_delay, max_delay_limit);
   float* delay_ptr = &delay_buffer_[0];
   for (int32_t i = 0; i < kNumBands; ++i) {
     Band& b = band_[i];
@@ -45,6 +45,8 @@ const int32_t kMidFactor = 3;
 const int32_t kDelayLineSize = 6144;
 const int32_t kMaxFilterBankBlockSize = 96;
 const int32_t kSampleMemorySize = kMaxFilterBankBlockSize * kNumBands / 2;
+// Sample rate the coefficients in filter_bank_table were designed for.
+const float kFilterBankDesignSampleRate = 96000.0f;
 
 class PooledDelayLine {
  public:
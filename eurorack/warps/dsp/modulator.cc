@@ -66,10 +66,33 @@ void Modulator::Init(float sample_rate) {
   feedback_sample_ = 0.0f;
 }
 
+void Modulator::Process(ShortFrame* input, ShortFrame* output, size_t size) {
+  ProcessFrames(input, output, size);
+}
+
+void Modulator::Process(FloatFrame* input, FloatFrame* output, size_t size) {
+  ProcessFrames(input, output, size);
+}
+
 void Modulator::ProcessEasterEgg(
     ShortFrame* input,
     ShortFrame* output,
     size_t size) {
+  ProcessEasterEggFrames(input, output, size);
+}
+
+void Modulator::ProcessEasterEgg(
+    FloatFrame* input,
+    FloatFrame* output,
+    size_t size) {
+  ProcessEasterEggFrames(input, output, size);
+}
+
+template<typename Frame>
+void Modulator::ProcessEasterEggFrames(
+    Frame* input,
+    Frame* output,
+    size_t size) {
   float* carrier = buffer_[0];
   float* carrier_i = &src_buffer_[0][0];
   float* carrier_q = &src_buffer_[0][size];
@@ -98,7 +121,7 @@ void Modulator::ProcessEasterEgg(
     quadrature_oscillator_.Render(shape, frequency, carrier_i, carrier_q, size);
   } else {
     for (size_t i = 0; i < size; ++i) {
-      carrier[i] = static_cast<float>(input[i].l) / 32768.0f;
+      carrier[i] = SampleToFloat(input[i].l);
     }
     quadrature_transform_[0].Process(carrier, carrier_i, carrier_q, size);
     
@@ -138,10 +161,10 @@ void Modulator::ProcessEasterEgg(
     float modulator_i, modulator_q;
 
     // Start from the signal from input 2, with non-linear gain.
-    float in = static_cast<float>(input->r) / 32768.0f;
+    float in = SampleToFloat(input->r);
     
     if (parameters_.carrier_shape) {
-      in += static_cast<float>(input->l) / 32768.0f;
+      in += SampleToFloat(input->l);
     }
     
     float modulator = in;
@@ -176,8 +199,8 @@ void Modulator::ProcessEasterEgg(
     main += wet_dry * (in - main);
     aux += wet_dry * (in - aux);
     
-    output->l = Clip16(static_cast<int32_t>(main * 32768.0f));
-    output->r = Clip16(static_cast<int32_t>(aux * 32768.0f));
+    FloatToSample(main, &output->l);
+    FloatToSample(aux, &output->r);
     ++output;
     ++input;
   }
@@ -185,12 +208,13 @@ void Modulator::ProcessEasterEgg(
   previous_parameters_ = parameters_;
 }
 
-void Modulator::Process(ShortFrame* input, ShortFrame* output, size_t size) {
+template<typename Frame>
+void Modulator::ProcessFrames(Frame* input, Frame* output, size_t size) {
   if (bypass_) {
     copy(&input[0], &input[size], &output[0]);
     return;
   } else if (easter_egg_) {
-    ProcessEasterEgg(input, output, size);
+    ProcessEasterEggFrames(input, output, size);
     return;
   }
   float* carrier = buffer_[0];
@@ -211,7 +235,7 @@ void Modulator::Process(ShortFrame* input, ShortFrame* output, size_t size) {
   }
   
   // Convert audio inputs to float and apply VCA/saturation (5.8% per channel)
-  short* input_samples = &input->l;
+  const auto* input_samples = &input->l;
   for (int32_t i = parameters_.carrier_shape ? 1 : 0; i < 2; ++i) {
       amplifier_[i].Process(
           parameters_.channel_drive[i],
@@ -227,7 +251,7 @@ void Modulator::Process(ShortFrame* input, ShortFrame* output, size_t size) {
   if (parameters_.carrier_shape) {
     // Scale phase-modulation input.
     for (size_t i = 0; i < size; ++i) {
-      internal_modulation_[i] = static_cast<float>(input[i].l) / 32768.0f;
+      internal_modulation_[i] = SampleToFloat(input[i].l);
     }
     // Xmod: sine, triangle saw.
     // Vocoder: saw, pulse, noise.
@@ -333,8 +357,8 @@ void Modulator::Process(ShortFrame* input, ShortFrame* output, size_t size) {
 
   // Convert back to integer and clip.
   while (size--) {
-    output->l = Clip16(static_cast<int32_t>(*main_output * 32768.0f));
-    output->r = Clip16(static_cast<int32_t>(*aux_output * 16384.0f));
+    FloatToSample(*main_output, &output->l);
+    FloatToSample(*aux_output * 0.5f, &output->r);
     ++main_output;
     ++aux_output;
     ++output;
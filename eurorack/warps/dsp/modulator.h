@@ -50,6 +50,19 @@ const size_t kNumOscillators = 1;
 typedef struct { short l; short r; } ShortFrame;
 typedef struct { float l; float r; } FloatFrame;
 
+// Conversions between the frame sample types and the internal float format.
+inline float SampleToFloat(short s) { return static_cast<float>(s) / 32768.0f; }
+inline float SampleToFloat(float s) { return s; }
+
+inline void FloatToSample(float x, short* s) {
+  *s = stmlib::Clip16(static_cast<int32_t>(x * 32768.0f));
+}
+
+inline void FloatToSample(float x, float* s) {
+  CONSTRAIN(x, -1.0f, 1.0f);
+  *s = x;
+}
+
 class SaturatingAmplifier {
  public:
   SaturatingAmplifier() { }
@@ -58,10 +71,11 @@ class SaturatingAmplifier {
     drive_ = 0.0f;
   }
   
+  template<typename T>
   void Process(
       float drive,
       float limit,
-      short* in,
+      const T* in,
       float* out,
       float* out_raw,
       size_t in_stride,
@@ -70,7 +84,7 @@ class SaturatingAmplifier {
     stmlib::ParameterInterpolator drive_modulation(&drive_, drive, size);
     float level = level_;
     for (size_t i = 0; i < size; ++i) {
-      float s = static_cast<float>(*in) / 32768.0f;
+      float s = SampleToFloat(*in);
       float error = s * s - level;
       level += error * (error > 0.0f ? 0.1f: 0.0001f);
       s *= level <= 0.0001f ? (1.0f / 0.0001f) * level : 1.0f;
@@ -143,6 +157,10 @@ class Modulator {
   void Init(float sample_rate);
   void Process(ShortFrame* input, ShortFrame* output, size_t size);
   void ProcessEasterEgg(ShortFrame* input, ShortFrame* output, size_t size);
+
+  // Same as above, with full-scale samples in [-1, 1] instead of 16-bit.
+  void Process(FloatFrame* input, FloatFrame* output, size_t size);
+  void ProcessEasterEgg(FloatFrame* input, FloatFrame* output, size_t size);
   inline Parameters* mutable_parameters() { return &parameters_; }
   inline const Parameters& parameters() { return parameters_; }
   
@@ -153,6 +171,11 @@ class Modulator {
   inline void set_easter_egg(bool easter_egg) { easter_egg_ = easter_egg; }
   
  private:
+  template<typename Frame>
+  void ProcessFrames(Frame* input, Frame* output, size_t size);
+  template<typename Frame>
+  void ProcessEasterEggFrames(Frame* input, Frame* output, size_t size);
+
   template<XmodAlgorithm algorithm_1, XmodAlgorithm algorithm_2>
   void ProcessXmod(
       float balance,
@@ -4,6 +4,30 @@
 #include "braids/signature_waveshaper.h"
 
 
+/** Applies the signature waveshaper to `size` samples four at a time, giving the same result as mixing each sample with SignatureWaveshaper::Transform().
+`size` must be a multiple of 4.
+*/
+static void applySignature(braids::SignatureWaveshaper& ws, int16_t* buffer, int size, uint16_t balance) {
+	const __m128i dryGain = _mm_set1_epi32(65535 - balance);
+	const __m128i wetGain = _mm_set1_epi32(balance);
+	for (int i = 0; i < size; i += 4) {
+		__m128i sample = _mm_cvtepi16_epi32(_mm_loadl_epi64((const __m128i*) &buffer[i]));
+		__m128i phase = _mm_add_epi32(sample, _mm_set1_epi32(32768));
+		__m128i fraction = _mm_and_si128(phase, _mm_set1_epi32(0xff));
+		// The transfer table is small, so look it up with scalar loads
+		int32_t index[4];
+		_mm_storeu_si128((__m128i*) index, _mm_srli_epi32(phase, 8));
+		__m128i a = _mm_setr_epi32(ws.transfer(index[0]), ws.transfer(index[1]), ws.transfer(index[2]), ws.transfer(index[3]));
+		__m128i b = _mm_setr_epi32(ws.transfer(index[0] + 1), ws.transfer(index[1] + 1), ws.transfer(index[2] + 1), ws.transfer(index[3] + 1));
+		__m128i warped = _mm_add_epi32(a, _mm_srai_epi32(_mm_mullo_epi32(_mm_sub_epi32(b, a), fraction), 8));
+		// stmlib::Mix()
+		__m128i mixed = _mm_add_epi32(_mm_mullo_epi32(sample, dryGain), _mm_mullo_epi32(warped, wetGain));
+		mixed = _mm_srai_epi32(mixed, 16);
+		_mm_storel_epi64((__m128i*) &buffer[i], _mm_packs_epi32(mixed, mixed));
+	}
+}
+
+
 struct Braids : Module {
 	enum ParamIds {
 		FINE_PARAM,
@@ -28,14 +52,16 @@ struct Braids : Module {
 		NUM_OUTPUTS
 	};
 
-	braids::MacroOscillator osc;
+	braids::MacroOscillator osc[16];
 	braids::SettingsData settings;
-	braids::VcoJitterSource jitter_source;
+	braids::VcoJitterSource jitter_source[16];
 	braids::SignatureWaveshaper ws;
 
-	dsp::SampleRateConverter<1> src;
-	dsp::DoubleRingBuffer<dsp::Frame<1>, 256> outputBuffer;
-	bool lastTrig = false;
+	dsp::SampleRateConverter<16> src;
+	dsp::DoubleRingBuffer<dsp::Frame<16>, 256> outputBuffer;
+	/** Number of channels rendered into outputBuffer. */
+	int outputChannels = 0;
+	bool lastTrig[16] = {};
 	bool lowCpu = false;
 
 	Braids() {
@@ -55,9 +81,11 @@ struct Braids : Module {
 		configOutput(OUT_OUTPUT, "Audio");
 
 		std::memset(&osc, 0, sizeof(osc));
-		osc.Init();
 		std::memset(&jitter_source, 0, sizeof(jitter_source));
-		jitter_source.Init();
+		for (int c = 0; c < 16; c++) {
+			osc[c].Init();
+			jitter_source[c].Init();
+		}
 		std::memset(&ws, 0, sizeof(ws));
 		ws.Init(0x0000);
 		std::memset(&settings, 0, sizeof(settings));
@@ -69,87 +97,101 @@ struct Braids : Module {
 	}
 
 	void process(const ProcessArgs& args) override {
+		int channels = std::max(inputs[PITCH_INPUT].getChannels(), 1);
+
 		// Trigger
-		bool trig = inputs[TRIG_INPUT].getVoltage() >= 1.0;
-		if (!lastTrig && trig) {
-			osc.Strike();
+		for (int c = 0; c < channels; c++) {
+			bool trig = inputs[TRIG_INPUT].getPolyVoltage(c) >= 1.0;
+			if (!lastTrig[c] && trig) {
+				osc[c].Strike();
+			}
+			lastTrig[c] = trig;
 		}
-		lastTrig = trig;
 
 		// Render frames
 		if (outputBuffer.empty()) {
-			float fm = params[FM_PARAM].getValue() * inputs[FM_INPUT].getVoltage();
+			// render_buffer[channel][bufferIndex]
+			int16_t render_buffer[16][24];
+
+			for (int c = 0; c < channels; c++) {
+				float fm = params[FM_PARAM].getValue() * inputs[FM_INPUT].getPolyVoltage(c);
 
-			// Set shape
-			int shape = std::round(params[SHAPE_PARAM].getValue() * braids::MACRO_OSC_SHAPE_LAST_ACCESSIBLE_FROM_META);
-			if (settings.meta_modulation) {
-				shape += std::round(fm / 10.0 * braids::MACRO_OSC_SHAPE_LAST_ACCESSIBLE_FROM_META);
+				// Set shape
+				int shape = std::round(params[SHAPE_PARAM].getValue() * braids::MACRO_OSC_SHAPE_LAST_ACCESSIBLE_FROM_META);
+				if (settings.meta_modulation) {
+					shape += std::round(fm / 10.0 * braids::MACRO_OSC_SHAPE_LAST_ACCESSIBLE_FROM_META);
+				}
+				shape = clamp(shape, 0, braids::MACRO_OSC_SHAPE_LAST_ACCESSIBLE_FROM_META);
+				// Display the shape of the first channel
+				if (c == 0)
+					settings.shape = shape;
+
+				// Setup oscillator from settings
+				osc[c].set_shape((braids::MacroOscillatorShape) shape);
+
+				// Set timbre/modulation
+				float timbre = params[TIMBRE_PARAM].getValue() + params[MODULATION_PARAM].getValue() * inputs[TIMBRE_INPUT].getPolyVoltage(c) / 5.0;
+				float modulation = params[COLOR_PARAM].getValue() + inputs[COLOR_INPUT].getPolyVoltage(c) / 5.0;
+				int16_t param1 = rescale(clamp(timbre, 0.0f, 1.0f), 0.0f, 1.0f, 0, INT16_MAX);
+				int16_t param2 = rescale(clamp(modulation, 0.0f, 1.0f), 0.0f, 1.0f, 0, INT16_MAX);
+				osc[c].set_parameters(param1, param2);
+
+				// Set pitch
+				float pitchV = inputs[PITCH_INPUT].getVoltage(c) + params[COARSE_PARAM].getValue() + params[FINE_PARAM].getValue() / 12.0;
+				if (!settings.meta_modulation)
+					pitchV += fm;
+				if (lowCpu)
+					pitchV += std::log2(96000.f * args.sampleTime);
+				int32_t pitch = (pitchV * 12.0 + 60) * 128;
+				pitch += jitter_source[c].Render(settings.vco_drift);
+				pitch = clamp(pitch, 0, 16383);
+				osc[c].set_pitch(pitch);
+
+				// TODO: add a sync input buffer (must be sample rate converted)
+				uint8_t sync_buffer[24] = {};
+
+				osc[c].Render(sync_buffer, render_buffer[c], 24);
+
+				// Signature waveshaping, decimation (not yet supported), and bit reduction (not yet supported)
+				uint16_t signature = settings.signature * settings.signature * 4095;
+				applySignature(ws, render_buffer[c], 24, signature);
 			}
-			settings.shape = clamp(shape, 0, braids::MACRO_OSC_SHAPE_LAST_ACCESSIBLE_FROM_META);
-
-			// Setup oscillator from settings
-			osc.set_shape((braids::MacroOscillatorShape) settings.shape);
-
-			// Set timbre/modulation
-			float timbre = params[TIMBRE_PARAM].getValue() + params[MODULATION_PARAM].getValue() * inputs[TIMBRE_INPUT].getVoltage() / 5.0;
-			float modulation = params[COLOR_PARAM].getValue() + inputs[COLOR_INPUT].getVoltage() / 5.0;
-			int16_t param1 = rescale(clamp(timbre, 0.0f, 1.0f), 0.0f, 1.0f, 0, INT16_MAX);
-			int16_t param2 = rescale(clamp(modulation, 0.0f, 1.0f), 0.0f, 1.0f, 0, INT16_MAX);
-			osc.set_parameters(param1, param2);
-
-			// Set pitch
-			float pitchV = inputs[PITCH_INPUT].getVoltage() + params[COARSE_PARAM].getValue() + params[FINE_PARAM].getValue() / 12.0;
-			if (!settings.meta_modulation)
-				pitchV += fm;
-			if (lowCpu)
-				pitchV += std::log2(96000.f * args.sampleTime);
-			int32_t pitch = (pitchV * 12.0 + 60) * 128;
-			pitch += jitter_source.Render(settings.vco_drift);
-			pitch = clamp(pitch, 0, 16383);
-			osc.set_pitch(pitch);
-
-			// TODO: add a sync input buffer (must be sample rate converted)
-			uint8_t sync_buffer[24] = {};
-
-			int16_t render_buffer[24];
-			osc.Render(sync_buffer, render_buffer, 24);
-
-			// Signature waveshaping, decimation (not yet supported), and bit reduction (not yet supported)
-			uint16_t signature = settings.signature * settings.signature * 4095;
-			for (size_t i = 0; i < 24; i++) {
-				const int16_t bit_mask = 0xffff;
-				int16_t sample = render_buffer[i] & bit_mask;
-				int16_t warped = ws.Transform(sample);
-				render_buffer[i] = stmlib::Mix(sample, warped, signature);
+
+			// Interleave channels
+			dsp::Frame<16> in[24] = {};
+			for (int i = 0; i < 24; i++) {
+				for (int c = 0; c < channels; c++) {
+					in[i].samples[c] = render_buffer[c][i] / 32768.0;
+				}
 			}
 
 			if (lowCpu) {
 				for (int i = 0; i < 24; i++) {
-					dsp::Frame<1> f;
-					f.samples[0] = render_buffer[i] / 32768.0;
-					outputBuffer.push(f);
+					outputBuffer.push(in[i]);
 				}
 			}
 			else {
-				// Sample rate convert
-				dsp::Frame<1> in[24];
-				for (int i = 0; i < 24; i++) {
-					in[i].samples[0] = render_buffer[i] / 32768.0;
-				}
+				// Sample rate convert all channels in one pass
 				src.setRates(96000, args.sampleRate);
+				src.setChannels(channels);
 
 				int inLen = 24;
 				int outLen = outputBuffer.capacity();
 				src.process(in, &inLen, outputBuffer.endData(), &outLen);
 				outputBuffer.endIncr(outLen);
 			}
+			outputChannels = channels;
 		}
 
 		// Output
 		if (!outputBuffer.empty()) {
-			dsp::Frame<1> f = outputBuffer.shift();
-			outputs[OUT_OUTPUT].setVoltage(5.0 * f.samples[0]);
+			dsp::Frame<16> f = outputBuffer.shift();
+			for (int c = 0; c < channels; c++) {
+				// Channels added since the buffer was rendered stay silent until the next render
+				outputs[OUT_OUTPUT].setVoltage(c < outputChannels ? 5.0 * f.samples[c] : 0.0, c);
+			}
 		}
+		outputs[OUT_OUTPUT].setChannels(channels);
 	}
 
 	json_t* dataToJson() override {
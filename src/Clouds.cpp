@@ -1,5 +1,9 @@
 #include "plugin.hpp"
+#include "WorkerPool.hpp"
 #include "clouds/dsp/granular_processor.h"
+#include <condition_variable>
+#include <mutex>
+#include <thread>
 
 
 struct Clouds : Module {
@@ -46,16 +50,47 @@ struct Clouds : Module {
 		NUM_LIGHTS
 	};
 
-	dsp::SampleRateConverter<2> inputSrc;
-	dsp::SampleRateConverter<2> outputSrc;
-	dsp::DoubleRingBuffer<dsp::Frame<2>, 256> inputBuffer;
-	dsp::DoubleRingBuffer<dsp::Frame<2>, 256> outputBuffer;
-
-	uint8_t* block_mem;
-	uint8_t* block_ccm;
-	clouds::GranularProcessor* processor;
+	dsp::SampleRateConverter<16 * 2> inputSrc;
+	dsp::SampleRateConverter<16 * 2> outputSrc;
+	dsp::DoubleRingBuffer<dsp::Frame<16 * 2>, 256> inputBuffer;
+	dsp::DoubleRingBuffer<dsp::Frame<16 * 2>, 256> outputBuffer;
+
+	/** A processor and the RAM it was initialized with. */
+	struct ProcessorSlot {
+		clouds::GranularProcessor processor;
+		/** Held by the spectral thread while it processes a hop of this processor. The engine thread only tries to lock it, so it never waits on a hop. */
+		std::mutex spectralMutex;
+		alignas(16) uint8_t blockMem[118784];
+		alignas(16) uint8_t blockCcm[65536 - 128];
+	};
+	/** One processor per polyphony channel, all carved from a single allocation. */
+	struct Processors {
+		ProcessorSlot* slots;
+		int count;
+
+		Processors(int count) : count(count) {
+			// Value-initialize so processors and their RAM start zeroed
+			slots = new ProcessorSlot[count]();
+			for (int c = 0; c < count; c++) {
+				ProcessorSlot* slot = &slots[c];
+				slot->processor.Init(slot->blockMem, sizeof(slot->blockMem), slot->blockCcm, sizeof(slot->blockCcm));
+				slot->processor.set_defer_spectral(true);
+			}
+		}
+		~Processors() {
+			delete[] slots;
+		}
+	};
+	/** Only accessed by the engine thread. */
+	Processors* processors = NULL;
+	/** Allocated and initialized by setPolyphony(), and swapped in by the engine thread. */
+	std::atomic<Processors*> nextProcessors{NULL};
+	/** Replaced processors, waiting for room in the spectral queue to be freed by the spectral thread. */
+	Processors* retiredProcessors = NULL;
+	/** Maximum number of polyphony channels. */
+	int polyphony = 1;
 
-	bool triggered = false;
+	bool triggered[16] = {};
 
 	dsp::SchmittTrigger freezeTrigger;
 	bool freeze = false;
@@ -65,6 +100,33 @@ struct Clouds : Module {
 	clouds::PlaybackMode playback;
 	int quality = 0;
 
+	// Multi-threaded rendering
+	/** Number of threads rendering processors, including the engine thread. */
+	int renderThreads = 1;
+	WorkerPool workerPool;
+	// Only written by the engine thread while no render jobs are in flight
+	clouds::ShortFrame renderInput[16][32] = {};
+	clouds::ShortFrame renderOutput[16][32] = {};
+	/** Channels left silent for this block because their processor is busy on the spectral thread. */
+	bool renderSkip[16] = {};
+
+	// Asynchronous spectral processing
+	/** Computes the FFT/IFFT of each spectral hop, so the engine thread never does. Its output is read back one hop later. */
+	std::thread spectralThread;
+	std::atomic<bool> spectralRunning{true};
+	/** A processor with a new hop, or replaced processors to free once the hops queued before them are done. */
+	struct SpectralTask {
+		ProcessorSlot* slot;
+		Processors* retired;
+	};
+	/** Pushed by the engine thread and popped by the spectral thread. */
+	dsp::RingBuffer<SpectralTask, 64> spectralQueue;
+	std::mutex spectralSleepMutex;
+	std::condition_variable spectralSleepCv;
+	std::atomic<int> spectralSleepers{0};
+	/** Number of hops of each channel already pushed to the queue. */
+	size_t spectralHops[16] = {};
+
 	Clouds() {
 		config(NUM_PARAMS, NUM_INPUTS, NUM_OUTPUTS, NUM_LIGHTS);
 		configParam(POSITION_PARAM, 0.0, 1.0, 0.5, "Grain position");
@@ -96,29 +158,141 @@ struct Clouds : Module {
 		configBypass(IN_L_INPUT, OUT_L_OUTPUT);
 		configBypass(IN_R_INPUT, OUT_R_OUTPUT);
 
-		const int memLen = 118784;
-		const int ccmLen = 65536 - 128;
-		block_mem = new uint8_t[memLen]();
-		block_ccm = new uint8_t[ccmLen]();
-		processor = new clouds::GranularProcessor();
-		memset(processor, 0, sizeof(*processor));
-
-		processor->Init(block_mem, memLen, block_ccm, ccmLen);
+		processors = new Processors(1);
 		onReset();
+		spectralThread = std::thread([this]() {spectralWork();});
 	}
 
 	~Clouds() {
-		delete processor;
-		delete[] block_mem;
-		delete[] block_ccm;
+		// Wait for render jobs and spectral hops before freeing the processors they use
+		workerPool.setThreads(0);
+		spectralRunning = false;
+		{
+			std::lock_guard<std::mutex> lock(spectralSleepMutex);
+			spectralSleepCv.notify_all();
+		}
+		spectralThread.join();
+		while (!spectralQueue.empty()) {
+			delete spectralQueue.shift().retired;
+		}
+		delete retiredProcessors;
+		delete nextProcessors.exchange(NULL);
+		delete processors;
+	}
+
+	/** Bytes used by the module, including its processors. */
+	size_t getMemorySize() {
+		return sizeof(Clouds) + polyphony * sizeof(ProcessorSlot);
+	}
+
+	/** Replaces all processors with new ones, clearing their recordings.
+	The processors are allocated by the calling thread, and swapped in by the engine thread.
+	*/
+	void setPolyphony(int channels) {
+		channels = clamp(channels, 1, 16);
+		if (channels == polyphony)
+			return;
+		polyphony = channels;
+		// Replaces processors that were not swapped in yet
+		delete nextProcessors.exchange(new Processors(polyphony));
+	}
+
+	/** Swaps in the processors allocated by setPolyphony(), and hands the replaced ones to the spectral thread. */
+	void swapProcessors() {
+		if (!retiredProcessors) {
+			Processors* next = nextProcessors.exchange(NULL);
+			if (next) {
+				retiredProcessors = processors;
+				processors = next;
+				for (int c = 0; c < 16; c++) {
+					spectralHops[c] = 0;
+				}
+			}
+		}
+		// Queued after the hops of the replaced processors, so the spectral thread frees them once it is done with them
+		if (retiredProcessors && !spectralQueue.full()) {
+			spectralQueue.push({NULL, retiredProcessors});
+			retiredProcessors = NULL;
+			notifySpectral();
+		}
+	}
+
+	void setRenderThreads(int threads) {
+		renderThreads = clamp(threads, 1, 4);
+		workerPool.setThreads(renderThreads - 1);
+	}
+
+	static void renderJob(void* context, int c) {
+		Clouds* that = (Clouds*) context;
+		if (that->renderSkip[c]) {
+			std::memset(that->renderOutput[c], 0, sizeof(that->renderOutput[c]));
+			return;
+		}
+		that->processors->slots[c].processor.Process(that->renderInput[c], that->renderOutput[c], 32);
+	}
+
+	void spectralWork() {
+#if defined(__x86_64__) || defined(__i386__)
+		// Match the engine threads: flush denormals to zero
+		_mm_setcsr(_mm_getcsr() | 0x8040);
+#endif
+		while (spectralRunning) {
+			if (spectralQueue.empty()) {
+				std::unique_lock<std::mutex> lock(spectralSleepMutex);
+				spectralSleepers++;
+				spectralSleepCv.wait(lock, [&]() {
+					return !spectralRunning || !spectralQueue.empty();
+				});
+				spectralSleepers--;
+				continue;
+			}
+			SpectralTask task = spectralQueue.shift();
+			if (task.slot) {
+				std::lock_guard<std::mutex> lock(task.slot->spectralMutex);
+				task.slot->processor.BufferSpectral();
+			}
+			delete task.retired;
+		}
+	}
+
+	void notifySpectral() {
+		if (spectralSleepers.load() > 0) {
+			std::lock_guard<std::mutex> lock(spectralSleepMutex);
+			spectralSleepCv.notify_all();
+		}
+	}
+
+	/** Queues the hops completed by the last render of each channel. */
+	void queueSpectralHops(int channels) {
+		bool queued = false;
+		for (int c = 0; c < channels; c++) {
+			ProcessorSlot* slot = &processors->slots[c];
+			size_t hops = slot->processor.num_spectral_hops();
+			if (hops == spectralHops[c])
+				continue;
+			spectralHops[c] = hops;
+			// If the queue is full, the hop is caught up on the engine thread instead
+			if (!spectralQueue.full()) {
+				spectralQueue.push({slot, NULL});
+				queued = true;
+			}
+		}
+		if (queued)
+			notifySpectral();
 	}
 
 	void process(const ProcessArgs& args) override {
+		swapProcessors();
+		int channels = std::min(std::max(inputs[IN_L_INPUT].getChannels(), inputs[IN_R_INPUT].getChannels()), processors->count);
+		channels = std::max(channels, 1);
+
 		// Get input
-		dsp::Frame<2> inputFrame = {};
+		dsp::Frame<16 * 2> inputFrame = {};
 		if (!inputBuffer.full()) {
-			inputFrame.samples[0] = inputs[IN_L_INPUT].getVoltage() * params[IN_GAIN_PARAM].getValue() / 5.0;
-			inputFrame.samples[1] = inputs[IN_R_INPUT].isConnected() ? inputs[IN_R_INPUT].getVoltage() * params[IN_GAIN_PARAM].getValue() / 5.0 : inputFrame.samples[0];
+			for (int c = 0; c < channels; c++) {
+				inputFrame.samples[c * 2 + 0] = inputs[IN_L_INPUT].getPolyVoltage(c) * params[IN_GAIN_PARAM].getValue() / 5.0;
+				inputFrame.samples[c * 2 + 1] = inputs[IN_R_INPUT].isConnected() ? inputs[IN_R_INPUT].getPolyVoltage(c) * params[IN_GAIN_PARAM].getValue() / 5.0 : inputFrame.samples[c * 2 + 0];
+			}
 			inputBuffer.push(inputFrame);
 		}
 
@@ -130,103 +304,157 @@ struct Clouds : Module {
 		}
 
 		// Trigger
-		if (inputs[TRIG_INPUT].getVoltage() >= 1.0) {
-			triggered = true;
+		for (int c = 0; c < channels; c++) {
+			if (inputs[TRIG_INPUT].getPolyVoltage(c) >= 1.0) {
+				triggered[c] = true;
+			}
 		}
 
 		// Render frames
 		if (outputBuffer.empty()) {
-			clouds::ShortFrame input[32] = {};
 			// Convert input buffer
 			{
 				inputSrc.setRates(args.sampleRate, 32000);
-				dsp::Frame<2> inputFrames[32];
+				inputSrc.setChannels(channels * 2);
+				dsp::Frame<16 * 2> inputFrames[32];
 				int inLen = inputBuffer.size();
 				int outLen = 32;
 				inputSrc.process(inputBuffer.startData(), &inLen, inputFrames, &outLen);
 				inputBuffer.startIncr(inLen);
 
 				// We might not fill all of the input buffer if there is a deficiency, but this cannot be avoided due to imprecisions between the input and output SRC.
-				for (int i = 0; i < outLen; i++) {
-					input[i].l = clamp(inputFrames[i].samples[0] * 32767.0f, -32768.0f, 32767.0f);
-					input[i].r = clamp(inputFrames[i].samples[1] * 32767.0f, -32768.0f, 32767.0f);
+				for (int c = 0; c < channels; c++) {
+					for (int i = 0; i < 32; i++) {
+						if (i < outLen) {
+							renderInput[c][i].l = clamp(inputFrames[i].samples[c * 2 + 0] * 32767.0f, -32768.0f, 32767.0f);
+							renderInput[c][i].r = clamp(inputFrames[i].samples[c * 2 + 1] * 32767.0f, -32768.0f, 32767.0f);
+						}
+						else {
+							renderInput[c][i].l = 0;
+							renderInput[c][i].r = 0;
+						}
+					}
 				}
 			}
 
-			// Set up processor
-			processor->set_playback_mode(playback);
-			processor->set_quality(quality);
-			processor->Prepare();
-
-			clouds::Parameters* p = processor->mutable_parameters();
-			p->trigger = triggered;
-			p->gate = triggered;
-			p->freeze = freeze || (inputs[FREEZE_INPUT].getVoltage() >= 1.0);
-			p->position = clamp(params[POSITION_PARAM].getValue() + inputs[POSITION_INPUT].getVoltage() / 5.0f, 0.0f, 1.0f);
-			p->size = clamp(params[SIZE_PARAM].getValue() + inputs[SIZE_INPUT].getVoltage() / 5.0f, 0.0f, 1.0f);
-			p->pitch = clamp((params[PITCH_PARAM].getValue() + inputs[PITCH_INPUT].getVoltage()) * 12.0f, -48.0f, 48.0f);
-			p->density = clamp(params[DENSITY_PARAM].getValue() + inputs[DENSITY_INPUT].getVoltage() / 5.0f, 0.0f, 1.0f);
-			p->texture = clamp(params[TEXTURE_PARAM].getValue() + inputs[TEXTURE_INPUT].getVoltage() / 5.0f, 0.0f, 1.0f);
-			p->dry_wet = params[BLEND_PARAM].getValue();
-			p->stereo_spread = params[SPREAD_PARAM].getValue();
-			p->feedback = params[FEEDBACK_PARAM].getValue();
-			// TODO
-			// Why doesn't dry audio get reverbed?
-			p->reverb = params[REVERB_PARAM].getValue();
-			float blend = inputs[BLEND_INPUT].getVoltage() / 5.0f;
-			switch (blendMode) {
-				case 0:
-					p->dry_wet += blend;
-					p->dry_wet = clamp(p->dry_wet, 0.0f, 1.0f);
-					break;
-				case 1:
-					p->stereo_spread += blend;
-					p->stereo_spread = clamp(p->stereo_spread, 0.0f, 1.0f);
-					break;
-				case 2:
-					p->feedback += blend;
-					p->feedback = clamp(p->feedback, 0.0f, 1.0f);
-					break;
-				case 3:
-					p->reverb += blend;
-					p->reverb = clamp(p->reverb, 0.0f, 1.0f);
-					break;
+			// Set up processors
+			for (int c = 0; c < channels; c++) {
+				ProcessorSlot* slot = &processors->slots[c];
+				clouds::GranularProcessor* processor = &slot->processor;
+				processor->set_playback_mode(playback);
+				processor->set_quality(quality);
+				renderSkip[c] = false;
+				if (processor->buffers_reset_pending()) {
+					// Resetting reallocates the memory of the phase vocoder. If the spectral thread is still on a hop of this processor, retry on the next block. Process() outputs silence until the reset is done.
+					if (slot->spectralMutex.try_lock()) {
+						processor->Prepare();
+						slot->spectralMutex.unlock();
+					}
+				}
+				else {
+					processor->Prepare();
+				}
+				// The processor is about to overwrite the output of the oldest pending hop, so finish it here if the spectral thread has fallen behind.
+				if (processor->num_pending_spectral_hops() >= 2) {
+					if (slot->spectralMutex.try_lock()) {
+						while (processor->num_pending_spectral_hops() >= 2) {
+							processor->BufferSpectral();
+						}
+						slot->spectralMutex.unlock();
+					}
+					else {
+						// The spectral thread is finishing that hop right now. Drop this block rather than wait for it.
+						renderSkip[c] = true;
+					}
+				}
+
+				clouds::Parameters* p = processor->mutable_parameters();
+				p->trigger = triggered[c];
+				p->gate = triggered[c];
+				p->freeze = freeze || (inputs[FREEZE_INPUT].getPolyVoltage(c) >= 1.0);
+				p->position = clamp(params[POSITION_PARAM].getValue() + inputs[POSITION_INPUT].getPolyVoltage(c) / 5.0f, 0.0f, 1.0f);
+				p->size = clamp(params[SIZE_PARAM].getValue() + inputs[SIZE_INPUT].getPolyVoltage(c) / 5.0f, 0.0f, 1.0f);
+				p->pitch = clamp((params[PITCH_PARAM].getValue() + inputs[PITCH_INPUT].getPolyVoltage(c)) * 12.0f, -48.0f, 48.0f);
+				p->density = clamp(params[DENSITY_PARAM].getValue() + inputs[DENSITY_INPUT].getPolyVoltage(c) / 5.0f, 0.0f, 1.0f);
+				p->texture = clamp(params[TEXTURE_PARAM].getValue() + inputs[TEXTURE_INPUT].getPolyVoltage(c) / 5.0f, 0.0f, 1.0f);
+				p->dry_wet = params[BLEND_PARAM].getValue();
+				p->stereo_spread = params[SPREAD_PARAM].getValue();
+				p->feedback = params[FEEDBACK_PARAM].getValue();
+				// TODO
+				// Why doesn't dry audio get reverbed?
+				p->reverb = params[REVERB_PARAM].getValue();
+				float blend = inputs[BLEND_INPUT].getPolyVoltage(c) / 5.0f;
+				switch (blendMode) {
+					case 0:
+						p->dry_wet += blend;
+						p->dry_wet = clamp(p->dry_wet, 0.0f, 1.0f);
+						break;
+					case 1:
+						p->stereo_spread += blend;
+						p->stereo_spread = clamp(p->stereo_spread, 0.0f, 1.0f);
+						break;
+					case 2:
+						p->feedback += blend;
+						p->feedback = clamp(p->feedback, 0.0f, 1.0f);
+						break;
+					case 3:
+						p->reverb += blend;
+						p->reverb = clamp(p->reverb, 0.0f, 1.0f);
+						break;
+				}
 			}
 
-			clouds::ShortFrame output[32];
-			processor->Process(input, output, 32);
+			// Process channels
+			if (workerPool.getThreads() > 0) {
+				workerPool.run(renderJob, this, channels);
+			}
+			else {
+				for (int c = 0; c < channels; c++) {
+					renderJob(this, c);
+				}
+			}
+			queueSpectralHops(channels);
 
 			// Convert output buffer
 			{
-				dsp::Frame<2> outputFrames[32];
-				for (int i = 0; i < 32; i++) {
-					outputFrames[i].samples[0] = output[i].l / 32768.0;
-					outputFrames[i].samples[1] = output[i].r / 32768.0;
+				dsp::Frame<16 * 2> outputFrames[32];
+				for (int c = 0; c < channels; c++) {
+					for (int i = 0; i < 32; i++) {
+						outputFrames[i].samples[c * 2 + 0] = renderOutput[c][i].l / 32768.0;
+						outputFrames[i].samples[c * 2 + 1] = renderOutput[c][i].r / 32768.0;
+					}
 				}
 
 				outputSrc.setRates(32000, args.sampleRate);
+				outputSrc.setChannels(channels * 2);
 				int inLen = 32;
 				int outLen = outputBuffer.capacity();
 				outputSrc.process(outputFrames, &inLen, outputBuffer.endData(), &outLen);
 				outputBuffer.endIncr(outLen);
 			}
 
-			triggered = false;
+			for (int c = 0; c < 16; c++) {
+				triggered[c] = false;
+			}
 		}
 
 		// Set output
-		dsp::Frame<2> outputFrame = {};
+		dsp::Frame<16 * 2> outputFrame = {};
 		if (!outputBuffer.empty()) {
 			outputFrame = outputBuffer.shift();
-			outputs[OUT_L_OUTPUT].setVoltage(5.0 * outputFrame.samples[0]);
-			outputs[OUT_R_OUTPUT].setVoltage(5.0 * outputFrame.samples[1]);
+			for (int c = 0; c < channels; c++) {
+				outputs[OUT_L_OUTPUT].setVoltage(5.0 * outputFrame.samples[c * 2 + 0], c);
+				outputs[OUT_R_OUTPUT].setVoltage(5.0 * outputFrame.samples[c * 2 + 1], c);
+			}
 		}
+		outputs[OUT_L_OUTPUT].setChannels(channels);
+		outputs[OUT_R_OUTPUT].setChannels(channels);
 
-		// Lights
-		clouds::Parameters* p = processor->mutable_parameters();
+		// Lights, based on the first poly channel
+		clouds::Parameters* p = processors->slots[0].processor.mutable_parameters();
 		dsp::VuMeter vuMeter;
 		vuMeter.dBInterval = 6.0;
-		dsp::Frame<2> lightFrame = p->freeze ? outputFrame : inputFrame;
+		dsp::Frame<16 * 2> lightFrame = p->freeze ? outputFrame : inputFrame;
 		vuMeter.setValue(fmaxf(fabsf(lightFrame.samples[0]), fabsf(lightFrame.samples[1])));
 		lights[FREEZE_LIGHT].setBrightness(p->freeze ? 0.75 : 0.0);
 		lights[MIX_GREEN_LIGHT].setSmoothBrightness(vuMeter.getBrightness(3), args.sampleTime);
@@ -252,6 +480,8 @@ struct Clouds : Module {
 		json_object_set_new(rootJ, "playback", json_integer((int) playback));
 		json_object_set_new(rootJ, "quality", json_integer(quality));
 		json_object_set_new(rootJ, "blendMode", json_integer(blendMode));
+		json_object_set_new(rootJ, "polyphony", json_integer(polyphony));
+		json_object_set_new(rootJ, "renderThreads", json_integer(renderThreads));
 
 		return rootJ;
 	}
@@ -271,6 +501,14 @@ struct Clouds : Module {
 		if (blendModeJ) {
 			blendMode = json_integer_value(blendModeJ);
 		}
+
+		json_t* polyphonyJ = json_object_get(rootJ, "polyphony");
+		if (polyphonyJ)
+			setPolyphony(json_integer_value(polyphonyJ));
+
+		json_t* renderThreadsJ = json_object_get(rootJ, "renderThreads");
+		if (renderThreadsJ)
+			setRenderThreads(json_integer_value(renderThreadsJ));
 	}
 };
 
@@ -406,6 +644,24 @@ struct CloudsWidget : ModuleWidget {
 				[=]() {module->quality = i;}
 			));
 		}
+
+		menu->addChild(new MenuSeparator);
+
+		static const std::vector<int> polyphonyChannels = {1, 2, 4, 8, 16};
+		menu->addChild(createIndexSubmenuItem("Polyphony", {"Off (first channel only)", "2 channels", "4 channels", "8 channels", "16 channels"},
+			[=]() {
+				auto it = std::find(polyphonyChannels.begin(), polyphonyChannels.end(), module->polyphony);
+				return it - polyphonyChannels.begin();
+			},
+			[=](size_t i) {module->setPolyphony(polyphonyChannels[i]);}
+		));
+
+		menu->addChild(createIndexSubmenuItem("Render threads", {"1 (engine thread)", "2", "3", "4"},
+			[=]() {return module->renderThreads - 1;},
+			[=](size_t i) {module->setRenderThreads(i + 1);}
+		));
+
+		menu->addChild(createMenuLabel(string::f("Memory: %d KB, %d KB per channel", (int) (module->getMemorySize() / 1024), (int) (sizeof(Clouds::ProcessorSlot) / 1024))));
 	}
 };
 
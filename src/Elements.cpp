@@ -1,5 +1,8 @@
 #include "plugin.hpp"
+#include "WorkerPool.hpp"
+#include "SlotAllocator.hpp"
 #include "elements/dsp/part.h"
+#include "stmlib/utils/random.h"
 
 
 struct Elements : Module {
@@ -75,8 +78,27 @@ struct Elements : Module {
 	dsp::DoubleRingBuffer<dsp::Frame<16 * 2>, 256> inputBuffer;
 	dsp::DoubleRingBuffer<dsp::Frame<16 * 2>, 256> outputBuffer;
 
-	uint16_t reverb_buffers[16][32768] = {};
-	elements::Part* parts[16];
+	/** A part and its reverb delay line, kept together in one allocation. */
+	struct PartSlot {
+		elements::Part part;
+		uint16_t reverbBuffer[32768];
+		/** Swapped in while the part renders, so its noise doesn't depend on which thread renders it. */
+		stmlib::Random::State randomState;
+	};
+	/** Allocated off the engine thread the first time their channel is used. */
+	SlotAllocator<PartSlot> partSlots;
+
+	// Multi-threaded rendering
+	/** Number of threads rendering parts, including the engine thread. */
+	int renderThreads = 1;
+	WorkerPool workerPool;
+	// Only written by the engine thread while no render jobs are in flight
+	elements::PerformanceState renderPerformance[16] = {};
+	// renderBlow[channel][bufferIndex]
+	float renderBlow[16][16] = {};
+	float renderStrike[16][16] = {};
+	float renderMain[16][16] = {};
+	float renderAux[16][16] = {};
 
 	Elements() {
 		config(NUM_PARAMS, NUM_INPUTS, NUM_OUTPUTS, NUM_LIGHTS);
@@ -132,21 +154,39 @@ struct Elements : Module {
 		configBypass(BLOW_INPUT, AUX_OUTPUT);
 		configBypass(STRIKE_INPUT, MAIN_OUTPUT);
 
-		for (int c = 0; c < 16; c++) {
-			parts[c] = new elements::Part();
-			// In the Mutable Instruments code, Part doesn't initialize itself, so zero it here.
-			std::memset(parts[c], 0, sizeof(*parts[c]));
-			parts[c]->Init(reverb_buffers[c]);
+		// In the Mutable Instruments code, Part doesn't initialize itself, but SlotAllocator value-initializes the slots to zero them.
+		partSlots.init([](void* context, PartSlot* slot, int index) {
+			elements::Part* part = &slot->part;
+			part->Init(slot->reverbBuffer);
 			// Just some random numbers
 			uint32_t seed[3] = {1, 2, 3};
-			parts[c]->Seed(seed, 3);
-		}
+			part->Seed(seed, 3);
+			slot->randomState.value = 0x21 + index;
+			slot->randomState.seeded = true;
+		}, this);
 	}
 
 	~Elements() {
-		for (int c = 0; c < 16; c++) {
-			delete parts[c];
-		}
+		// Wait for render jobs before freeing the parts they use
+		workerPool.setThreads(0);
+	}
+
+	/** Bytes used by the module, including its allocated parts. */
+	size_t getMemorySize() {
+		return sizeof(Elements) + partSlots.getAllocatedCount() * sizeof(PartSlot);
+	}
+
+	void setRenderThreads(int threads) {
+		renderThreads = clamp(threads, 1, 4);
+		workerPool.setThreads(renderThreads - 1);
+	}
+
+	static void renderJob(void* context, int c) {
+		Elements* that = (Elements*) context;
+		PartSlot* slot = that->partSlots[c];
+		stmlib::Random::SwapState(&slot->randomState);
+		slot->part.Process(that->renderPerformance[c], that->renderBlow[c], that->renderStrike[c], that->renderMain[c], that->renderAux[c], 16);
+		stmlib::Random::SwapState(&slot->randomState);
 	}
 
 	void onReset() override {
@@ -155,6 +195,13 @@ struct Elements : Module {
 
 	void process(const ProcessArgs& args) override {
 		int channels = std::max(inputs[NOTE_INPUT].getChannels(), 1);
+		// New parts are picked up a few blocks after their channel first appears, and take the model of the first part
+		int partCount = partSlots.size();
+		channels = partSlots.grow(channels);
+		for (int c = partCount; c < partSlots.size(); c++) {
+			partSlots[c]->part.set_easter_egg(partSlots[0]->part.easter_egg());
+			partSlots[c]->part.set_resonator_model(partSlots[0]->part.resonator_model());
+		}
 
 		// Get input
 		if (!inputBuffer.full()) {
@@ -168,10 +215,6 @@ struct Elements : Module {
 
 		// Generate output if output buffer is empty
 		if (outputBuffer.empty()) {
-			// blow[channel][bufferIndex]
-			float blow[16][16] = {};
-			float strike[16][16] = {};
-
 			// Convert input buffer
 			{
 				inputSrc.setRates(args.sampleRate, 32000);
@@ -183,24 +226,17 @@ struct Elements : Module {
 				inputBuffer.startIncr(inLen);
 
 				for (int c = 0; c < channels; c++) {
-					for (int i = 0; i < outLen; i++) {
-						blow[c][i] = inputFrames[i].samples[c * 2 + 0];
-						strike[c][i] = inputFrames[i].samples[c * 2 + 1];
+					for (int i = 0; i < 16; i++) {
+						renderBlow[c][i] = (i < outLen) ? inputFrames[i].samples[c * 2 + 0] : 0.f;
+						renderStrike[c][i] = (i < outLen) ? inputFrames[i].samples[c * 2 + 1] : 0.f;
 					}
 				}
 			}
 
-			// Process channels
-			// main[channel][bufferIndex]
-			float main[16][16];
-			float aux[16][16];
-			float gateLight = 0.f;
-			float exciterLight = 0.f;
-			float resonatorLight = 0.f;
-
+			// Set up channels
 			for (int c = 0; c < channels; c++) {
 				// Set patch from parameters
-				elements::Patch* p = parts[c]->mutable_patch();
+				elements::Patch* p = partSlots[c]->part.mutable_patch();
 				p->exciter_envelope_shape = params[CONTOUR_PARAM].getValue();
 				p->exciter_bow_level = params[BOW_PARAM].getValue();
 				p->exciter_blow_level = params[BLOW_PARAM].getValue();
@@ -220,19 +256,31 @@ struct Elements : Module {
 				p->space = clamp(params[SPACE_PARAM].getValue() + params[SPACE_MOD_PARAM].getValue() * inputs[SPACE_MOD_INPUT].getPolyVoltage(c) / 5.f, 0.f, 2.f);
 
 				// Get performance inputs
-				elements::PerformanceState performance;
+				elements::PerformanceState& performance = renderPerformance[c];
 				performance.note = 12.f * inputs[NOTE_INPUT].getVoltage(c) + std::round(params[COARSE_PARAM].getValue()) + params[FINE_PARAM].getValue() + 69.f;
 				performance.modulation = 3.3f * dsp::quarticBipolar(params[FM_PARAM].getValue()) * 49.5f * inputs[FM_INPUT].getPolyVoltage(c) / 5.f;
 				performance.gate = params[PLAY_PARAM].getValue() >= 1.f || inputs[GATE_INPUT].getPolyVoltage(c) >= 1.f;
 				performance.strength = clamp(1.f - inputs[STRENGTH_INPUT].getPolyVoltage(c) / 5.f, 0.f, 1.f);
+			}
 
-				// Generate audio
-				parts[c]->Process(performance, blow[c], strike[c], main[c], aux[c], 16);
+			// Generate audio
+			if (workerPool.getThreads() > 0) {
+				workerPool.run(renderJob, this, channels);
+			}
+			else {
+				for (int c = 0; c < channels; c++) {
+					renderJob(this, c);
+				}
+			}
 
-				// Set lights based on first poly channel
-				gateLight = std::max(gateLight, performance.gate ? 0.75f : 0.f);
-				exciterLight = std::max(exciterLight, parts[c]->exciter_level());
-				resonatorLight = std::max(resonatorLight, parts[c]->resonator_level());
+			// Set lights based on the loudest poly channel
+			float gateLight = 0.f;
+			float exciterLight = 0.f;
+			float resonatorLight = 0.f;
+			for (int c = 0; c < channels; c++) {
+				gateLight = std::max(gateLight, renderPerformance[c].gate ? 0.75f : 0.f);
+				exciterLight = std::max(exciterLight, partSlots[c]->part.exciter_level());
+				resonatorLight = std::max(resonatorLight, partSlots[c]->part.resonator_level());
 			}
 
 			// Set lights
@@ -245,8 +293,8 @@ struct Elements : Module {
 				dsp::Frame<16 * 2> outputFrames[16];
 				for (int c = 0; c < channels; c++) {
 					for (int i = 0; i < 16; i++) {
-						outputFrames[i].samples[c * 2 + 0] = main[c][i];
-						outputFrames[i].samples[c * 2 + 1] = aux[c][i];
+						outputFrames[i].samples[c * 2 + 0] = renderMain[c][i];
+						outputFrames[i].samples[c * 2 + 1] = renderAux[c][i];
 					}
 				}
 
@@ -275,6 +323,7 @@ struct Elements : Module {
 	json_t* dataToJson() override {
 		json_t* rootJ = json_object();
 		json_object_set_new(rootJ, "model", json_integer(getModel()));
+		json_object_set_new(rootJ, "renderThreads", json_integer(renderThreads));
 		return rootJ;
 	}
 
@@ -283,28 +332,35 @@ struct Elements : Module {
 		if (modelJ) {
 			setModel(json_integer_value(modelJ));
 		}
+
+		json_t* renderThreadsJ = json_object_get(rootJ, "renderThreads");
+		if (renderThreadsJ)
+			setRenderThreads(json_integer_value(renderThreadsJ));
 	}
 
 	int getModel() {
 		// Use the first channel's Part as the reference model
-		if (parts[0]->easter_egg())
+		elements::Part* part = &partSlots.getAllocated(0)->part;
+		if (part->easter_egg())
 			return -1;
-		return (int) parts[0]->resonator_model();
+		return (int) part->resonator_model();
 	}
 
 	/** Sets the resonator model.
 	-1 means easter egg (Ominous voice)
+	Parts allocated later take the model of the first part.
 	*/
 	void setModel(int model) {
-		if (model < 0) {
-			for (int c = 0; c < 16; c++) {
-				parts[c]->set_easter_egg(true);
+		for (int c = 0; c < 16; c++) {
+			PartSlot* slot = partSlots.getAllocated(c);
+			if (!slot)
+				break;
+			if (model < 0) {
+				slot->part.set_easter_egg(true);
 			}
-		}
-		else {
-			for (int c = 0; c < 16; c++) {
-				parts[c]->set_easter_egg(false);
-				parts[c]->set_resonator_model((elements::ResonatorModel) model);
+			else {
+				slot->part.set_easter_egg(false);
+				slot->part.set_resonator_model((elements::ResonatorModel) model);
 			}
 		}
 	}
@@ -415,6 +471,15 @@ struct ElementsWidget : ModuleWidget {
 				[=]() {module->setModel(modelLabel.id);}
 			));
 		}
+
+		menu->addChild(new MenuSeparator);
+
+		menu->addChild(createIndexSubmenuItem("Render threads", {"1 (engine thread)", "2", "3", "4"},
+			[=]() {return module->renderThreads - 1;},
+			[=](size_t i) {module->setRenderThreads(i + 1);}
+		));
+
+		menu->addChild(createMenuLabel(string::f("Memory: %d KB for %d channels, %d bytes per channel", (int) (module->getMemorySize() / 1024), module->partSlots.getAllocatedCount(), (int) sizeof(Elements::PartSlot))));
 	}
 };
 
@@ -41,10 +41,18 @@ struct Frames : Module {
 		NUM_LIGHTS = FRAME_LIGHT + 3
 	};
 
+	/** The firmware stores 64 keyframes in flash, but the module can hold many more. */
+	static const uint16_t MAX_KEYFRAMES = 4096;
+
 	frames::Keyframer keyframer;
+	frames::Keyframe* keyframes;
 	frames::PolyLfo poly_lfo;
 	bool poly_lfo_mode = false;
 	uint16_t lastControls[4] = {};
+	/** Keyframer gains of each channel, updated only when the keyframer is reevaluated */
+	float keyframerGains[16][4] = {};
+	uint16_t lastTimestampMods[16] = {};
+	int keyframerChannels = 1;
 
 	dsp::SchmittTrigger addTrigger;
 	dsp::SchmittTrigger delTrigger;
@@ -75,14 +83,19 @@ struct Frames : Module {
 		configOutput(OUT4_OUTPUT, "Channel 4");
 		configOutput(FRAME_STEP_OUTPUT, "Frame step");
 
+		keyframes = new frames::Keyframe[MAX_KEYFRAMES];
 		memset(&keyframer, 0, sizeof(keyframer));
-		keyframer.Init();
+		keyframer.Init(keyframes, MAX_KEYFRAMES);
 		memset(&poly_lfo, 0, sizeof(poly_lfo));
 		poly_lfo.Init();
 
 		onReset();
 	}
 
+	~Frames() {
+		delete[] keyframes;
+	}
+
 	void process(const ProcessArgs& args) override {
 		// Set gain and timestamp knobs
 		uint16_t controls[4];
@@ -90,10 +103,16 @@ struct Frames : Module {
 			controls[i] = params[GAIN1_PARAM + i].getValue() * 65535.0;
 		}
 
+		// The poly LFO has a single phase, but each channel of the frame input evaluates the keyframes separately.
+		int channels = poly_lfo_mode ? 1 : std::max(inputs[FRAME_INPUT].getChannels(), 1);
+
 		int32_t timestamp = params[FRAME_PARAM].getValue() * 65535.0;
-		int32_t timestampMod = timestamp + params[MODULATION_PARAM].getValue() * inputs[FRAME_INPUT].getVoltage() / 10.0 * 65535.0;
+		uint16_t timestampMods[16];
+		for (int c = 0; c < channels; c++) {
+			int32_t timestampMod = timestamp + params[MODULATION_PARAM].getValue() * inputs[FRAME_INPUT].getPolyVoltage(c) / 10.0 * 65535.0;
+			timestampMods[c] = clamp(timestampMod, 0, 65535);
+		}
 		timestamp = clamp(timestamp, 0, 65535);
-		timestampMod = clamp(timestampMod, 0, 65535);
 		int16_t nearestIndex = -1;
 		if (!poly_lfo_mode) {
 			nearestIndex = keyframer.FindNearestKeyframe(timestamp, 2048);
@@ -109,7 +128,7 @@ struct Frames : Module {
 				poly_lfo.set_spread(controls[2]);
 			if (controls[3] != lastControls[3])
 				poly_lfo.set_coupling(controls[3]);
-			poly_lfo.Render(timestampMod);
+			poly_lfo.Render(timestampMods[0]);
 		}
 		else {
 			for (int i = 0; i < 4; i++) {
@@ -136,25 +155,47 @@ struct Frames : Module {
 					keyframer.RemoveKeyframe(nearestTimestamp);
 				}
 			}
-			keyframer.Evaluate(timestampMod);
+
+			// The first channel also drives the lights.
+			// Skipped when neither the frame nor the keyframes have changed
+			bool changed = keyframer.Evaluate(timestampMods[0]);
+			if (changed) {
+				for (int i = 0; i < 4; i++) {
+					keyframerGains[0][i] = computeGain(i, keyframer.level(i) / 65535.0);
+				}
+			}
+
+			// Other channels are evaluated together, and only if one of them has moved
+			if (channels > 1) {
+				changed = changed || (channels != keyframerChannels);
+				for (int c = 1; c < channels; c++) {
+					changed = changed || (timestampMods[c] != lastTimestampMods[c]);
+				}
+				if (changed) {
+					uint16_t levels[16][4];
+					keyframer.EvaluateLevels(&timestampMods[1], levels[1], channels - 1);
+					for (int c = 1; c < channels; c++) {
+						for (int i = 0; i < 4; i++) {
+							keyframerGains[c][i] = computeGain(i, levels[c][i] / 65535.0);
+						}
+						lastTimestampMods[c] = timestampMods[c];
+					}
+				}
+			}
+			keyframerChannels = channels;
 		}
 
 		// Get gains
-		float gains[4];
+		float gains[16][4];
 		for (int i = 0; i < 4; i++) {
 			if (poly_lfo_mode) {
-				// gains[i] = poly_lfo.level(i) / 255.0;
-				gains[i] = poly_lfo.level(i) / 65535.0;
+				// gains[0][i] = poly_lfo.level(i) / 255.0;
+				gains[0][i] = computeGain(i, poly_lfo.level(i) / 65535.0);
 			}
 			else {
-				float lin = keyframer.level(i) / 65535.0;
-				gains[i] = lin;
-			}
-			// Simulate SSM2164
-			if (keyframer.mutable_settings(i)->response > 0) {
-				const float expBase = 200.0;
-				float expGain = rescale(powf(expBase, gains[i]), 1.0f, expBase, 0.0f, 1.0f);
-				gains[i] = crossfade(gains[i], expGain, keyframer.mutable_settings(i)->response / 255.0f);
+				for (int c = 0; c < channels; c++) {
+					gains[c][i] = keyframerGains[c][i];
+				}
 			}
 		}
 
@@ -164,33 +205,34 @@ struct Frames : Module {
 		}
 
 		// Get inputs
-		float all = ((int)params[OFFSET_PARAM].getValue() == 1) ? 10.0 : 0.0;
-		if (inputs[ALL_INPUT].isConnected()) {
-			all = inputs[ALL_INPUT].getVoltage();
-		}
+		float offset = ((int)params[OFFSET_PARAM].getValue() == 1) ? 10.0 : 0.0;
+		float mix[16] = {};
+		for (int c = 0; c < channels; c++) {
+			float all = offset;
+			if (inputs[ALL_INPUT].isConnected()) {
+				all = inputs[ALL_INPUT].getPolyVoltage(c);
+			}
 
-		float ins[4];
-		for (int i = 0; i < 4; i++) {
-			ins[i] = inputs[IN1_INPUT + i].getNormalVoltage(all) * gains[i];
+			for (int i = 0; i < 4; i++) {
+				float in = inputs[IN1_INPUT + i].getNormalPolyVoltage(all, c) * gains[c][i];
+				// Set outputs
+				if (outputs[OUT1_OUTPUT + i].isConnected()) {
+					outputs[OUT1_OUTPUT + i].setVoltage(in, c);
+				}
+				else {
+					mix[c] += in;
+				}
+			}
+			outputs[MIX_OUTPUT].setVoltage(clamp(mix[c] / 2.0, -10.0f, 10.0f), c);
 		}
-
-		// Set outputs
-		float mix = 0.0;
-
 		for (int i = 0; i < 4; i++) {
-			if (outputs[OUT1_OUTPUT + i].isConnected()) {
-				outputs[OUT1_OUTPUT + i].setVoltage(ins[i]);
-			}
-			else {
-				mix += ins[i];
-			}
+			outputs[OUT1_OUTPUT + i].setChannels(channels);
 		}
-
-		outputs[MIX_OUTPUT].setVoltage(clamp(mix / 2.0, -10.0f, 10.0f));
+		outputs[MIX_OUTPUT].setChannels(channels);
 
 		// Set lights
 		for (int i = 0; i < 4; i++) {
-			lights[GAIN1_LIGHT + i].setBrightness(gains[i]);
+			lights[GAIN1_LIGHT + i].setBrightness(gains[0][i]);
 		}
 
 		if (poly_lfo_mode) {
@@ -215,6 +257,18 @@ struct Frames : Module {
 		}
 	}
 
+	float computeGain(int i, float lin) {
+		float gain = lin;
+		// Simulate SSM2164
+		uint8_t response = keyframer.settings(i).response;
+		if (response > 0) {
+			const float expBase = 200.0;
+			float expGain = rescale(powf(expBase, gain), 1.0f, expBase, 0.0f, 1.0f);
+			gain = crossfade(gain, expGain, response / 255.0f);
+		}
+		return gain;
+	}
+
 	json_t* dataToJson() override {
 		json_t* rootJ = json_object();
 		json_object_set_new(rootJ, "polyLfo", json_boolean(poly_lfo_mode));
@@ -222,10 +276,10 @@ struct Frames : Module {
 		json_t* keyframesJ = json_array();
 		for (int i = 0; i < keyframer.num_keyframes(); i++) {
 			json_t* keyframeJ = json_array();
-			frames::Keyframe* keyframe = keyframer.mutable_keyframe(i);
-			json_array_append_new(keyframeJ, json_integer(keyframe->timestamp));
+			const frames::Keyframe& keyframe = keyframer.keyframe(i);
+			json_array_append_new(keyframeJ, json_integer(keyframe.timestamp));
 			for (int k = 0; k < 4; k++) {
-				json_array_append_new(keyframeJ, json_integer(keyframe->values[k]));
+				json_array_append_new(keyframeJ, json_integer(keyframe.values[k]));
 			}
 			json_array_append_new(keyframesJ, keyframeJ);
 		}
@@ -234,8 +288,8 @@ struct Frames : Module {
 		json_t* channelsJ = json_array();
 		for (int i = 0; i < 4; i++) {
 			json_t* channelJ = json_object();
-			json_object_set_new(channelJ, "curve", json_integer((int) keyframer.mutable_settings(i)->easing_curve));
-			json_object_set_new(channelJ, "response", json_integer(keyframer.mutable_settings(i)->response));
+			json_object_set_new(channelJ, "curve", json_integer((int) keyframer.settings(i).easing_curve));
+			json_object_set_new(channelJ, "response", json_integer(keyframer.settings(i).response));
 			json_array_append_new(channelsJ, channelJ);
 		}
 		json_object_set_new(rootJ, "channels", channelsJ);
@@ -269,10 +323,10 @@ struct Frames : Module {
 				if (channelJ) {
 					json_t* curveJ = json_object_get(channelJ, "curve");
 					if (curveJ)
-						keyframer.mutable_settings(i)->easing_curve = (frames::EasingCurve) json_integer_value(curveJ);
+						keyframer.set_easing_curve(i, (frames::EasingCurve) json_integer_value(curveJ));
 					json_t* responseJ = json_object_get(channelJ, "response");
 					if (responseJ)
-						keyframer.mutable_settings(i)->response = json_integer_value(responseJ);
+						keyframer.set_response(i, json_integer_value(responseJ));
 				}
 			}
 		}
@@ -282,8 +336,8 @@ struct Frames : Module {
 		poly_lfo_mode = false;
 		keyframer.Clear();
 		for (int i = 0; i < 4; i++) {
-			keyframer.mutable_settings(i)->easing_curve = frames::EASING_CURVE_LINEAR;
-			keyframer.mutable_settings(i)->response = 0;
+			keyframer.set_easing_curve(i, frames::EASING_CURVE_LINEAR);
+			keyframer.set_response(i, 0);
 		}
 	}
 	void onRandomize() override {
@@ -367,8 +421,8 @@ struct FramesWidget : ModuleWidget {
 					};
 					for (int i = 0; i < (int) curveLabels.size(); i++) {
 						menu->addChild(createCheckMenuItem(curveLabels[i], "",
-							[=]() {return module->keyframer.mutable_settings(c)->easing_curve == i;},
-							[=]() {module->keyframer.mutable_settings(c)->easing_curve = (frames::EasingCurve) i;}
+							[=]() {return module->keyframer.settings(c).easing_curve == i;},
+							[=]() {module->keyframer.set_easing_curve(c, (frames::EasingCurve) i);}
 						));
 					}
 
@@ -377,12 +431,12 @@ struct FramesWidget : ModuleWidget {
 					menu->addChild(createMenuLabel("Response curve"));
 
 					menu->addChild(createCheckMenuItem("Linear", "",
-						[=]() {return module->keyframer.mutable_settings(c)->response == 0;},
-						[=]() {module->keyframer.mutable_settings(c)->response = 0;}
+						[=]() {return module->keyframer.settings(c).response == 0;},
+						[=]() {module->keyframer.set_response(c, 0);}
 					));
 					menu->addChild(createCheckMenuItem("Exponential", "",
-						[=]() {return module->keyframer.mutable_settings(c)->response == 255;},
-						[=]() {module->keyframer.mutable_settings(c)->response = 255;}
+						[=]() {return module->keyframer.settings(c).response == 255;},
+						[=]() {module->keyframer.set_response(c, 255);}
 					));
 				}
 			));
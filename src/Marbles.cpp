@@ -4,12 +4,18 @@
 #include "marbles/random/t_generator.h"
 #include "marbles/random/x_y_generator.h"
 #include "marbles/note_filter.h"
+#include "marbles/scale_recorder.h"
+#include "Marbles/output_lanes.hpp"
 
 
 static const int BLOCK_SIZE = 5;
+static const int MAX_X_CHANNELS = 16;
 
 
-static const marbles::Scale preset_scales[6] = {
+static const int NUM_SCALES = 6;
+
+
+static const marbles::Scale preset_scales[NUM_SCALES] = {
 	// C major
 	{
 		1.0f,
@@ -191,6 +197,11 @@ struct Marbles : Module {
 	marbles::TGenerator t_generator;
 	marbles::XYGenerator xy_generator;
 	marbles::NoteFilter note_filter;
+	marbles::ScaleRecorder scale_recorder;
+	// The polyphonic X₁ lanes draw from their own stream, so they don't change the sequences of the other outputs
+	marbles::RandomGenerator x_lanes_random_generator;
+	marbles::RandomStream x_lanes_random_stream;
+	marbles::OutputLanes x_lanes[MAX_X_CHANNELS / 4];
 
 	// State
 	dsp::BooleanTrigger tDejaVuTrigger;
@@ -210,6 +221,14 @@ struct Marbles : Module {
 	int x_scale;
 	int y_divider_index;
 	int x_clock_source_internal;
+	int x_channels;
+	/** Scales of the quantizer, either presets or learned with the scale recorder */
+	marbles::Scale scales[NUM_SCALES];
+	/** Set from the UI thread, applied by the engine thread */
+	bool record_scale = false;
+	bool recording_scale = false;
+	bool reset_scale = false;
+	float record_blink_phase = 0.f;
 
 	// Buffers
 	stmlib::GateFlags t_clocks[BLOCK_SIZE] = {};
@@ -221,6 +240,7 @@ struct Marbles : Module {
 	float ramp_slave[2][BLOCK_SIZE] = {};
 	bool gates[BLOCK_SIZE * 2] = {};
 	float voltages[BLOCK_SIZE * 4] = {};
+	simd::float_4 x_lane_voltages[BLOCK_SIZE][MAX_X_CHANNELS / 4] = {};
 	int blockIndex = 0;
 
 	Marbles() {
@@ -262,8 +282,14 @@ struct Marbles : Module {
 		random_generator.Init(1);
 		random_stream.Init(&random_generator);
 		note_filter.Init();
-		onSampleRateChange();
+		scale_recorder.Init();
+		x_lanes_random_generator.Init(2);
+		x_lanes_random_stream.Init(&x_lanes_random_generator);
+		for (int i = 0; i < MAX_X_CHANNELS / 4; i++) {
+			x_lanes[i].Init(&x_lanes_random_stream);
+		}
 		onReset();
+		onSampleRateChange();
 	}
 
 	void onReset() override {
@@ -277,6 +303,12 @@ struct Marbles : Module {
 		x_scale = 0;
 		y_divider_index = 8;
 		x_clock_source_internal = 0;
+		x_channels = 1;
+
+		for (int i = 0; i < NUM_SCALES; i++) {
+			scales[i] = preset_scales[i];
+			loadScale(i);
+		}
 	}
 
 	void onRandomize() override {
@@ -292,8 +324,16 @@ struct Marbles : Module {
 		xy_generator.Init(&random_stream, sampleRate);
 
 		// Set scales
-		for (int i = 0; i < 6; i++) {
-			xy_generator.LoadScale(i, preset_scales[i]);
+		for (int i = 0; i < NUM_SCALES; i++) {
+			loadScale(i);
+		}
+	}
+
+	/** Compiles scale `i` into the quantizers of all X channels. */
+	void loadScale(int i) {
+		xy_generator.LoadScale(i, scales[i]);
+		for (int j = 0; j < MAX_X_CHANNELS / 4; j++) {
+			x_lanes[j].LoadScale(i, scales[i]);
 		}
 	}
 
@@ -310,6 +350,24 @@ struct Marbles : Module {
 		json_object_set_new(rootJ, "x_scale", json_integer(x_scale));
 		json_object_set_new(rootJ, "y_divider_index", json_integer(y_divider_index));
 		json_object_set_new(rootJ, "x_clock_source_internal", json_integer(x_clock_source_internal));
+		json_object_set_new(rootJ, "x_channels", json_integer(x_channels));
+
+		json_t* scalesJ = json_array();
+		for (int i = 0; i < NUM_SCALES; i++) {
+			const marbles::Scale& scale = scales[i];
+			json_t* scaleJ = json_object();
+			json_object_set_new(scaleJ, "base_interval", json_real(scale.base_interval));
+			json_t* degreesJ = json_array();
+			for (int j = 0; j < scale.num_degrees; j++) {
+				json_t* degreeJ = json_object();
+				json_object_set_new(degreeJ, "voltage", json_real(scale.degree[j].voltage));
+				json_object_set_new(degreeJ, "weight", json_integer(scale.degree[j].weight));
+				json_array_append_new(degreesJ, degreeJ);
+			}
+			json_object_set_new(scaleJ, "degrees", degreesJ);
+			json_array_append_new(scalesJ, scaleJ);
+		}
+		json_object_set_new(rootJ, "scales", scalesJ);
 
 		return rootJ;
 	}
@@ -354,6 +412,37 @@ struct Marbles : Module {
 		json_t* x_clock_source_internalJ = json_object_get(rootJ, "x_clock_source_internal");
 		if (x_clock_source_internalJ)
 			x_clock_source_internal = json_integer_value(x_clock_source_internalJ);
+
+		json_t* x_channelsJ = json_object_get(rootJ, "x_channels");
+		if (x_channelsJ)
+			x_channels = clamp((int) json_integer_value(x_channelsJ), 1, MAX_X_CHANNELS);
+
+		json_t* scalesJ = json_object_get(rootJ, "scales");
+		if (scalesJ) {
+			for (int i = 0; i < NUM_SCALES; i++) {
+				json_t* scaleJ = json_array_get(scalesJ, i);
+				if (!scaleJ)
+					break;
+				json_t* base_intervalJ = json_object_get(scaleJ, "base_interval");
+				json_t* degreesJ = json_object_get(scaleJ, "degrees");
+				int num_degrees = json_array_size(degreesJ);
+				if (!base_intervalJ || num_degrees < 1 || num_degrees > marbles::kMaxDegrees)
+					continue;
+				float base_interval = json_number_value(base_intervalJ);
+				if (!(base_interval > 0.f))
+					continue;
+
+				marbles::Scale& scale = scales[i];
+				scale.base_interval = base_interval;
+				scale.num_degrees = num_degrees;
+				for (int j = 0; j < num_degrees; j++) {
+					json_t* degreeJ = json_array_get(degreesJ, j);
+					scale.degree[j].voltage = json_number_value(json_object_get(degreeJ, "voltage"));
+					scale.degree[j].weight = clamp((int) json_integer_value(json_object_get(degreeJ, "weight")), 0, 255);
+				}
+				loadScale(i);
+			}
+		}
 	}
 
 	void process(const ProcessArgs& args) override {
@@ -413,7 +502,15 @@ struct Marbles : Module {
 		lights[X_RANGE_LIGHTS + 0].setBrightness(x_range == 0 || x_range == 1);
 		lights[X_RANGE_LIGHTS + 1].setBrightness(x_range == 1 || x_range == 2);
 
-		lights[EXTERNAL_LIGHT].setBrightness(external);
+		if (recording_scale) {
+			record_blink_phase += 2.f * args.sampleTime;
+			if (record_blink_phase >= 1.f)
+				record_blink_phase -= 1.f;
+			lights[EXTERNAL_LIGHT].setBrightness(record_blink_phase < 0.5f);
+		}
+		else {
+			lights[EXTERNAL_LIGHT].setBrightness(external);
+		}
 
 		outputs[T1_OUTPUT].setVoltage(gates[blockIndex * 2 + 0] ? 10.f : 0.f);
 		lights[T1_LIGHT].setSmoothBrightness(gates[blockIndex * 2 + 0], args.sampleTime);
@@ -422,8 +519,17 @@ struct Marbles : Module {
 		outputs[T3_OUTPUT].setVoltage(gates[blockIndex * 2 + 1] ? 10.f : 0.f);
 		lights[T3_LIGHT].setSmoothBrightness(gates[blockIndex * 2 + 1], args.sampleTime);
 
-		outputs[X1_OUTPUT].setVoltage(voltages[blockIndex * 4 + 0]);
-		lights[X1_LIGHT].setSmoothBrightness(voltages[blockIndex * 4 + 0], args.sampleTime);
+		if (x_channels > 1) {
+			outputs[X1_OUTPUT].setChannels(x_channels);
+			for (int c = 0; c < x_channels; c += 4) {
+				outputs[X1_OUTPUT].setVoltageSimd(x_lane_voltages[blockIndex][c / 4], c);
+			}
+		}
+		else {
+			outputs[X1_OUTPUT].setChannels(1);
+			outputs[X1_OUTPUT].setVoltage(voltages[blockIndex * 4 + 0]);
+		}
+		lights[X1_LIGHT].setSmoothBrightness(outputs[X1_OUTPUT].getVoltage(), args.sampleTime);
 		outputs[X2_OUTPUT].setVoltage(voltages[blockIndex * 4 + 1]);
 		lights[X2_LIGHT].setSmoothBrightness(voltages[blockIndex * 4 + 1], args.sampleTime);
 		outputs[X3_OUTPUT].setVoltage(voltages[blockIndex * 4 + 2]);
@@ -475,6 +581,21 @@ struct Marbles : Module {
 
 		t_generator.Process(t_external_clock, t_clocks, ramps, gates, BLOCK_SIZE);
 
+		// Scale recorder
+
+		if (reset_scale) {
+			reset_scale = false;
+			scales[x_scale] = preset_scales[x_scale];
+			loadScale(x_scale);
+		}
+		if (record_scale != recording_scale) {
+			if (record_scale)
+				scale_recorder.Clear();
+			else if (scale_recorder.ExtractScale(&scales[x_scale]))
+				loadScale(x_scale);
+			recording_scale = record_scale;
+		}
+
 		// Set up XYGenerator
 
 		marbles::ClockSource x_clock_source = (marbles::ClockSource) x_clock_source_internal;
@@ -490,6 +611,29 @@ struct Marbles : Module {
 		x.register_mode = external;
 		x.register_value = u;
 
+		if (recording_scale) {
+			// Like the hardware, learn the notes held on the X spread input while the X clock gate is high, and pass them through to the X and Y outputs
+			float voltage = inputs[X_SPREAD_INPUT].getVoltage();
+			for (int i = 0; i < BLOCK_SIZE; i++) {
+				stmlib::GateFlags gate = xy_clocks[i];
+				if (gate & stmlib::GATE_FLAG_RISING)
+					scale_recorder.NewNote(voltage);
+				if (gate & stmlib::GATE_FLAG_HIGH)
+					scale_recorder.UpdateVoltage(voltage);
+				if (gate & stmlib::GATE_FLAG_FALLING)
+					scale_recorder.AcceptNote();
+			}
+			for (int i = 0; i < BLOCK_SIZE; i++) {
+				for (int j = 0; j < 4; j++) {
+					voltages[i * 4 + j] = voltage;
+				}
+				for (int j = 0; j < MAX_X_CHANNELS / 4; j++) {
+					x_lane_voltages[i][j] = voltage;
+				}
+			}
+			return;
+		}
+
 		float x_spread = clamp(params[X_SPREAD_PARAM].getValue() + inputs[X_SPREAD_INPUT].getVoltage() / 5.f, 0.f, 1.f);
 		x.spread = x_spread;
 		float x_bias = clamp(params[X_BIAS_PARAM].getValue() + inputs[X_BIAS_INPUT].getVoltage() / 5.f, 0.f, 1.f);
@@ -532,6 +676,51 @@ struct Marbles : Module {
 		y.scale_index = x_scale;
 
 		xy_generator.Process(x_clock_source, x, y, xy_clocks, ramps, voltages, BLOCK_SIZE);
+
+		if (x_channels > 1)
+			stepXLanes(x_clock_source, x);
+	}
+
+	/** Renders the channels of the polyphonic X₁ output, four at a time.
+	Each channel has its own random sequence and follows X₁'s clock. The X mode spreads the bias, spread, and steps settings across all channels like it does across X₁, X₂, and X₃.
+	*/
+	void stepXLanes(marbles::ClockSource clock_source, const marbles::GroupSettings& x) {
+		// XYGenerator::Process() has already extracted the external clock ramp into ramp_slave[0]
+		const float* ramp = ramp_slave[0];
+		if (clock_source == marbles::CLOCK_SOURCE_INTERNAL_T2)
+			ramp = ramp_master;
+		else if (clock_source == marbles::CLOCK_SOURCE_INTERNAL_T3)
+			ramp = ramp_slave[1];
+
+		marbles::ScaleOffset scale_offset(10.f, -5.f);
+		if (x.voltage_range == marbles::VOLTAGE_RANGE_NARROW)
+			scale_offset = marbles::ScaleOffset(2.f, 0.f);
+		else if (x.voltage_range == marbles::VOLTAGE_RANGE_POSITIVE)
+			scale_offset = marbles::ScaleOffset(5.f, 0.f);
+
+		for (int c = 0; c < x_channels; c += 4) {
+			// Lanes past the last channel repeat its settings
+			simd::float_4 amount = 1.f;
+			if (x.control_mode != marbles::CONTROL_MODE_IDENTICAL) {
+				simd::float_4 i = simd::float_4(c, c + 1, c + 2, c + 3);
+				simd::float_4 t = 2.f * simd::fmin(i, x_channels - 1) / (x_channels - 1) - 1.f;
+				// With 3 channels, both modes give the amounts of X₁, X₂, and X₃
+				amount = (x.control_mode == marbles::CONTROL_MODE_TILT) ? t : 1.f - 2.f * simd::fabs(t);
+			}
+
+			marbles::OutputLanes& lanes = x_lanes[c / 4];
+			lanes.set_scale_offset(scale_offset);
+			lanes.set_spread(0.5f + (x.spread - 0.5f) * amount);
+			lanes.set_bias(0.5f + (x.bias - 0.5f) * amount);
+			lanes.set_steps(0.5f + (x.steps - 0.5f) * (x.register_mode ? 1.f : amount));
+			lanes.set_scale_index(x.scale_index);
+			lanes.set_register_mode(x.register_mode);
+			lanes.set_register_value(x.register_value);
+			lanes.set_register_transposition(4.f * x.spread * (x.bias - 0.5f) * amount);
+			lanes.set_deja_vu(x.deja_vu);
+			lanes.set_length(x.length);
+			lanes.Process(ramp, &x_lane_voltages[0][c / 4], BLOCK_SIZE, MAX_X_CHANNELS / 4);
+		}
 	}
 };
 
@@ -646,6 +835,15 @@ struct MarblesWidget : ModuleWidget {
 			"Raag Shri",
 		}, &module->x_scale));
 
+		menu->addChild(createBoolMenuItem("Record scale from X spread input and X clock gate", "",
+			[=]() {return module->record_scale;},
+			[=](bool val) {module->record_scale = val;}
+		));
+
+		menu->addChild(createMenuItem("Reset scale", "",
+			[=]() {module->reset_scale = true;}
+		));
+
 		menu->addChild(createIndexPtrSubmenuItem("Internal X clock source", {
 			"T₁ → X₁, T₂ → X₂, T₃ → X₃",
 			"T₁ → X₁, X₂, X₃",
@@ -653,6 +851,11 @@ struct MarblesWidget : ModuleWidget {
 			"T₃ → X₁, X₂, X₃",
 		}, &module->x_clock_source_internal));
 
+		menu->addChild(createIndexSubmenuItem("X₁ channels", {"1 (hardware)", "2", "3", "4", "5", "6", "7", "8", "9", "10", "11", "12", "13", "14", "15", "16"},
+			[=]() {return module->x_channels - 1;},
+			[=](size_t i) {module->x_channels = i + 1;}
+		));
+
 		menu->addChild(createIndexPtrSubmenuItem("Y divider ratio", {
 			"1/64",
 			"1/48",
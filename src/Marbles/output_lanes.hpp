@@ -0,0 +1,338 @@
+// Mutable Instruments Marbles X outputs, rendering four channels per pass.
+//
+// OutputLanes mirrors marbles::OutputChannel for four channels following the
+// same clock, each lane of a float_4 holding the state of one channel. Since
+// all lanes receive a new value on the same sample, the uniform draws of their
+// random sequences are shaped by the beta distribution tables in a single pass
+// of BetaDistributionSampleLanes(), and quantized one after the other. Between
+// clock edges, the glide of LagProcessor::Process() is computed for all lanes
+// at once, and skipped when every lane is quantized.
+
+#pragma once
+
+#include <rack.hpp>
+
+#include "marbles/random/distributions.h"
+#include "marbles/random/output_channel.h"
+#include "marbles/random/quantizer.h"
+#include "marbles/random/random_sequence.h"
+#include "marbles/resources.h"
+#include "stmlib/dsp/dsp.h"
+#include "stmlib/dsp/units.h"
+
+namespace marbles {
+
+typedef rack::simd::float_4 float_4;
+
+// BetaDistributionSample() of each lane. Table cells are gathered lane by
+// lane, the interpolation between them is done in SIMD.
+inline float_4 BetaDistributionSampleLanes(
+    float_4 uniform,
+    float_4 spread,
+    float_4 bias) {
+  const float_4 flip_result = bias > 0.5f;
+  uniform = rack::simd::ifelse(flip_result, 1.0f - uniform, uniform);
+  bias = rack::simd::ifelse(flip_result, 1.0f - bias, bias);
+
+  bias *= (static_cast<float>(kNumBiasValues) - 1.0f) * 2.0f;
+  spread *= (static_cast<float>(kNumRangeValues) - 1.0f);
+  const float_4 bias_integral = rack::simd::trunc(bias);
+  const float_4 bias_fractional = bias - bias_integral;
+  const float_4 spread_integral = rack::simd::trunc(spread);
+  const float_4 spread_fractional = spread - spread_integral;
+
+  // Lower 5% and 95% percentiles use a different table with higher resolution.
+  const float_4 low_tail = uniform <= 0.05f;
+  const float_4 high_tail = uniform >= 0.95f;
+  uniform = rack::simd::ifelse(low_tail, uniform * 20.0f,
+      rack::simd::ifelse(high_tail, (uniform - 0.95f) * 20.0f, uniform));
+
+  const float_4 index = uniform * kIcdfTableSize;
+  const float_4 index_integral = rack::simd::trunc(index);
+  const float_4 index_fractional = index - index_integral;
+
+  // Corners of the (spread, bias) cell: x1y1, x2y1, x1y2, x2y2.
+  const int low_bits = rack::simd::movemask(low_tail);
+  const int high_bits = rack::simd::movemask(high_tail);
+  float a[4][4];
+  float b[4][4];
+  for (int k = 0; k < 4; ++k) {
+    const size_t cell = static_cast<size_t>(bias_integral[k]) * \
+        (kNumRangeValues + 1) + static_cast<size_t>(spread_integral[k]);
+    size_t offset = 0;
+    if (low_bits & (1 << k)) {
+      offset = kIcdfTableSize + 1;
+    } else if (high_bits & (1 << k)) {
+      offset = 2 * (kIcdfTableSize + 1);
+    }
+    offset += static_cast<size_t>(index_integral[k]);
+    const size_t corners[4] = {
+      cell, cell + 1, cell + kNumRangeValues + 1, cell + kNumRangeValues + 2
+    };
+    for (int c = 0; c < 4; ++c) {
+      const float* table = distributions_table[corners[c]] + offset;
+      a[c][k] = table[0];
+      b[c][k] = table[1];
+    }
+  }
+
+  float_4 corner[4];
+  for (int c = 0; c < 4; ++c) {
+    const float_4 a_c = float_4::load(a[c]);
+    const float_4 b_c = float_4::load(b[c]);
+    corner[c] = a_c + (b_c - a_c) * index_fractional;
+  }
+
+  const float_4 y1 = corner[0] + (corner[1] - corner[0]) * spread_fractional;
+  const float_4 y2 = corner[2] + (corner[3] - corner[2]) * spread_fractional;
+  const float_4 y = y1 + (y2 - y1) * bias_fractional;
+  return rack::simd::ifelse(flip_result, 1.0f - y, y);
+}
+
+class OutputLanes {
+ public:
+  static const int kNumLanes = 4;
+  static const int kNumScales = 6;
+
+  void Init(RandomStream* random_stream) {
+    for (int i = 0; i < kNumLanes; ++i) {
+      random_sequence_[i].Init(random_stream);
+    }
+
+    spread_ = 0.5f;
+    bias_ = 0.5f;
+    steps_ = 0.5f;
+    scale_index_ = 0;
+
+    register_mode_ = false;
+    register_value_ = 0.0f;
+    register_transposition_ = 0.0f;
+
+    previous_steps_ = 0.0f;
+    previous_phase_ = 0.0f;
+    reacquisition_counter_ = 0;
+
+    voltage_ = 0.0f;
+    quantized_voltage_ = 0.0f;
+
+    scale_offset_ = ScaleOffset(10.0f, -5.0f);
+
+    ramp_start_ = 0.0f;
+    ramp_value_ = 0.0f;
+    lp_state_ = 0.0f;
+    lag_previous_phase_ = 0.0f;
+
+    Scale scale;
+    scale.Init();
+    for (int i = 0; i < kNumScales; ++i) {
+      LoadScale(i, scale);
+    }
+  }
+
+  void LoadScale(int i, const Scale& scale) {
+    for (int k = 0; k < kNumLanes; ++k) {
+      quantizer_[k][i].Init(scale);
+    }
+  }
+
+  // Same as OutputChannel::Process() on each lane, all lanes following the
+  // ramp in phase. Lane k of each sample is written to output[k].
+  void Process(
+      const float* phase,
+      float_4* output,
+      size_t size,
+      size_t stride) {
+    float_4 steps = previous_steps_;
+    const float_4 steps_increment = \
+        (steps_ - previous_steps_) / static_cast<float>(size);
+
+    // See OutputChannel::Process() for the reasons behind this.
+    if (reacquisition_counter_) {
+      --reacquisition_counter_;
+      float u[kNumLanes];
+      for (int k = 0; k < kNumLanes; ++k) {
+        u[k] = random_sequence_[k].RewriteValue(register_value_);
+      }
+      voltage_ = 10.0f * (float_4::load(u) - 0.5f) + register_transposition_;
+      quantized_voltage_ = Quantize(voltage_, 2.0f * steps_ - 1.0f);
+    }
+
+    while (size--) {
+      steps += steps_increment;
+      if (*phase < previous_phase_) {
+        voltage_ = GenerateNewVoltages();
+        ramp_start_ = ramp_value_;
+        quantized_voltage_ = Quantize(voltage_, 2.0f * steps - 1.0f);
+        if (register_mode_) {
+          reacquisition_counter_ = kNumReacquisitions;
+        }
+      }
+
+      const float_4 quantized = steps >= 0.5f;
+      if (rack::simd::movemask(quantized) == 0xf) {
+        *output = quantized_voltage_;
+      } else {
+        const float_4 smoothness = 1.0f - 2.0f * steps;
+        *output = rack::simd::ifelse(
+            quantized,
+            quantized_voltage_,
+            Lag(voltage_, smoothness, *phase, ~quantized));
+      }
+      output += stride;
+      previous_phase_ = *phase++;
+    }
+    previous_steps_ = steps;
+  }
+
+  inline void set_spread(float_4 spread) {
+    spread_ = spread;
+  }
+
+  inline void set_bias(float_4 bias) {
+    bias_ = bias;
+  }
+
+  inline void set_steps(float_4 steps) {
+    steps_ = steps;
+  }
+
+  inline void set_scale_index(int i) {
+    scale_index_ = i;
+  }
+
+  inline void set_register_mode(bool register_mode) {
+    register_mode_ = register_mode;
+  }
+
+  inline void set_register_value(float register_value) {
+    register_value_ = register_value;
+  }
+
+  inline void set_register_transposition(float_4 register_transposition) {
+    register_transposition_ = register_transposition;
+  }
+
+  inline void set_scale_offset(const ScaleOffset& scale_offset) {
+    scale_offset_ = scale_offset;
+  }
+
+  inline void set_deja_vu(float deja_vu) {
+    for (int k = 0; k < kNumLanes; ++k) {
+      random_sequence_[k].set_deja_vu(deja_vu);
+    }
+  }
+
+  inline void set_length(int length) {
+    for (int k = 0; k < kNumLanes; ++k) {
+      random_sequence_[k].set_length(length);
+    }
+  }
+
+ private:
+  static const uint32_t kNumReacquisitions = 20;
+
+  float_4 GenerateNewVoltages() {
+    float u[kNumLanes];
+    for (int k = 0; k < kNumLanes; ++k) {
+      u[k] = random_sequence_[k].NextValue(register_mode_, register_value_);
+    }
+    const float_4 uniform = float_4::load(u);
+
+    if (register_mode_) {
+      return 10.0f * (uniform - 0.5f) + register_transposition_;
+    }
+
+    const float_4 degenerate_amount = rack::simd::clamp(
+        1.25f - spread_ * 25.0f, 0.0f, 1.0f);
+    const float_4 bernoulli_amount = rack::simd::clamp(
+        spread_ * 25.0f - 23.75f, 0.0f, 1.0f);
+
+    float_4 value = BetaDistributionSampleLanes(uniform, spread_, bias_);
+    const float_4 bernoulli_value = rack::simd::ifelse(
+        uniform >= (1.0f - bias_), 0.999999f, 0.0f);
+
+    value += degenerate_amount * (bias_ - value);
+    value += bernoulli_amount * (bernoulli_value - value);
+    return value * scale_offset_.scale + scale_offset_.offset;
+  }
+
+  float_4 Quantize(float_4 voltage, float_4 amount) {
+    float quantized[kNumLanes];
+    for (int k = 0; k < kNumLanes; ++k) {
+      quantized[k] = quantizer_[k][scale_index_].Process(
+          voltage[k], amount[k], false);
+    }
+    return float_4::load(quantized);
+  }
+
+  // LagProcessor::Process() of the lanes selected by mask. The others keep
+  // their state, and their output is meaningless.
+  float_4 Lag(float_4 value, float_4 smoothness, float phase, float_4 mask) {
+    float_4 frequency = phase - lag_previous_phase_;
+    frequency = rack::simd::ifelse(frequency < 0.0f, frequency + 1.0f, frequency);
+    lag_previous_phase_ = rack::simd::ifelse(mask, phase, lag_previous_phase_);
+
+    const int bits = rack::simd::movemask(mask);
+    const float_4 semitones = 84.0f * (1.0f - smoothness);
+    float ratio[kNumLanes];
+    for (int k = 0; k < kNumLanes; ++k) {
+      ratio[k] = bits & (1 << k)
+          ? stmlib::SemitonesToRatio(semitones[k])
+          : 1.0f;
+    }
+    frequency *= 0.25f;
+    frequency *= float_4::load(ratio);
+    frequency = rack::simd::ifelse(frequency >= 1.0f, 1.0f, frequency);
+    frequency += rack::simd::ifelse(
+        smoothness <= 0.05f,
+        20.f * (0.05f - smoothness) * (1.0f - frequency),
+        0.0f);
+
+    lp_state_ += rack::simd::ifelse(
+        mask, frequency * (value - lp_state_), 0.0f);
+
+    const float_4 interp_amount = rack::simd::clamp(
+        (smoothness - 0.6f) * 5.0f, 0.0f, 1.0f);
+    const float_4 interp_linearity = rack::simd::clamp(
+        (1.0f - smoothness) * 5.0f, 0.0f, 1.0f);
+
+    // All lanes share the phase, so the warped phase is looked up once.
+    const float warped_phase = stmlib::Interpolate(
+        lut_raised_cosine, phase, 256.0f);
+    const float_4 interp_phase = \
+        warped_phase + (phase - warped_phase) * interp_linearity;
+    const float_4 interp = ramp_start_ + (value - ramp_start_) * interp_phase;
+    ramp_value_ = rack::simd::ifelse(mask, interp, ramp_value_);
+
+    return lp_state_ + (interp - lp_state_) * interp_amount;
+  }
+
+  RandomSequence random_sequence_[kNumLanes];
+  Quantizer quantizer_[kNumLanes][kNumScales];
+
+  float_4 spread_;
+  float_4 bias_;
+  float_4 steps_;
+  int scale_index_;
+
+  bool register_mode_;
+  float register_value_;
+  float_4 register_transposition_;
+
+  float_4 previous_steps_;
+  float previous_phase_;
+  uint32_t reacquisition_counter_;
+
+  float_4 voltage_;
+  float_4 quantized_voltage_;
+
+  ScaleOffset scale_offset_;
+
+  // LagProcessor state.
+  float_4 ramp_start_;
+  float_4 ramp_value_;
+  float_4 lp_state_;
+  float_4 lag_previous_phase_;
+};
+
+}  // namespace marbles
@@ -1,4 +1,6 @@
 #include "plugin.hpp"
+#include "WorkerPool.hpp"
+#include "SlotAllocator.hpp"
 
 #pragma GCC diagnostic push
 #ifndef __clang__
@@ -7,15 +9,19 @@
 #include "plaits/dsp/voice.h"
 //#include "plaits/user_data_receiver.h"
 #include "plaits/user_data.h"
+#include "Plaits/engine_batch.hpp"
 #include "stmlib/dsp/hysteresis_quantizer.h"
 #pragma GCC diagnostic pop
 
 #include <osdialog.h>
+#include <mutex>
 #include <thread>
 
 #include <fstream>
 #include <iterator>
 
+static const int BLOCK_SIZE = 12;
+
 static const char WAVE_FILTERS[] = "BIN (*.bin):bin, BIN";
 static std::string waveDir;
 
@@ -56,10 +62,25 @@ struct Plaits : Module {
 		NUM_LIGHTS
 	};
 
-	plaits::Voice voice[16];
+	/** A voice and the RAM shared by its engines, kept together in one allocation. */
+	struct VoiceSlot {
+		plaits::Voice voice;
+		char engineBuffer[16384];
+	};
+	/** Allocated off the engine thread the first time their channel is used. */
+	SlotAllocator<VoiceSlot> voiceSlots;
+	/** Voices picked up by the engine thread. */
+	plaits::Voice* voice[16] = {};
 	plaits::Patch patch = {};
-	plaits::UserData user_data;
-	char shared_buffer[16][16384] = {};
+	/** Custom data, double-buffered so it can be replaced from other threads while voices are rendering.
+	Voices read the front buffer. The back buffer is only written by writeUserData().
+	*/
+	plaits::UserData userData[2];
+	/** Bit 0: index of the front buffer. Bit 1: set when the back buffer holds new data the engine thread should switch to. */
+	std::atomic<int> userDataState{0};
+	/** Serializes writers of the back buffer. */
+	std::mutex userDataMutex;
+	std::thread loadThread;
 	float triPhase = 0.f;
 	int frequencyMode = 10;
 	stmlib::HysteresisQuantizer2 octaveQuantizer;
@@ -67,11 +88,36 @@ struct Plaits : Module {
 	dsp::SampleRateConverter<16 * 2> outputSrc;
 	dsp::DoubleRingBuffer<dsp::Frame<16 * 2>, 256> outputBuffer;
 	bool lowCpu = false;
+	/** Stops rendering voices whose LPG has closed until they are triggered again. */
+	bool skipIdleVoices = true;
+	/** Voices of the 6-operator FM engines whose release tails can overlap in each channel. */
+	int sixOpVoices = plaits::kNumSixOpVoices;
 
 	dsp::BooleanTrigger model1Trigger;
 	dsp::BooleanTrigger model2Trigger;
 
-	bool loading = false;
+	// Multi-threaded rendering
+	/** Number of threads rendering voices, including the engine thread. */
+	int renderThreads = 1;
+	/** Renders voices while the engine thread outputs the previous block. Adds one block of latency. */
+	bool renderLatency = false;
+	WorkerPool workerPool;
+	// Only written by the engine thread while no render jobs are in flight
+	plaits::Patch renderPatch = {};
+	plaits::Modulations renderModulations[16] = {};
+	plaits::Voice::Frame renderOutput[16][BLOCK_SIZE] = {};
+	int renderChannels = 0;
+	/** Whether the engine of each voice must be rendered this block, i.e. the voice is not idle. */
+	bool renderEngine[16] = {};
+	/** Voices rendered by one job. Voices sharing an engine supported by plaits::EngineBatch are rendered together. */
+	struct RenderJob {
+		int channels[plaits::EngineBatch::kMaxVoices];
+		int count;
+	};
+	RenderJob renderJobs[16] = {};
+	int renderJobCount = 0;
+	/** Whether a batch dispatched with render latency has not been collected yet. */
+	bool renderPending = false;
 
 	Plaits() {
 		config(NUM_PARAMS, NUM_INPUTS, NUM_OUTPUTS, NUM_LIGHTS);
@@ -100,16 +146,31 @@ struct Plaits : Module {
 		configOutput(OUT_OUTPUT, "Main");
 		configOutput(AUX_OUTPUT, "Auxiliary");
 
-		for (int i = 0; i < 16; i++) {
-			stmlib::BufferAllocator allocator(shared_buffer[i], sizeof(shared_buffer[i]));
-			voice[i].Init(&allocator, &user_data);
-		}
+		// Slots are value-initialized, so the engine RAM starts zeroed.
+		// Voice::Init() only stores the user data pointer, and the engine thread switches new voices to the front buffer when it picks them up.
+		voiceSlots.init([](void* context, VoiceSlot* slot, int index) {
+			Plaits* that = (Plaits*) context;
+			stmlib::BufferAllocator allocator(slot->engineBuffer, sizeof(slot->engineBuffer));
+			slot->voice.Init(&allocator, &that->userData[0]);
+		}, this);
 
 		octaveQuantizer.Init(9, 0.01f, false);
 
 		onReset();
 	}
 
+	~Plaits() {
+		if (loadThread.joinable())
+			loadThread.join();
+		// Wait for render jobs before freeing the voices they use
+		workerPool.setThreads(0);
+	}
+
+	/** Bytes used by the module, including its allocated voices. */
+	size_t getMemorySize() {
+		return sizeof(Plaits) + voiceSlots.getAllocatedCount() * sizeof(VoiceSlot);
+	}
+
 	void onReset() override {
 		patch.engine = 0;
 		patch.lpg_colour = 0.5f;
@@ -124,13 +185,23 @@ struct Plaits : Module {
 		json_t* rootJ = json_object();
 
 		json_object_set_new(rootJ, "lowCpu", json_boolean(lowCpu));
+		json_object_set_new(rootJ, "skipIdleVoices", json_boolean(skipIdleVoices));
+		json_object_set_new(rootJ, "sixOpVoices", json_integer(sixOpVoices));
 		json_object_set_new(rootJ, "model", json_integer(patch.engine));
 		json_object_set_new(rootJ, "frequencyMode", json_integer(frequencyMode));
-
-		const uint8_t* userDataBuffer = user_data.getBuffer();
-		if (userDataBuffer != nullptr) {
-			std::string userDataString = rack::string::toBase64(userDataBuffer, plaits::UserData::MAX_USER_DATA_SIZE);
-			json_object_set_new(rootJ, "userData", json_string(userDataString.c_str()));
+		json_object_set_new(rootJ, "renderThreads", json_integer(renderThreads));
+		json_object_set_new(rootJ, "renderLatency", json_boolean(renderLatency));
+
+		{
+			// Save the newest data, even if the engine thread hasn't switched to it yet
+			std::lock_guard<std::mutex> lock(userDataMutex);
+			int state = userDataState.load();
+			int index = (state & 2) ? 1 - (state & 1) : (state & 1);
+			const uint8_t* userDataBuffer = userData[index].getBuffer();
+			if (userDataBuffer != nullptr) {
+				std::string userDataString = rack::string::toBase64(userDataBuffer, plaits::UserData::MAX_USER_DATA_SIZE);
+				json_object_set_new(rootJ, "userData", json_string(userDataString.c_str()));
+			}
 		}
 
 		return rootJ;
@@ -141,6 +212,14 @@ struct Plaits : Module {
 		if (lowCpuJ)
 			lowCpu = json_boolean_value(lowCpuJ);
 
+		// Legacy <=1.5.0 patches rendered every voice
+		json_t* skipIdleVoicesJ = json_object_get(rootJ, "skipIdleVoices");
+		skipIdleVoices = skipIdleVoicesJ ? json_boolean_value(skipIdleVoicesJ) : false;
+
+		json_t* sixOpVoicesJ = json_object_get(rootJ, "sixOpVoices");
+		if (sixOpVoicesJ)
+			sixOpVoices = clamp((int) json_integer_value(sixOpVoicesJ), 1, plaits::kMaxSixOpVoices);
+
 		json_t* modelJ = json_object_get(rootJ, "model");
 		if (modelJ)
 			patch.engine = json_integer_value(modelJ);
@@ -149,13 +228,24 @@ struct Plaits : Module {
 		if (frequencyModeJ)
 			frequencyMode = json_integer_value(frequencyModeJ);
 
+		json_t* renderThreadsJ = json_object_get(rootJ, "renderThreads");
+		if (renderThreadsJ)
+			setRenderThreads(json_integer_value(renderThreadsJ));
+
+		json_t* renderLatencyJ = json_object_get(rootJ, "renderLatency");
+		if (renderLatencyJ)
+			renderLatency = json_boolean_value(renderLatencyJ);
+
 		json_t* userDataJ = json_object_get(rootJ, "userData");
 		if (userDataJ) {
 			std::string userDataString = json_string_value(userDataJ);
 			const std::vector<uint8_t> userDataVector = rack::string::fromBase64(userDataString);
-			if (userDataVector.size() > 0) {
+			if (userDataVector.size() >= plaits::UserData::MAX_USER_DATA_SIZE) {
 				const uint8_t* userDataBuffer = &userDataVector[0];
-				user_data.setBuffer(userDataBuffer);
+				writeUserData([&](plaits::UserData* data) {
+					data->setBuffer(userDataBuffer);
+					return true;
+				});
 			}
 		}
 
@@ -172,10 +262,15 @@ struct Plaits : Module {
 
 	void process(const ProcessArgs& args) override {
 		int channels = std::max(inputs[NOTE_INPUT].getChannels(), 1);
+		// New voices are picked up a few blocks after their channel first appears
+		int voiceCount = voiceSlots.size();
+		channels = voiceSlots.grow(channels);
+		for (int c = voiceCount; c < voiceSlots.size(); c++) {
+			voice[c] = &voiceSlots[c]->voice;
+			voice[c]->ReloadUserData(&userData[userDataState.load() & 1]);
+		}
 
 		if (outputBuffer.empty()) {
-			const int blockSize = 12;
-
 			// Model buttons
 			if (model1Trigger.process(params[MODEL1_PARAM].getValue())) {
 				if (patch.engine == 0) {
@@ -190,7 +285,7 @@ struct Plaits : Module {
 
 			// Model lights
 			// Pulse light at 2 Hz
-			triPhase += 2.f * args.sampleTime * blockSize;
+			triPhase += 2.f * args.sampleTime * BLOCK_SIZE;
 			if (triPhase >= 1.f)
 				triPhase -= 1.f;
 			float tri = (triPhase < 0.5f) ? triPhase * 2.f : (1.f - triPhase) * 2.f;
@@ -199,7 +294,7 @@ struct Plaits : Module {
 			bool activeLights[16] = {};
 			bool pulse = false;
 			for (int c = 0; c < channels; c++) {
-				int activeEngine = voice[c].active_engine();
+				int activeEngine = voice[c]->active_engine();
 				if (activeEngine < 8) {
 					activeLights[activeEngine] = true;
 					activeLights[activeEngine+8] = true;
@@ -249,51 +344,37 @@ struct Plaits : Module {
 			patch.timbre_modulation_amount = params[TIMBRE_CV_PARAM].getValue();
 			patch.morph_modulation_amount = params[MORPH_CV_PARAM].getValue();
 
-			// Render output buffer for each voice
-			dsp::Frame<16 * 2> outputFrames[blockSize];
-			for (int c = 0; c < channels; c++) {
-				// Construct modulations
-				plaits::Modulations modulations;
-				modulations.engine = inputs[ENGINE_INPUT].getPolyVoltage(c) / 5.f;
-				modulations.note = inputs[NOTE_INPUT].getVoltage(c) * 12.f;
-				modulations.frequency = inputs[FREQ_INPUT].getPolyVoltage(c) * 6.f;
-				modulations.harmonics = inputs[HARMONICS_INPUT].getPolyVoltage(c) / 5.f;
-				modulations.timbre = inputs[TIMBRE_INPUT].getPolyVoltage(c) / 8.f;
-				modulations.morph = inputs[MORPH_INPUT].getPolyVoltage(c) / 8.f;
-				// Triggers at around 0.7 V
-				modulations.trigger = inputs[TRIGGER_INPUT].getPolyVoltage(c) / 3.f;
-				modulations.level = inputs[LEVEL_INPUT].getPolyVoltage(c) / 8.f;
-
-				modulations.frequency_patched = inputs[FREQ_INPUT].isConnected();
-				modulations.timbre_patched = inputs[TIMBRE_INPUT].isConnected();
-				modulations.morph_patched = inputs[MORPH_INPUT].isConnected();
-				modulations.trigger_patched = inputs[TRIGGER_INPUT].isConnected();
-				modulations.level_patched = inputs[LEVEL_INPUT].isConnected();
-
-				// Render frames
-				plaits::Voice::Frame output[blockSize];
-				voice[c].Render(patch, modulations, output, blockSize);
-
-				// Convert output to frames
-				for (int i = 0; i < blockSize; i++) {
-					outputFrames[i].samples[c * 2 + 0] = output[i].out / 32768.f;
-					outputFrames[i].samples[c * 2 + 1] = output[i].aux / 32768.f;
-				}
+			// Collect voices dispatched during the previous block before preparing voices again.
+			// This also runs when render latency or worker threads have been switched off since, so the batch is never left in flight.
+			bool threaded = (workerPool.getThreads() > 0);
+			bool latency = threaded && renderLatency;
+			if (renderPending) {
+				workerPool.wait();
+				renderPending = false;
+				dsp::Frame<16 * 2> outputFrames[BLOCK_SIZE] = {};
+				convertRenderOutput(outputFrames);
+				pushOutput(outputFrames, channels, args.sampleRate);
 			}
 
-			// Convert output
-			if (lowCpu) {
-				int len = std::min((int) outputBuffer.capacity(), blockSize);
-				std::memcpy(outputBuffer.endData(), outputFrames, len * sizeof(outputFrames[0]));
-				outputBuffer.endIncr(len);
+			// Render output buffer for each voice
+			swapUserData();
+			prepareRender(channels);
+			if (latency) {
+				workerPool.dispatch(renderJob, this, renderJobCount);
+				renderPending = true;
 			}
 			else {
-				outputSrc.setRates(48000, (int) args.sampleRate);
-				int inLen = blockSize;
-				int outLen = outputBuffer.capacity();
-				outputSrc.setChannels(channels * 2);
-				outputSrc.process(outputFrames, &inLen, outputBuffer.endData(), &outLen);
-				outputBuffer.endIncr(outLen);
+				if (threaded) {
+					workerPool.run(renderJob, this, renderJobCount);
+				}
+				else {
+					for (int j = 0; j < renderJobCount; j++) {
+						renderVoices(j);
+					}
+				}
+				dsp::Frame<16 * 2> outputFrames[BLOCK_SIZE] = {};
+				convertRenderOutput(outputFrames);
+				pushOutput(outputFrames, channels, args.sampleRate);
 			}
 		}
 
@@ -310,36 +391,174 @@ struct Plaits : Module {
 		outputs[AUX_OUTPUT].setChannels(channels);
 	}
 
-	void reset() {
-			bool success = user_data.Save(nullptr, patch.engine);
-			if (success) {
-				for (int c = 0; c < 16; c++) {
-					voice[c].ReloadUserData();
+	/** Resamples a block of voice output into the output buffer. */
+	void pushOutput(dsp::Frame<16 * 2>* outputFrames, int channels, float sampleRate) {
+		if (lowCpu) {
+			int len = std::min((int) outputBuffer.capacity(), BLOCK_SIZE);
+			std::memcpy(outputBuffer.endData(), outputFrames, len * sizeof(outputFrames[0]));
+			outputBuffer.endIncr(len);
+		}
+		else {
+			outputSrc.setRates(48000, (int) sampleRate);
+			int inLen = BLOCK_SIZE;
+			int outLen = outputBuffer.capacity();
+			outputSrc.setChannels(channels * 2);
+			outputSrc.process(outputFrames, &inLen, outputBuffer.endData(), &outLen);
+			outputBuffer.endIncr(outLen);
+		}
+	}
+
+	/** Copies the patch and per-channel modulations, prepares each voice and groups voices into render jobs, so they can be rendered off the engine thread. */
+	void prepareRender(int channels) {
+		renderPatch = patch;
+		renderChannels = channels;
+		for (int c = 0; c < channels; c++) {
+			// Construct modulations
+			plaits::Modulations& modulations = renderModulations[c];
+			modulations.engine = inputs[ENGINE_INPUT].getPolyVoltage(c) / 5.f;
+			modulations.note = inputs[NOTE_INPUT].getVoltage(c) * 12.f;
+			modulations.frequency = inputs[FREQ_INPUT].getPolyVoltage(c) * 6.f;
+			modulations.harmonics = inputs[HARMONICS_INPUT].getPolyVoltage(c) / 5.f;
+			modulations.timbre = inputs[TIMBRE_INPUT].getPolyVoltage(c) / 8.f;
+			modulations.morph = inputs[MORPH_INPUT].getPolyVoltage(c) / 8.f;
+			// Triggers at around 0.7 V
+			modulations.trigger = inputs[TRIGGER_INPUT].getPolyVoltage(c) / 3.f;
+			modulations.level = inputs[LEVEL_INPUT].getPolyVoltage(c) / 8.f;
+
+			modulations.frequency_patched = inputs[FREQ_INPUT].isConnected();
+			modulations.timbre_patched = inputs[TIMBRE_INPUT].isConnected();
+			modulations.morph_patched = inputs[MORPH_INPUT].isConnected();
+			modulations.trigger_patched = inputs[TRIGGER_INPUT].isConnected();
+			modulations.level_patched = inputs[LEVEL_INPUT].isConnected();
+
+			voice[c]->set_idle_skipping(skipIdleVoices);
+			voice[c]->set_num_six_op_voices(sixOpVoices);
+			renderEngine[c] = voice[c]->Prepare(renderPatch, modulations);
+		}
+
+		// Batch voices using the same SIMD-capable engine, render all others alone
+		bool planned[16] = {};
+		renderJobCount = 0;
+		for (int c = 0; c < channels; c++) {
+			if (planned[c])
+				continue;
+			RenderJob& job = renderJobs[renderJobCount++];
+			job.channels[0] = c;
+			job.count = 1;
+			planned[c] = true;
+			int engine = voice[c]->active_engine();
+			if (!renderEngine[c] || !plaits::EngineBatch::Supports(engine))
+				continue;
+			for (int d = c + 1; d < channels && job.count < plaits::EngineBatch::kMaxVoices; d++) {
+				if (!planned[d] && renderEngine[d] && voice[d]->active_engine() == engine) {
+					job.channels[job.count++] = d;
+					planned[d] = true;
 				}
 			}
+		}
 	}
 
-	void load(const std::string& path) {
-		loading = true;
-		DEFER({loading = false;});
-		// HACK Sleep 100us so DSP thread is likely to finish processing before we resize the vector
-		std::this_thread::sleep_for(std::chrono::duration<double>(100e-6));
-
-		std::string ext = string::lowercase(system::getExtension(path));
-		
-		if (ext == ".bin") {
-			std::ifstream input(path, std::ios::binary);
-			std::vector<uint8_t> buffer(std::istreambuf_iterator<char>(input), {});
-			uint8_t* rx_buffer = buffer.data();
-			bool success = user_data.Save(rx_buffer, patch.engine);
-			if (success) {
-				for (int c = 0; c < 16; c++) {
-					voice[c].ReloadUserData();
-				}
+	int getActiveVoices() {
+		int activeVoices = 0;
+		for (int c = 0; c < renderChannels; c++) {
+			if (voice[c]->active())
+				activeVoices++;
+		}
+		return activeVoices;
+	}
+
+	void renderVoices(int j) {
+		const RenderJob& job = renderJobs[j];
+		if (job.count > 1) {
+			plaits::Voice* voices[plaits::EngineBatch::kMaxVoices];
+			for (int i = 0; i < job.count; i++) {
+				voices[i] = voice[job.channels[i]];
+			}
+			plaits::EngineBatch::RenderEngines(voices, job.count, BLOCK_SIZE);
+		}
+		else if (renderEngine[job.channels[0]]) {
+			voice[job.channels[0]]->RenderEngine(BLOCK_SIZE);
+		}
+		for (int i = 0; i < job.count; i++) {
+			int c = job.channels[i];
+			voice[c]->Finish(renderOutput[c], BLOCK_SIZE);
+		}
+	}
+
+	static void renderJob(void* context, int j) {
+		static_cast<Plaits*>(context)->renderVoices(j);
+	}
+
+	void convertRenderOutput(dsp::Frame<16 * 2>* outputFrames) {
+		for (int c = 0; c < renderChannels; c++) {
+			for (int i = 0; i < BLOCK_SIZE; i++) {
+				outputFrames[i].samples[c * 2 + 0] = renderOutput[c][i].out / 32768.f;
+				outputFrames[i].samples[c * 2 + 1] = renderOutput[c][i].aux / 32768.f;
 			}
 		}
 	}
 
+	void setRenderThreads(int threads) {
+		renderThreads = clamp(threads, 1, 4);
+		workerPool.setThreads(renderThreads - 1);
+	}
+
+	/** Writes custom data into the back buffer, which voices switch to at the start of the next block.
+	May be called from any thread except the engine thread.
+	If `write` returns false, the back buffer must be left untouched.
+	*/
+	bool writeUserData(std::function<bool(plaits::UserData*)> write) {
+		std::lock_guard<std::mutex> lock(userDataMutex);
+		// Take the back buffer back if the engine thread hasn't switched to it yet
+		int state = userDataState.load();
+		while (!userDataState.compare_exchange_weak(state, state & 1)) {}
+		bool success = write(&userData[1 - (state & 1)]);
+		if (success || (state & 2))
+			userDataState.fetch_or(2);
+		return success;
+	}
+
+	/** Switches voices to the back buffer if it holds new data. Must be called by the engine thread while no render jobs are in flight. */
+	void swapUserData() {
+		int state = userDataState.load();
+		if (!(state & 2))
+			return;
+		int front = 1 - (state & 1);
+		// Fails if a writer has just taken the back buffer back, in which case we'll switch on a later block.
+		if (!userDataState.compare_exchange_strong(state, front))
+			return;
+		for (int c = 0; c < voiceSlots.size(); c++) {
+			voice[c]->ReloadUserData(&userData[front]);
+		}
+	}
+
+	void reset() {
+		int slot = patch.engine;
+		writeUserData([&](plaits::UserData* data) {
+			return data->Save(nullptr, slot);
+		});
+	}
+
+	/** Reads and installs a custom data file on a background thread. */
+	void load(const std::string& path) {
+		int slot = patch.engine;
+		if (loadThread.joinable())
+			loadThread.join();
+		loadThread = std::thread([this, path, slot]() {
+			std::string ext = string::lowercase(system::getExtension(path));
+
+			if (ext == ".bin") {
+				std::ifstream input(path, std::ios::binary);
+				std::vector<uint8_t> buffer(std::istreambuf_iterator<char>(input), {});
+				// Short files would otherwise be read past their end
+				buffer.resize(plaits::UserData::MAX_USER_DATA_SIZE);
+				writeUserData([&](plaits::UserData* data) {
+					return data->Save(buffer.data(), slot);
+				});
+			}
+		});
+	}
+
 	void loadDialog() {
 		osdialog_filters* filters = osdialog_filters_parse(WAVE_FILTERS);
 		char* pathC = osdialog_file(OSDIALOG_OPEN, waveDir.empty() ? NULL : waveDir.c_str(), NULL, filters);
@@ -458,6 +677,31 @@ struct PlaitsWidget : ModuleWidget {
 
 		menu->addChild(createBoolPtrMenuItem("Low CPU (disable resampling)", "", &module->lowCpu));
 
+		menu->addChild(createIndexSubmenuItem("Render threads", {"1 (engine thread)", "2", "3", "4"},
+			[=]() {return module->renderThreads - 1;},
+			[=](size_t i) {module->setRenderThreads(i + 1);}
+		));
+
+		menu->addChild(createBoolPtrMenuItem("Render in background (+1 block latency)", "", &module->renderLatency));
+
+		menu->addChild(createBoolPtrMenuItem("Skip silent voices", "", &module->skipIdleVoices));
+
+		static const int sixOpVoices[] = {2, 4, 8};
+		menu->addChild(createIndexSubmenuItem("6-operator FM voices per channel", {"2 (hardware)", "4", "8"},
+			[=]() {
+				for (int i = 0; i < 3; i++) {
+					if (module->sixOpVoices == sixOpVoices[i])
+						return i;
+				}
+				return 0;
+			},
+			[=](size_t i) {module->sixOpVoices = sixOpVoices[i];}
+		));
+
+		menu->addChild(createMenuLabel(string::f("Sounding voices: %d of %d", module->getActiveVoices(), module->renderChannels)));
+
+		menu->addChild(createMenuLabel(string::f("Memory: %d KB for %d voices, %d bytes per voice", (int) (module->getMemorySize() / 1024), module->voiceSlots.getAllocatedCount(), (int) sizeof(Plaits::VoiceSlot))));
+
 		menu->addChild(createBoolMenuItem("Edit LPG response/decay", "",
 			[=]() {return this->getLpgMode();},
 			[=](bool val) {this->setLpgMode(val);}
@@ -0,0 +1,530 @@
+// Mutable Instruments Plaits engines, rendering up to four voices per pass.
+//
+// When several voices of the module use the virtual analog, waveshaping or
+// six-op FM engine, their oscillators are rendered together in the lanes of a
+// float_4.
+// The state of each voice's scalar oscillators is loaded before the block and
+// stored back after it, so voices can move in and out of a batch (or change
+// engine) at any block without a discontinuity. The output is the same as
+// rendering each voice with Voice::RenderEngine(), bit for bit unless the
+// compiler is allowed to reassociate floating point operations.
+
+#pragma once
+
+#include <rack.hpp>
+
+#include "plaits/dsp/voice.h"
+#include "Plaits/operator_lanes.hpp"
+#include "Plaits/oscillator_lanes.hpp"
+
+namespace plaits {
+
+class EngineBatch {
+ public:
+  static const int kMaxVoices = 4;
+
+  // Engine indices, as registered by Voice::Init().
+  static const int kFirstSixOpEngine = 2;
+  static const int kLastSixOpEngine = 4;
+  static const int kVirtualAnalogEngine = 8;
+  static const int kWaveshapingEngine = 9;
+
+  static bool Supports(int engine_index) {
+    return IsSixOp(engine_index) || \
+        engine_index == kVirtualAnalogEngine || \
+        engine_index == kWaveshapingEngine;
+  }
+
+  // Renders the engine of n prepared voices, which must all be using the same
+  // supported engine. Equivalent to calling RenderEngine() on each voice.
+  static void RenderEngines(Voice** voices, int n, size_t size) {
+    // Unused lanes duplicate the first voice and are never stored back.
+    Voice* lanes[kMaxVoices];
+    for (int i = 0; i < kMaxVoices; ++i) {
+      lanes[i] = voices[i < n ? i : 0];
+    }
+    if (IsSixOp(voices[0]->active_engine())) {
+      RenderSixOp(lanes, n, size);
+    } else if (voices[0]->active_engine() == kVirtualAnalogEngine) {
+      RenderVirtualAnalog(lanes, n, size);
+    } else {
+      RenderWaveshaping(lanes, n, size);
+    }
+  }
+
+ private:
+  static bool IsSixOp(int engine_index) {
+    return engine_index >= kFirstSixOpEngine && \
+        engine_index <= kLastSixOpEngine;
+  }
+
+  template<typename T>
+  static float_4 Load(T* const* objects, float T::*member) {
+    return float_4(
+        objects[0]->*member,
+        objects[1]->*member,
+        objects[2]->*member,
+        objects[3]->*member);
+  }
+
+  template<typename T>
+  static float_4 Load(T* const* objects, bool T::*member) {
+    return float_4(
+        objects[0]->*member ? 1.0f : 0.0f,
+        objects[1]->*member ? 1.0f : 0.0f,
+        objects[2]->*member ? 1.0f : 0.0f,
+        objects[3]->*member ? 1.0f : 0.0f) > 0.0f;
+  }
+
+  template<typename T>
+  static void Store(float_4 value, T* const* objects, float T::*member, int n) {
+    for (int i = 0; i < n; ++i) {
+      objects[i]->*member = value[i];
+    }
+  }
+
+  template<typename T>
+  static void Store(float_4 mask, T* const* objects, bool T::*member, int n) {
+    const int bits = rack::simd::movemask(mask);
+    for (int i = 0; i < n; ++i) {
+      objects[i]->*member = (bits >> i) & 1;
+    }
+  }
+
+  static void Load(SlopeOscillatorLanes* lanes, Oscillator* const* o) {
+    lanes->phase_ = Load(o, &Oscillator::phase_);
+    lanes->next_sample_ = Load(o, &Oscillator::next_sample_);
+    lanes->high_ = Load(o, &Oscillator::high_);
+    lanes->frequency_ = Load(o, &Oscillator::frequency_);
+    lanes->pw_ = Load(o, &Oscillator::pw_);
+  }
+
+  static void Store(
+      const SlopeOscillatorLanes& lanes, Oscillator* const* o, int n) {
+    Store(lanes.phase_, o, &Oscillator::phase_, n);
+    Store(lanes.next_sample_, o, &Oscillator::next_sample_, n);
+    Store(lanes.high_, o, &Oscillator::high_, n);
+    Store(lanes.frequency_, o, &Oscillator::frequency_, n);
+    Store(lanes.pw_, o, &Oscillator::pw_, n);
+  }
+
+  static void Load(
+      VariableShapeOscillatorLanes* lanes,
+      VariableShapeOscillator* const* o) {
+    typedef VariableShapeOscillator O;
+    lanes->master_phase_ = Load(o, &O::master_phase_);
+    lanes->slave_phase_ = Load(o, &O::slave_phase_);
+    lanes->next_sample_ = Load(o, &O::next_sample_);
+    lanes->previous_pw_ = Load(o, &O::previous_pw_);
+    lanes->high_ = Load(o, &O::high_);
+    lanes->master_frequency_ = Load(o, &O::master_frequency_);
+    lanes->slave_frequency_ = Load(o, &O::slave_frequency_);
+    lanes->pw_ = Load(o, &O::pw_);
+    lanes->waveshape_ = Load(o, &O::waveshape_);
+  }
+
+  static void Store(
+      const VariableShapeOscillatorLanes& lanes,
+      VariableShapeOscillator* const* o,
+      int n) {
+    typedef VariableShapeOscillator O;
+    Store(lanes.master_phase_, o, &O::master_phase_, n);
+    Store(lanes.slave_phase_, o, &O::slave_phase_, n);
+    Store(lanes.next_sample_, o, &O::next_sample_, n);
+    Store(lanes.previous_pw_, o, &O::previous_pw_, n);
+    Store(lanes.high_, o, &O::high_, n);
+    Store(lanes.master_frequency_, o, &O::master_frequency_, n);
+    Store(lanes.slave_frequency_, o, &O::slave_frequency_, n);
+    Store(lanes.pw_, o, &O::pw_, n);
+    Store(lanes.waveshape_, o, &O::waveshape_, n);
+  }
+
+  static void Load(
+      VariableSawOscillatorLanes* lanes,
+      VariableSawOscillator* const* o) {
+    typedef VariableSawOscillator O;
+    lanes->phase_ = Load(o, &O::phase_);
+    lanes->next_sample_ = Load(o, &O::next_sample_);
+    lanes->previous_pw_ = Load(o, &O::previous_pw_);
+    lanes->high_ = Load(o, &O::high_);
+    lanes->frequency_ = Load(o, &O::frequency_);
+    lanes->pw_ = Load(o, &O::pw_);
+    lanes->waveshape_ = Load(o, &O::waveshape_);
+  }
+
+  static void Store(
+      const VariableSawOscillatorLanes& lanes,
+      VariableSawOscillator* const* o,
+      int n) {
+    typedef VariableSawOscillator O;
+    Store(lanes.phase_, o, &O::phase_, n);
+    Store(lanes.next_sample_, o, &O::next_sample_, n);
+    Store(lanes.previous_pw_, o, &O::previous_pw_, n);
+    Store(lanes.high_, o, &O::high_, n);
+    Store(lanes.frequency_, o, &O::frequency_, n);
+    Store(lanes.pw_, o, &O::pw_, n);
+    Store(lanes.waveshape_, o, &O::waveshape_, n);
+  }
+
+  // VirtualAnalogEngine::Render(), VA_VARIANT 2.
+  static void RenderVirtualAnalog(Voice** voices, int n, size_t size) {
+    VirtualAnalogEngine* e[kMaxVoices];
+    VariableShapeOscillator* primary[kMaxVoices];
+    VariableShapeOscillator* auxiliary[kMaxVoices];
+    VariableShapeOscillator* sync[kMaxVoices];
+    VariableSawOscillator* variable_saw[kMaxVoices];
+
+    float primary_f[kMaxVoices];
+    float auxiliary_f[kMaxVoices];
+    float primary_sync_f[kMaxVoices];
+    float auxiliary_sync_f[kMaxVoices];
+    float shape[kMaxVoices];
+    float pw[kMaxVoices];
+    float square_pw[kMaxVoices];
+    float square_sync_f[kMaxVoices];
+    float saw_pw[kMaxVoices];
+    float saw_shape[kMaxVoices];
+    float square_gain[kMaxVoices];
+    float saw_gain[kMaxVoices];
+
+    for (int i = 0; i < kMaxVoices; ++i) {
+      e[i] = &voices[i]->virtual_analog_engine_;
+      primary[i] = &e[i]->primary_;
+      auxiliary[i] = &e[i]->auxiliary_;
+      sync[i] = &e[i]->sync_;
+      variable_saw[i] = &e[i]->variable_saw_;
+
+      const EngineParameters& parameters = voices[i]->pending_.parameters;
+      const float sync_amount = parameters.timbre * parameters.timbre;
+      const float auxiliary_detune = e[i]->ComputeDetuning(
+          parameters.harmonics);
+      primary_f[i] = NoteToFrequency(parameters.note);
+      auxiliary_f[i] = NoteToFrequency(parameters.note + auxiliary_detune);
+      primary_sync_f[i] = NoteToFrequency(
+          parameters.note + sync_amount * 48.0f);
+      auxiliary_sync_f[i] = NoteToFrequency(
+          parameters.note + auxiliary_detune + sync_amount * 48.0f);
+
+      shape[i] = parameters.morph * 1.5f;
+      CONSTRAIN(shape[i], 0.0f, 1.0f);
+
+      pw[i] = 0.5f + (parameters.morph - 0.66f) * 1.46f;
+      CONSTRAIN(pw[i], 0.5f, 0.995f);
+
+      square_pw[i] = 1.3f * parameters.timbre - 0.15f;
+      CONSTRAIN(square_pw[i], 0.005f, 0.5f);
+
+      const float square_sync_ratio = parameters.timbre < 0.5f
+          ? 0.0f
+          : (parameters.timbre - 0.5f) * (parameters.timbre - 0.5f) * 4.0f * \
+              48.0f;
+
+      const float square_gain_i = std::min(parameters.timbre * 8.0f, 1.0f);
+
+      saw_pw[i] = parameters.morph < 0.5f
+          ? parameters.morph + 0.5f
+          : 1.0f - (parameters.morph - 0.5f) * 2.0f;
+      saw_pw[i] *= 1.1f;
+      CONSTRAIN(saw_pw[i], 0.005f, 1.0f);
+
+      saw_shape[i] = 10.0f - 21.0f * parameters.morph;
+      CONSTRAIN(saw_shape[i], 0.0f, 1.0f);
+
+      float saw_gain_i = 8.0f * (1.0f - parameters.morph);
+      CONSTRAIN(saw_gain_i, 0.02f, 1.0f);
+
+      square_sync_f[i] = NoteToFrequency(parameters.note + square_sync_ratio);
+
+      const float norm = 1.0f / (std::max(square_gain_i, saw_gain_i));
+      square_gain[i] = square_gain_i * 0.3f * norm;
+      saw_gain[i] = saw_gain_i * 0.5f * norm;
+    }
+
+    VariableShapeOscillatorLanes primary_lanes;
+    VariableShapeOscillatorLanes auxiliary_lanes;
+    VariableShapeOscillatorLanes sync_lanes;
+    VariableSawOscillatorLanes variable_saw_lanes;
+    Load(&primary_lanes, primary);
+    Load(&auxiliary_lanes, auxiliary);
+    Load(&sync_lanes, sync);
+    Load(&variable_saw_lanes, variable_saw);
+    float_4 auxiliary_amount = Load(e, &VirtualAnalogEngine::auxiliary_amount_);
+    float_4 xmod_amount = Load(e, &VirtualAnalogEngine::xmod_amount_);
+
+    float_4 out[kMaxBlockSize];
+    float_4 aux[kMaxBlockSize];
+    float_4 temp[kMaxBlockSize];
+
+    // Render monster sync to AUX.
+    primary_lanes.Render(
+        float_4::load(primary_f),
+        float_4::load(primary_sync_f),
+        float_4::load(pw),
+        float_4::load(shape),
+        out,
+        size);
+    auxiliary_lanes.Render(
+        float_4::load(auxiliary_f),
+        float_4::load(auxiliary_sync_f),
+        float_4::load(pw),
+        float_4::load(shape),
+        aux,
+        size);
+    for (size_t i = 0; i < size; ++i) {
+      aux[i] = (aux[i] - out[i]) * 0.5f;
+    }
+
+    // Render double varishape to OUT.
+    sync_lanes.Render(
+        float_4::load(primary_f),
+        float_4::load(square_sync_f),
+        float_4::load(square_pw),
+        1.0f,
+        temp,
+        size);
+    variable_saw_lanes.Render(
+        float_4::load(auxiliary_f),
+        float_4::load(saw_pw),
+        float_4::load(saw_shape),
+        out,
+        size);
+    {
+      ParameterInterpolatorLanes square_gain_modulation(
+          &auxiliary_amount, float_4::load(square_gain), size);
+      ParameterInterpolatorLanes saw_gain_modulation(
+          &xmod_amount, float_4::load(saw_gain), size);
+      for (size_t i = 0; i < size; ++i) {
+        out[i] = out[i] * saw_gain_modulation.Next() + \
+            square_gain_modulation.Next() * temp[i];
+      }
+    }
+
+    Store(primary_lanes, primary, n);
+    Store(auxiliary_lanes, auxiliary, n);
+    Store(sync_lanes, sync, n);
+    Store(variable_saw_lanes, variable_saw, n);
+    Store(auxiliary_amount, e, &VirtualAnalogEngine::auxiliary_amount_, n);
+    Store(xmod_amount, e, &VirtualAnalogEngine::xmod_amount_, n);
+
+    Scatter(out, voices, n, size, true);
+    Scatter(aux, voices, n, size, false);
+  }
+
+  // WaveshapingEngine::Render(). Only the slope oscillators are rendered in
+  // lanes, the table lookups of the waveshaper stay scalar.
+  static void RenderWaveshaping(Voice** voices, int n, size_t size) {
+    WaveshapingEngine* e[kMaxVoices];
+    Oscillator* slope[kMaxVoices];
+    Oscillator* triangle[kMaxVoices];
+    float f0[kMaxVoices];
+    float pw[kMaxVoices];
+
+    for (int i = 0; i < kMaxVoices; ++i) {
+      e[i] = &voices[i]->waveshaping_engine_;
+      slope[i] = &e[i]->slope_;
+      triangle[i] = &e[i]->triangle_;
+
+      const EngineParameters& parameters = voices[i]->pending_.parameters;
+      f0[i] = NoteToFrequency(parameters.note);
+      pw[i] = parameters.morph * 0.45f + 0.5f;
+    }
+
+    SlopeOscillatorLanes slope_lanes;
+    SlopeOscillatorLanes triangle_lanes;
+    Load(&slope_lanes, slope);
+    Load(&triangle_lanes, triangle);
+
+    float_4 out[kMaxBlockSize];
+    float_4 aux[kMaxBlockSize];
+    slope_lanes.Render(float_4::load(f0), float_4::load(pw), out, size);
+    triangle_lanes.Render(float_4::load(f0), 0.5f, aux, size);
+
+    Store(slope_lanes, slope, n);
+    Store(triangle_lanes, triangle, n);
+
+    Scatter(out, voices, n, size, true);
+    Scatter(aux, voices, n, size, false);
+    for (int i = 0; i < n; ++i) {
+      e[i]->Shape(
+          voices[i]->pending_.parameters,
+          voices[i]->out_buffer_,
+          voices[i]->aux_buffer_,
+          size);
+    }
+  }
+
+  // SixOpEngine::Render(). Voice allocation and envelopes stay scalar. Each
+  // engine renders one of its staggered voices per block, and the operators
+  // of those voices are computed together when they share an algorithm.
+  static void RenderSixOp(Voice** voices, int n, size_t size) {
+    SixOpEngine* e[kMaxVoices];
+    fm::Voice<6>* fm_voice[kMaxVoices];
+    float f[kMaxVoices][6];
+    float a[kMaxVoices][6];
+
+    for (int i = 0; i < n; ++i) {
+      e[i] = &voices[i]->six_op_engine_;
+      e[i]->UpdateVoices(voices[i]->pending_.parameters, size);
+      e[i]->BeginStaggeredRender(size);
+
+      // FMVoice::Render() and the first half of fm::Voice<6>::Render().
+      FMVoice* v = &e[i]->voice_[e[i]->rendered_voice_];
+      const bool render = v->patch_ && \
+          v->voice_.ComputeFrequenciesAndAmplitudes(
+              v->parameters_,
+              size * e[i]->num_voices_,
+              f[i],
+              a[i]);
+      fm_voice[i] = render ? &v->voice_ : NULL;
+    }
+
+    bool rendered[kMaxVoices] = { };
+    for (int i = 0; i < n; ++i) {
+      if (!fm_voice[i] || rendered[i]) {
+        continue;
+      }
+      int lanes[kMaxVoices];
+      int m = 0;
+      for (int j = i; j < n; ++j) {
+        if (fm_voice[j] && !rendered[j] && \
+            fm_voice[j]->patch_->algorithm == fm_voice[i]->patch_->algorithm && \
+            e[j]->num_voices_ == e[i]->num_voices_) {
+          lanes[m++] = j;
+          rendered[j] = true;
+        }
+      }
+      const size_t staggered_size = size * e[i]->num_voices_;
+      if (m == 1) {
+        float* temp = e[i]->temp_buffer_;
+        float* buffers[4] = {
+          temp,
+          temp + staggered_size,
+          temp + 2 * staggered_size,
+          temp + 2 * staggered_size
+        };
+        fm_voice[i]->RenderAlgorithm(f[i], a[i], buffers, staggered_size);
+        continue;
+      }
+
+      // Unused lanes duplicate the first voice and are never stored back.
+      fm::Voice<6>* v[kMaxVoices];
+      const float* lane_f[kMaxVoices];
+      const float* lane_a[kMaxVoices];
+      float* temp[kMaxVoices];
+      for (int k = 0; k < kMaxVoices; ++k) {
+        const int j = lanes[k < m ? k : 0];
+        v[k] = fm_voice[j];
+        lane_f[k] = f[j];
+        lane_a[k] = a[j];
+        temp[k] = e[j]->temp_buffer_;
+      }
+      RenderAlgorithmLanes(v, lane_f, lane_a, temp, m, staggered_size);
+    }
+
+    for (int i = 0; i < n; ++i) {
+      e[i]->EndStaggeredRender(
+          voices[i]->out_buffer_,
+          voices[i]->aux_buffer_,
+          size);
+    }
+  }
+
+  // Second half of fm::Voice<6>::Render(), for voices sharing an algorithm.
+  // Only the first of the voice's buffers is accumulated into, the others are
+  // always written by an operator before being read.
+  static void RenderAlgorithmLanes(
+      fm::Voice<6>* const* v,
+      const float* const* f,
+      const float* const* a,
+      float* const* temp,
+      int n,
+      size_t size) {
+    fm::OperatorLanes ops[6];
+    float_4 lane_f[6];
+    float_4 lane_a[6];
+    for (int i = 0; i < 6; ++i) {
+      ops[i].phase = _mm_setr_epi32(
+          v[0]->operator_[i].phase,
+          v[1]->operator_[i].phase,
+          v[2]->operator_[i].phase,
+          v[3]->operator_[i].phase);
+      ops[i].amplitude = float_4(
+          v[0]->operator_[i].amplitude,
+          v[1]->operator_[i].amplitude,
+          v[2]->operator_[i].amplitude,
+          v[3]->operator_[i].amplitude);
+      lane_f[i] = float_4(f[0][i], f[1][i], f[2][i], f[3][i]);
+      lane_a[i] = float_4(a[0][i], a[1][i], a[2][i], a[3][i]);
+    }
+
+    float_4 fb_state[2];
+    float fb_scale[kMaxVoices];
+    for (int i = 0; i < 2; ++i) {
+      fb_state[i] = float_4(
+          v[0]->feedback_state_[i],
+          v[1]->feedback_state_[i],
+          v[2]->feedback_state_[i],
+          v[3]->feedback_state_[i]);
+    }
+    for (int k = 0; k < kMaxVoices; ++k) {
+      const int fb_amount = v[k]->patch_->feedback;
+      fb_scale[k] = fb_amount ? float(1 << fb_amount) / 512.0f : 0.0f;
+    }
+
+    float_4 buffer[3][kMaxBlockSize * kMaxSixOpVoices];
+    for (size_t j = 0; j < size; ++j) {
+      buffer[0][j] = float_4(temp[0][j], temp[1][j], temp[2][j], temp[3][j]);
+    }
+    float_4* buffers[4] = { buffer[0], buffer[1], buffer[2], buffer[2] };
+
+    const fm::Algorithms<6>* algorithms = v[0]->algorithms_;
+    const int algorithm = v[0]->patch_->algorithm;
+    for (int i = 0; i < 6; ) {
+      const fm::Algorithms<6>::RenderCall& call = algorithms->render_call(
+          algorithm, i);
+      fm::RenderLanesFn render_fn = fm::GetLanesRenderer(
+          call.n, call.modulation_source, call.additive);
+      (*render_fn)(
+          &ops[i],
+          &lane_f[i],
+          &lane_a[i],
+          fb_state,
+          float_4::load(fb_scale),
+          buffers[call.input_index],
+          buffers[call.output_index],
+          size);
+      i += call.n;
+    }
+
+    alignas(16) uint32_t phase[kMaxVoices];
+    for (int i = 0; i < 6; ++i) {
+      _mm_store_si128((__m128i*) phase, ops[i].phase);
+      for (int k = 0; k < n; ++k) {
+        v[k]->operator_[i].phase = phase[k];
+        v[k]->operator_[i].amplitude = ops[i].amplitude[k];
+      }
+    }
+    for (int k = 0; k < n; ++k) {
+      v[k]->feedback_state_[0] = fb_state[0][k];
+      v[k]->feedback_state_[1] = fb_state[1][k];
+      for (size_t j = 0; j < size; ++j) {
+        temp[k][j] = buffer[0][j][k];
+      }
+    }
+  }
+
+  // Transposes lanes into the out or aux buffer of each voice.
+  static void Scatter(
+      const float_4* in, Voice** voices, int n, size_t size, bool to_out) {
+    for (int i = 0; i < n; ++i) {
+      float* destination = to_out
+          ? voices[i]->out_buffer_
+          : voices[i]->aux_buffer_;
+      for (size_t j = 0; j < size; ++j) {
+        destination[j] = in[j][i];
+      }
+    }
+  }
+};
+
+}  // namespace plaits
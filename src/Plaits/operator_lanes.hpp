@@ -0,0 +1,186 @@
+// Mutable Instruments Plaits FM operators, rendering four voices per pass.
+//
+// RenderOperatorsLanes() mirrors plaits::fm::RenderOperators() sample for
+// sample, with each SIMD lane running the operators of one voice. The lanes
+// must be playing the same algorithm, but their patches may otherwise differ.
+// Phases are kept as 32-bit integers so that they wrap exactly like the scalar
+// code, and each lane looks up its own entries of the sine table.
+//
+// The state of each lane is loaded from and stored back to the voices' scalar
+// operators by plaits::EngineBatch around every block.
+
+#pragma once
+
+#include <rack.hpp>
+
+#include "plaits/dsp/fm/operator.h"
+#include "plaits/resources.h"
+
+namespace plaits {
+
+typedef rack::simd::float_4 float_4;
+
+namespace fm {
+
+struct OperatorLanes {
+  __m128i phase;
+  float_4 amplitude;
+};
+
+// static_cast<uint32_t>() of each lane, valid in [0, 2^32).
+inline __m128i TruncateToUint32(float_4 x) {
+  const float_4 half_range = 2147483648.0f;
+  const float_4 high = x >= half_range;
+  const __m128i truncated = _mm_cvttps_epi32((x - (high & half_range)).v);
+  return _mm_xor_si128(truncated, _mm_castps_si128((high & -0.0f).v));
+}
+
+// static_cast<float>() of each lane, read as an unsigned integer. Both halves
+// convert exactly, so the sum is rounded only once.
+inline float_4 ConvertFromUint32(__m128i x) {
+  const float_4 high = _mm_cvtepi32_ps(_mm_srli_epi32(x, 16));
+  const float_4 low = _mm_cvtepi32_ps(
+      _mm_and_si128(x, _mm_set1_epi32(0xffff)));
+  return high * 65536.0f + low;
+}
+
+// SinePM() of each lane.
+inline float_4 SinePMLanes(__m128i phase, float_4 pm) {
+  const float max_uint32 = 4294967296.0f;
+  const int max_index = 32;
+  const float offset = float(max_index);
+  const float scale = max_uint32 / float(max_index * 2);
+
+  // * max_index * 2
+  phase = _mm_add_epi32(
+      phase, _mm_slli_epi32(TruncateToUint32((pm + offset) * scale), 6));
+
+  alignas(16) uint32_t integral[4];
+  _mm_store_si128(
+      (__m128i*) integral, _mm_srli_epi32(phase, 32 - kSineLUTBits));
+  const float_4 fractional = ConvertFromUint32(
+      _mm_slli_epi32(phase, kSineLUTBits)) / max_uint32;
+
+  // Each lane reads its two neighbouring entries with a single load.
+  const __m128 ab_01 = _mm_loadh_pi(
+      _mm_loadl_pi(_mm_setzero_ps(), (const __m64*) &lut_sine[integral[0]]),
+      (const __m64*) &lut_sine[integral[1]]);
+  const __m128 ab_23 = _mm_loadh_pi(
+      _mm_loadl_pi(_mm_setzero_ps(), (const __m64*) &lut_sine[integral[2]]),
+      (const __m64*) &lut_sine[integral[3]]);
+  const float_4 a = _mm_shuffle_ps(ab_01, ab_23, _MM_SHUFFLE(2, 0, 2, 0));
+  const float_4 b = _mm_shuffle_ps(ab_01, ab_23, _MM_SHUFFLE(3, 1, 3, 1));
+  return a + (b - a) * fractional;
+}
+
+typedef void (*RenderLanesFn)(
+    OperatorLanes* ops,
+    const float_4* f,
+    const float_4* a,
+    float_4* fb_state,
+    float_4 fb_scale,
+    const float_4* modulation,
+    float_4* out,
+    size_t size);
+
+// The feedback amount of each lane is passed already scaled, since it comes
+// from a different patch.
+template<int n, int modulation_source, bool additive>
+void RenderOperatorsLanes(
+    OperatorLanes* ops,
+    const float_4* f,
+    const float_4* a,
+    float_4* fb_state,
+    float_4 fb_scale,
+    const float_4* modulation,
+    float_4* out,
+    size_t size) {
+  float_4 previous_0, previous_1;
+
+  if (modulation_source >= Operator::MODULATION_SOURCE_FEEDBACK) {
+    previous_0 = fb_state[0];
+    previous_1 = fb_state[1];
+  }
+
+  __m128i frequency[n];
+  __m128i phase[n];
+  float_4 amplitude[n];
+  float_4 amplitude_increment[n];
+
+  const float scale = 1.0f / float(size);
+  for (int i = 0; i < n; ++i) {
+    frequency[i] = TruncateToUint32(
+        rack::simd::fmin(f[i], 0.5f) * 4294967296.0f);
+    phase[i] = ops[i].phase;
+    amplitude[i] = ops[i].amplitude;
+    amplitude_increment[i] = \
+        (rack::simd::fmin(a[i], 4.0f) - amplitude[i]) * scale;
+  }
+
+  while (size--) {
+    float_4 pm = 0.0f;
+    if (modulation_source >= Operator::MODULATION_SOURCE_FEEDBACK) {
+      pm = (previous_0 + previous_1) * fb_scale;
+    } else if (modulation_source == Operator::MODULATION_SOURCE_EXTERNAL) {
+      pm = *modulation++;
+    }
+    for (int i = 0; i < n; ++i) {
+      phase[i] = _mm_add_epi32(phase[i], frequency[i]);
+      pm = SinePMLanes(phase[i], pm) * amplitude[i];
+      amplitude[i] += amplitude_increment[i];
+      if (i == modulation_source) {
+        previous_1 = previous_0;
+        previous_0 = pm;
+      }
+    }
+    if (additive) {
+      *out++ += pm;
+    } else {
+      *out++ = pm;
+    }
+  }
+
+  for (int i = 0; i < n; ++i) {
+    ops[i].phase = phase[i];
+    ops[i].amplitude = amplitude[i];
+  }
+
+  if (modulation_source >= Operator::MODULATION_SOURCE_FEEDBACK) {
+    fb_state[0] = previous_0;
+    fb_state[1] = previous_1;
+  }
+}
+
+// Lane counterpart of the renderers compiled by Algorithms<6>.
+inline RenderLanesFn GetLanesRenderer(
+    int n, int modulation_source, bool additive) {
+  struct RendererSpecs {
+    int n;
+    int modulation_source;
+    bool additive;
+    RenderLanesFn render_fn;
+  };
+  static const RendererSpecs renderers[] = {
+    { 1, -2, false, &RenderOperatorsLanes<1, -2, false> },
+    { 1, -2, true, &RenderOperatorsLanes<1, -2, true> },
+    { 1, -1, false, &RenderOperatorsLanes<1, -1, false> },
+    { 1, -1, true, &RenderOperatorsLanes<1, -1, true> },
+    { 1, 0, false, &RenderOperatorsLanes<1, 0, false> },
+    { 1, 0, true, &RenderOperatorsLanes<1, 0, true> },
+    { 3, 2, true, &RenderOperatorsLanes<3, 2, true> },
+    { 2, 1, true, &RenderOperatorsLanes<2, 1, true> },
+    { 0, 0, false, NULL }
+  };
+  for (const RendererSpecs* r = renderers; r->n; ++r) {
+    if (r->n == n && \
+        r->modulation_source == modulation_source && \
+        r->additive == additive) {
+      return r->render_fn;
+    }
+  }
+  return NULL;
+}
+
+}  // namespace fm
+
+}  // namespace plaits
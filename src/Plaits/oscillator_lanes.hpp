@@ -0,0 +1,417 @@
+// Mutable Instruments Plaits oscillators, rendering four voices per pass.
+//
+// These mirror plaits::Oscillator (slope shape), plaits::VariableShapeOscillator
+// (hard sync) and plaits::VariableSawOscillator sample for sample, with each
+// SIMD lane holding the state of one voice. Branches of the scalar code are
+// replaced by masks, so lanes whose discontinuities happen on different samples
+// can be rendered together.
+//
+// The state of each lane is loaded from and stored back to the voices' scalar
+// oscillators by plaits::EngineBatch around every block.
+
+#pragma once
+
+#include <rack.hpp>
+
+#include "plaits/dsp/oscillator/oscillator.h"
+
+namespace plaits {
+
+typedef rack::simd::float_4 float_4;
+
+inline float_4 ThisBlepSample(float_4 t) {
+  return 0.5f * t * t;
+}
+
+inline float_4 NextBlepSample(float_4 t) {
+  t = 1.0f - t;
+  return -0.5f * t * t;
+}
+
+inline float_4 NextIntegratedBlepSample(float_4 t) {
+  const float_4 t1 = 0.5f * t;
+  const float_4 t2 = t1 * t1;
+  const float_4 t4 = t2 * t2;
+  return 0.1875f - t1 + 1.5f * t2 - t4;
+}
+
+inline float_4 ThisIntegratedBlepSample(float_4 t) {
+  return NextIntegratedBlepSample(1.0f - t);
+}
+
+// Zeroes the lanes of x which are not selected by mask.
+inline float_4 Masked(float_4 mask, float_4 x) {
+  return x & mask;
+}
+
+// Discontinuities are rare, so the blep corrections are skipped altogether
+// when no lane needs them.
+inline bool Any(float_4 mask) {
+  return rack::simd::movemask(mask) != 0;
+}
+
+class ParameterInterpolatorLanes {
+ public:
+  ParameterInterpolatorLanes(float_4* state, float_4 new_value, size_t size) {
+    state_ = state;
+    value_ = *state;
+    increment_ = (new_value - *state) / static_cast<float>(size);
+  }
+
+  ~ParameterInterpolatorLanes() {
+    *state_ = value_;
+  }
+
+  inline float_4 Next() {
+    value_ += increment_;
+    return value_;
+  }
+
+ private:
+  float_4* state_;
+  float_4 value_;
+  float_4 increment_;
+};
+
+// plaits::Oscillator::Render<OSCILLATOR_SHAPE_SLOPE> without external FM.
+class SlopeOscillatorLanes {
+ public:
+  void Render(float_4 frequency, float_4 pw, float_4* out, size_t size) {
+    frequency = rack::simd::clamp(frequency, kMinFrequency, kMaxFrequency);
+    pw = rack::simd::clamp(pw, frequency * 2.0f, 1.0f - 2.0f * frequency);
+
+    ParameterInterpolatorLanes fm(&frequency_, frequency, size);
+    ParameterInterpolatorLanes pwm(&pw_, pw, size);
+
+    float_4 next_sample = next_sample_;
+
+    while (size--) {
+      float_4 this_sample = next_sample;
+      next_sample = 0.0f;
+
+      const float_4 frequency = fm.Next();
+      const float_4 pw = pwm.Next();
+      const float_4 slope_up = 1.0f / pw;
+      const float_4 slope_down = 1.0f / (1.0f - pw);
+      const float_4 discontinuity = (slope_up + slope_down) * frequency;
+      phase_ += frequency;
+
+      const float_4 low = phase_ < pw;
+      const float_4 transition = high_ ^ low;
+      if (Any(transition)) {
+        const float_4 t = (phase_ - pw) / frequency;
+        this_sample -= Masked(
+            transition, ThisIntegratedBlepSample(t) * discontinuity);
+        next_sample -= Masked(
+            transition, NextIntegratedBlepSample(t) * discontinuity);
+        high_ = rack::simd::ifelse(transition, low, high_);
+      }
+
+      const float_4 wrap = phase_ >= 1.0f;
+      if (Any(wrap)) {
+        phase_ = rack::simd::ifelse(wrap, phase_ - 1.0f, phase_);
+        const float_4 t = phase_ / frequency;
+        this_sample += Masked(
+            wrap, ThisIntegratedBlepSample(t) * discontinuity);
+        next_sample += Masked(
+            wrap, NextIntegratedBlepSample(t) * discontinuity);
+        high_ = high_ | wrap;
+      }
+
+      next_sample += rack::simd::ifelse(
+          high_,
+          phase_ * slope_up,
+          1.0f - (phase_ - pw) * slope_down);
+      *out++ = 2.0f * this_sample - 1.0f;
+    }
+    next_sample_ = next_sample;
+  }
+
+ private:
+  friend class EngineBatch;
+
+  float_4 phase_;
+  float_4 next_sample_;
+  float_4 high_;
+
+  float_4 frequency_;
+  float_4 pw_;
+};
+
+// plaits::VariableShapeOscillator::Render<true, false>, the hard-synced
+// variable waveshape used by the virtual analog engine.
+class VariableShapeOscillatorLanes {
+ public:
+  void Render(
+      float_4 master_frequency,
+      float_4 frequency,
+      float_4 pw,
+      float_4 waveshape,
+      float_4* out,
+      size_t size) {
+    master_frequency = rack::simd::fmin(master_frequency, kMaxFrequency);
+    frequency = rack::simd::fmin(frequency, kMaxFrequency);
+    pw = rack::simd::ifelse(
+        frequency >= 0.25f,
+        0.5f,
+        rack::simd::clamp(pw, frequency * 2.0f, 1.0f - 2.0f * frequency));
+
+    ParameterInterpolatorLanes master_fm(
+        &master_frequency_, master_frequency, size);
+    ParameterInterpolatorLanes fm(&slave_frequency_, frequency, size);
+    ParameterInterpolatorLanes pwm(&pw_, pw, size);
+    ParameterInterpolatorLanes waveshape_modulation(
+        &waveshape_, waveshape, size);
+
+    float_4 next_sample = next_sample_;
+
+    while (size--) {
+      float_4 this_sample = next_sample;
+      next_sample = 0.0f;
+
+      const float_4 master_frequency = master_fm.Next();
+      const float_4 slave_frequency = fm.Next();
+      const float_4 pw = pwm.Next();
+      const float_4 waveshape = waveshape_modulation.Next();
+
+      const float_4 square_amount = rack::simd::fmax(
+          waveshape - 0.5f, 0.0f) * 2.0f;
+      const float_4 triangle_amount = rack::simd::fmax(
+          1.0f - waveshape * 2.0f, 0.0f);
+
+      const float_4 slope_up = 1.0f / pw;
+      const float_4 slope_down = 1.0f / (1.0f - pw);
+      const float_4 triangle_step = (slope_up + slope_down) * \
+          slave_frequency * triangle_amount;
+
+      // Master oscillator and sync reset.
+      master_phase_ += master_frequency;
+      const float_4 reset = master_phase_ >= 1.0f;
+      const bool any_reset = Any(reset);
+      float_4 reset_time = 0.0f;
+      float_4 active = ~reset;
+      if (any_reset) {
+        master_phase_ = rack::simd::ifelse(
+            reset, master_phase_ - 1.0f, master_phase_);
+        reset_time = rack::simd::ifelse(
+            reset, master_phase_ / master_frequency, 0.0f);
+
+        float_4 slave_phase_at_reset = slave_phase_ + \
+            (1.0f - reset_time) * slave_frequency;
+        const float_4 wrap_at_reset = slave_phase_at_reset >= 1.0f;
+        slave_phase_at_reset = rack::simd::ifelse(
+            wrap_at_reset, slave_phase_at_reset - 1.0f, slave_phase_at_reset);
+        const float_4 transition_during_reset = reset & (wrap_at_reset | \
+            (~high_ & (slave_phase_at_reset >= pw)));
+        const float_4 value = ComputeNaiveSample(
+            slave_phase_at_reset,
+            pw,
+            slope_up,
+            slope_down,
+            triangle_amount,
+            square_amount);
+        this_sample -= Masked(reset, value * ThisBlepSample(reset_time));
+        next_sample -= Masked(reset, value * NextBlepSample(reset_time));
+        active = active | transition_during_reset;
+      }
+
+      // Transitions of the slave oscillator. The scalar code loops until no
+      // transition is left, which takes at most low -> high -> low -> high.
+      slave_phase_ += slave_frequency;
+
+      Rise(active & ~high_ & (slave_phase_ >= pw),
+          pw, slave_frequency, square_amount, triangle_step,
+          &this_sample, &next_sample);
+
+      const float_4 fall = active & high_ & (slave_phase_ >= 1.0f);
+      if (Any(fall)) {
+        slave_phase_ = rack::simd::ifelse(
+            fall, slave_phase_ - 1.0f, slave_phase_);
+        const float_4 t = slave_phase_ / slave_frequency;
+        this_sample -= Masked(
+            fall, (1.0f - triangle_amount) * ThisBlepSample(t));
+        next_sample -= Masked(
+            fall, (1.0f - triangle_amount) * NextBlepSample(t));
+        this_sample += Masked(
+            fall, triangle_step * ThisIntegratedBlepSample(t));
+        next_sample += Masked(
+            fall, triangle_step * NextIntegratedBlepSample(t));
+        high_ = ~fall & high_;
+
+        Rise(fall & (slave_phase_ >= pw),
+            pw, slave_frequency, square_amount, triangle_step,
+            &this_sample, &next_sample);
+      }
+
+      if (any_reset) {
+        slave_phase_ = rack::simd::ifelse(
+            reset, reset_time * slave_frequency, slave_phase_);
+        high_ = ~reset & high_;
+      }
+
+      next_sample += ComputeNaiveSample(
+          slave_phase_,
+          pw,
+          slope_up,
+          slope_down,
+          triangle_amount,
+          square_amount);
+      previous_pw_ = pw;
+
+      *out++ = (2.0f * this_sample - 1.0f);
+    }
+
+    next_sample_ = next_sample;
+  }
+
+ private:
+  friend class EngineBatch;
+
+  inline void Rise(
+      float_4 mask,
+      float_4 pw,
+      float_4 slave_frequency,
+      float_4 square_amount,
+      float_4 triangle_step,
+      float_4* this_sample,
+      float_4* next_sample) {
+    if (!Any(mask)) {
+      return;
+    }
+    const float_4 t = (slave_phase_ - pw) / \
+        (previous_pw_ - pw + slave_frequency);
+    *this_sample += Masked(mask, square_amount * ThisBlepSample(t));
+    *next_sample += Masked(mask, square_amount * NextBlepSample(t));
+    *this_sample -= Masked(mask, triangle_step * ThisIntegratedBlepSample(t));
+    *next_sample -= Masked(mask, triangle_step * NextIntegratedBlepSample(t));
+    high_ = high_ | mask;
+  }
+
+  inline float_4 ComputeNaiveSample(
+      float_4 phase,
+      float_4 pw,
+      float_4 slope_up,
+      float_4 slope_down,
+      float_4 triangle_amount,
+      float_4 square_amount) const {
+    const float_4 low = phase < pw;
+    float_4 saw = phase;
+    float_4 square = rack::simd::ifelse(low, 0.0f, 1.0f);
+    float_4 triangle = rack::simd::ifelse(
+        low,
+        phase * slope_up,
+        1.0f - (phase - pw) * slope_down);
+    saw += (square - saw) * square_amount;
+    saw += (triangle - saw) * triangle_amount;
+    return saw;
+  }
+
+  float_4 master_phase_;
+  float_4 slave_phase_;
+  float_4 next_sample_;
+  float_4 previous_pw_;
+  float_4 high_;
+
+  float_4 master_frequency_;
+  float_4 slave_frequency_;
+  float_4 pw_;
+  float_4 waveshape_;
+};
+
+// plaits::VariableSawOscillator.
+class VariableSawOscillatorLanes {
+ public:
+  void Render(
+      float_4 frequency,
+      float_4 pw,
+      float_4 waveshape,
+      float_4* out,
+      size_t size) {
+    frequency = rack::simd::fmin(frequency, kMaxFrequency);
+    pw = rack::simd::ifelse(
+        frequency >= 0.25f,
+        0.5f,
+        rack::simd::clamp(pw, frequency * 2.0f, 1.0f - 2.0f * frequency));
+
+    ParameterInterpolatorLanes fm(&frequency_, frequency, size);
+    ParameterInterpolatorLanes pwm(&pw_, pw, size);
+    ParameterInterpolatorLanes waveshape_modulation(
+        &waveshape_, waveshape, size);
+
+    float_4 next_sample = next_sample_;
+
+    while (size--) {
+      float_4 this_sample = next_sample;
+      next_sample = 0.0f;
+
+      const float_4 frequency = fm.Next();
+      const float_4 pw = pwm.Next();
+      const float_4 waveshape = waveshape_modulation.Next();
+      const float_4 triangle_amount = waveshape;
+      const float_4 notch_amount = 1.0f - waveshape;
+      const float_4 slope_up = 1.0f / pw;
+      const float_4 slope_down = 1.0f / (1.0f - pw);
+      const float_4 triangle_step = (slope_up + slope_down) * frequency * \
+          triangle_amount;
+
+      phase_ += frequency;
+
+      const float_4 rise = ~high_ & (phase_ >= pw);
+      const float_4 fall = ~rise & (phase_ >= 1.0f);
+
+      if (Any(rise)) {
+        const float_4 notch = (kVariableSawNotchDepth + 1.0f - pw) * \
+            notch_amount;
+        const float_4 t = (phase_ - pw) / (previous_pw_ - pw + frequency);
+        this_sample += Masked(rise, notch * ThisBlepSample(t));
+        next_sample += Masked(rise, notch * NextBlepSample(t));
+        this_sample -= Masked(
+            rise, triangle_step * ThisIntegratedBlepSample(t));
+        next_sample -= Masked(
+            rise, triangle_step * NextIntegratedBlepSample(t));
+        high_ = high_ | rise;
+      }
+
+      if (Any(fall)) {
+        phase_ = rack::simd::ifelse(fall, phase_ - 1.0f, phase_);
+        const float_4 notch = (kVariableSawNotchDepth + 1.0f) * notch_amount;
+        const float_4 t = phase_ / frequency;
+        this_sample -= Masked(fall, notch * ThisBlepSample(t));
+        next_sample -= Masked(fall, notch * NextBlepSample(t));
+        this_sample += Masked(
+            fall, triangle_step * ThisIntegratedBlepSample(t));
+        next_sample += Masked(
+            fall, triangle_step * NextIntegratedBlepSample(t));
+        high_ = ~fall & high_;
+      }
+
+      const float_4 low = phase_ < pw;
+      const float_4 notch_saw = rack::simd::ifelse(
+          low, phase_, 1.0f + kVariableSawNotchDepth);
+      const float_4 triangle = rack::simd::ifelse(
+          low,
+          phase_ * slope_up,
+          1.0f - (phase_ - pw) * slope_down);
+      next_sample += notch_saw * notch_amount + triangle * triangle_amount;
+      previous_pw_ = pw;
+
+      *out++ = (2.0f * this_sample - 1.0f) / (1.0f + kVariableSawNotchDepth);
+    }
+
+    next_sample_ = next_sample;
+  }
+
+ private:
+  friend class EngineBatch;
+
+  float_4 phase_;
+  float_4 next_sample_;
+  float_4 previous_pw_;
+  float_4 high_;
+
+  float_4 frequency_;
+  float_4 pw_;
+  float_4 waveshape_;
+};
+
+}  // namespace plaits
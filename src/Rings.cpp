@@ -1,4 +1,5 @@
 #include "plugin.hpp"
+#include "SlotAllocator.hpp"
 #include "rings/dsp/part.h"
 #include "rings/dsp/strummer.h"
 #include "rings/dsp/string_synth_part.h"
@@ -45,17 +46,22 @@ struct Rings : Module {
 		NUM_LIGHTS
 	};
 
-	dsp::SampleRateConverter<1> inputSrc;
-	dsp::SampleRateConverter<2> outputSrc;
-	dsp::DoubleRingBuffer<dsp::Frame<1>, 256> inputBuffer;
-	dsp::DoubleRingBuffer<dsp::Frame<2>, 256> outputBuffer;
-
-	uint16_t reverb_buffer[32768] = {};
-	rings::Part part;
-	rings::StringSynthPart string_synth;
-	rings::Strummer strummer;
-	bool strum = false;
-	bool lastStrum = false;
+	dsp::SampleRateConverter<16> inputSrc;
+	dsp::SampleRateConverter<16 * 2> outputSrc;
+	dsp::DoubleRingBuffer<dsp::Frame<16>, 256> inputBuffer;
+	dsp::DoubleRingBuffer<dsp::Frame<16 * 2>, 256> outputBuffer;
+
+	/** The voices of one polyphony channel and their shared reverb delay line, kept together in one allocation. */
+	struct PartSlot {
+		uint16_t reverbBuffer[32768];
+		rings::Part part;
+		rings::StringSynthPart stringSynth;
+		rings::Strummer strummer;
+	};
+	/** Allocated off the engine thread the first time their channel is used. */
+	SlotAllocator<PartSlot> partSlots;
+	bool strum[16] = {};
+	bool lastStrum[16] = {};
 
 	dsp::SchmittTrigger polyphonyTrigger;
 	dsp::SchmittTrigger modelTrigger;
@@ -93,23 +99,40 @@ struct Rings : Module {
 		configBypass(IN_INPUT, ODD_OUTPUT);
 		configBypass(IN_INPUT, EVEN_OUTPUT);
 
-		strummer.Init(0.01, 44100.0 / 24);
-		part.Init(reverb_buffer);
-		string_synth.Init(reverb_buffer);
+		// In the Mutable Instruments code, Part doesn't initialize itself, but SlotAllocator value-initializes the slots to zero them.
+		partSlots.init([](void* context, PartSlot* slot, int index) {
+			slot->strummer.Init(0.01, 44100.0 / 24);
+			slot->part.Init(slot->reverbBuffer);
+			slot->stringSynth.Init(slot->reverbBuffer);
+		}, this);
+	}
+
+	/** Bytes used by the module, including its allocated parts. */
+	size_t getMemorySize() {
+		return sizeof(Rings) + partSlots.getAllocatedCount() * sizeof(PartSlot);
 	}
 
 	void process(const ProcessArgs& args) override {
+		// Each channel of the pitch, strum, or audio input plays its own part
+		int channels = std::max({inputs[PITCH_INPUT].getChannels(), inputs[STRUM_INPUT].getChannels(), inputs[IN_INPUT].getChannels(), 1});
+		// New parts are picked up a few blocks after their channel first appears
+		channels = partSlots.grow(channels);
+
 		// TODO
 		// "Normalized to a pulse/burst generator that reacts to note changes on the V/OCT input."
 		// Get input
 		if (!inputBuffer.full()) {
-			dsp::Frame<1> f;
-			f.samples[0] = inputs[IN_INPUT].getVoltage() / 5.0;
+			dsp::Frame<16> f = {};
+			for (int c = 0; c < channels; c++) {
+				f.samples[c] = inputs[IN_INPUT].getPolyVoltage(c) / 5.0;
+			}
 			inputBuffer.push(f);
 		}
 
-		if (!strum) {
-			strum = inputs[STRUM_INPUT].getVoltage() >= 1.0;
+		for (int c = 0; c < channels; c++) {
+			if (!strum[c]) {
+				strum[c] = inputs[STRUM_INPUT].getPolyVoltage(c) >= 1.0;
+			}
 		}
 
 		// Polyphony / model
@@ -128,78 +151,96 @@ struct Rings : Module {
 
 		// Render frames
 		if (outputBuffer.empty()) {
-			float in[24] = {};
+			// in[channel][bufferIndex]
+			float in[16][24] = {};
 			// Convert input buffer
 			{
 				inputSrc.setRates(args.sampleRate, 48000);
+				inputSrc.setChannels(channels);
 				int inLen = inputBuffer.size();
 				int outLen = 24;
-				inputSrc.process(inputBuffer.startData(), &inLen, (dsp::Frame<1>*) in, &outLen);
+				dsp::Frame<16> inputFrames[24];
+				inputSrc.process(inputBuffer.startData(), &inLen, inputFrames, &outLen);
 				inputBuffer.startIncr(inLen);
-			}
 
-			// Polyphony
-			int polyphony = 1 << polyphonyMode;
-			if (part.polyphony() != polyphony)
-				part.set_polyphony(polyphony);
-			// Model
-			if (easterEgg)
-				string_synth.set_fx((rings::FxType) resonatorModel);
-			else
-				part.set_model(resonatorModel);
-
-			// Patch
-			rings::Patch patch;
-			float structure = params[STRUCTURE_PARAM].getValue() + 3.3 * dsp::quadraticBipolar(params[STRUCTURE_MOD_PARAM].getValue()) * inputs[STRUCTURE_MOD_INPUT].getVoltage() / 5.0;
-			patch.structure = clamp(structure, 0.0f, 0.9995f);
-			patch.brightness = clamp(params[BRIGHTNESS_PARAM].getValue() + 3.3 * dsp::quadraticBipolar(params[BRIGHTNESS_MOD_PARAM].getValue()) * inputs[BRIGHTNESS_MOD_INPUT].getVoltage() / 5.0, 0.0f, 1.0f);
-			patch.damping = clamp(params[DAMPING_PARAM].getValue() + 3.3 * dsp::quadraticBipolar(params[DAMPING_MOD_PARAM].getValue()) * inputs[DAMPING_MOD_INPUT].getVoltage() / 5.0, 0.0f, 0.9995f);
-			patch.position = clamp(params[POSITION_PARAM].getValue() + 3.3 * dsp::quadraticBipolar(params[POSITION_MOD_PARAM].getValue()) * inputs[POSITION_MOD_INPUT].getVoltage() / 5.0, 0.0f, 0.9995f);
-
-			// Performance
-			rings::PerformanceState performance_state;
-			performance_state.note = 12.0 * inputs[PITCH_INPUT].getNormalVoltage(1 / 12.0);
-			float transpose = params[FREQUENCY_PARAM].getValue();
-			// Quantize transpose if pitch input is connected
-			if (inputs[PITCH_INPUT].isConnected()) {
-				transpose = roundf(transpose);
-			}
-			performance_state.tonic = 12.0 + clamp(transpose, 0.0f, 60.0f);
-			performance_state.fm = clamp(48.0 * 3.3 * dsp::quarticBipolar(params[FREQUENCY_MOD_PARAM].getValue()) * inputs[FREQUENCY_MOD_INPUT].getNormalVoltage(1.0) / 5.0, -48.0f, 48.0f);
-
-			performance_state.internal_exciter = !inputs[IN_INPUT].isConnected();
-			performance_state.internal_strum = !inputs[STRUM_INPUT].isConnected();
-			performance_state.internal_note = !inputs[PITCH_INPUT].isConnected();
-
-			// TODO
-			// "Normalized to a step detector on the V/OCT input and a transient detector on the IN input."
-			performance_state.strum = strum && !lastStrum;
-			lastStrum = strum;
-			strum = false;
-
-			performance_state.chord = clamp((int) roundf(structure * (rings::kNumChords - 1)), 0, rings::kNumChords - 1);
-
-			// Process audio
-			float out[24];
-			float aux[24];
-			if (easterEgg) {
-				strummer.Process(NULL, 24, &performance_state);
-				string_synth.Process(performance_state, patch, in, out, aux, 24);
+				for (int c = 0; c < channels; c++) {
+					for (int i = 0; i < outLen; i++) {
+						in[c][i] = inputFrames[i].samples[c];
+					}
+				}
 			}
-			else {
-				strummer.Process(in, 24, &performance_state);
-				part.Process(performance_state, patch, in, out, aux, 24);
+
+			float out[16][24];
+			float aux[16][24];
+			for (int c = 0; c < channels; c++) {
+				rings::Part& part = partSlots[c]->part;
+				rings::StringSynthPart& stringSynth = partSlots[c]->stringSynth;
+				rings::Strummer& strummer = partSlots[c]->strummer;
+
+				// Polyphony
+				int polyphony = 1 << polyphonyMode;
+				if (part.polyphony() != polyphony)
+					part.set_polyphony(polyphony);
+				// Model
+				if (easterEgg)
+					stringSynth.set_fx((rings::FxType) resonatorModel);
+				else
+					part.set_model(resonatorModel);
+
+				// Patch
+				rings::Patch patch;
+				float structure = params[STRUCTURE_PARAM].getValue() + 3.3 * dsp::quadraticBipolar(params[STRUCTURE_MOD_PARAM].getValue()) * inputs[STRUCTURE_MOD_INPUT].getPolyVoltage(c) / 5.0;
+				patch.structure = clamp(structure, 0.0f, 0.9995f);
+				patch.brightness = clamp(params[BRIGHTNESS_PARAM].getValue() + 3.3 * dsp::quadraticBipolar(params[BRIGHTNESS_MOD_PARAM].getValue()) * inputs[BRIGHTNESS_MOD_INPUT].getPolyVoltage(c) / 5.0, 0.0f, 1.0f);
+				patch.damping = clamp(params[DAMPING_PARAM].getValue() + 3.3 * dsp::quadraticBipolar(params[DAMPING_MOD_PARAM].getValue()) * inputs[DAMPING_MOD_INPUT].getPolyVoltage(c) / 5.0, 0.0f, 0.9995f);
+				patch.position = clamp(params[POSITION_PARAM].getValue() + 3.3 * dsp::quadraticBipolar(params[POSITION_MOD_PARAM].getValue()) * inputs[POSITION_MOD_INPUT].getPolyVoltage(c) / 5.0, 0.0f, 0.9995f);
+
+				// Performance
+				rings::PerformanceState performance_state;
+				performance_state.note = 12.0 * inputs[PITCH_INPUT].getNormalPolyVoltage(1 / 12.0, c);
+				float transpose = params[FREQUENCY_PARAM].getValue();
+				// Quantize transpose if pitch input is connected
+				if (inputs[PITCH_INPUT].isConnected()) {
+					transpose = roundf(transpose);
+				}
+				performance_state.tonic = 12.0 + clamp(transpose, 0.0f, 60.0f);
+				performance_state.fm = clamp(48.0 * 3.3 * dsp::quarticBipolar(params[FREQUENCY_MOD_PARAM].getValue()) * inputs[FREQUENCY_MOD_INPUT].getNormalPolyVoltage(1.0, c) / 5.0, -48.0f, 48.0f);
+
+				performance_state.internal_exciter = !inputs[IN_INPUT].isConnected();
+				performance_state.internal_strum = !inputs[STRUM_INPUT].isConnected();
+				performance_state.internal_note = !inputs[PITCH_INPUT].isConnected();
+
+				// TODO
+				// "Normalized to a step detector on the V/OCT input and a transient detector on the IN input."
+				performance_state.strum = strum[c] && !lastStrum[c];
+				lastStrum[c] = strum[c];
+				strum[c] = false;
+
+				performance_state.chord = clamp((int) roundf(structure * (rings::kNumChords - 1)), 0, rings::kNumChords - 1);
+
+				// Process audio
+				if (easterEgg) {
+					strummer.Process(NULL, 24, &performance_state);
+					stringSynth.Process(performance_state, patch, in[c], out[c], aux[c], 24);
+				}
+				else {
+					strummer.Process(in[c], 24, &performance_state);
+					part.Process(performance_state, patch, in[c], out[c], aux[c], 24);
+				}
 			}
 
 			// Convert output buffer
 			{
-				dsp::Frame<2> outputFrames[24];
-				for (int i = 0; i < 24; i++) {
-					outputFrames[i].samples[0] = out[i];
-					outputFrames[i].samples[1] = aux[i];
+				dsp::Frame<16 * 2> outputFrames[24];
+				for (int c = 0; c < channels; c++) {
+					for (int i = 0; i < 24; i++) {
+						outputFrames[i].samples[c * 2 + 0] = out[c][i];
+						outputFrames[i].samples[c * 2 + 1] = aux[c][i];
+					}
 				}
 
 				outputSrc.setRates(48000, args.sampleRate);
+				outputSrc.setChannels(channels * 2);
 				int inLen = 24;
 				int outLen = outputBuffer.capacity();
 				outputSrc.process(outputFrames, &inLen, outputBuffer.endData(), &outLen);
@@ -209,18 +250,25 @@ struct Rings : Module {
 
 		// Set output
 		if (!outputBuffer.empty()) {
-			dsp::Frame<2> outputFrame = outputBuffer.shift();
-			// "Note that you need to insert a jack into each output to split the signals: when only one jack is inserted, both signals are mixed together."
-			if (outputs[ODD_OUTPUT].isConnected() && outputs[EVEN_OUTPUT].isConnected()) {
-				outputs[ODD_OUTPUT].setVoltage(clamp(outputFrame.samples[0], -1.0, 1.0) * 5.0);
-				outputs[EVEN_OUTPUT].setVoltage(clamp(outputFrame.samples[1], -1.0, 1.0) * 5.0);
-			}
-			else {
-				float v = clamp(outputFrame.samples[0] + outputFrame.samples[1], -1.0, 1.0) * 5.0;
-				outputs[ODD_OUTPUT].setVoltage(v);
-				outputs[EVEN_OUTPUT].setVoltage(v);
+			dsp::Frame<16 * 2> outputFrame = outputBuffer.shift();
+			for (int c = 0; c < channels; c++) {
+				float odd = outputFrame.samples[c * 2 + 0];
+				float even = outputFrame.samples[c * 2 + 1];
+				// "Note that you need to insert a jack into each output to split the signals: when only one jack is inserted, both signals are mixed together."
+				if (outputs[ODD_OUTPUT].isConnected() && outputs[EVEN_OUTPUT].isConnected()) {
+					outputs[ODD_OUTPUT].setVoltage(clamp(odd, -1.0, 1.0) * 5.0, c);
+					outputs[EVEN_OUTPUT].setVoltage(clamp(even, -1.0, 1.0) * 5.0, c);
+				}
+				else {
+					float v = clamp(odd + even, -1.0, 1.0) * 5.0;
+					outputs[ODD_OUTPUT].setVoltage(v, c);
+					outputs[EVEN_OUTPUT].setVoltage(v, c);
+				}
 			}
 		}
+
+		outputs[ODD_OUTPUT].setChannels(channels);
+		outputs[EVEN_OUTPUT].setChannels(channels);
 	}
 
 	json_t* dataToJson() override {
@@ -333,6 +381,10 @@ struct RingsWidget : ModuleWidget {
 			[=]() {return module->easterEgg;},
 			[=](bool val) {module->easterEgg = val;}
 		));
+
+		menu->addChild(new MenuSeparator);
+
+		menu->addChild(createMenuLabel(string::f("Memory: %d KB for %d channels, %d KB per channel", (int) (module->getMemorySize() / 1024), module->partSlots.getAllocatedCount(), (int) (sizeof(Rings::PartSlot) / 1024))));
 	}
 };
 
@@ -28,7 +28,8 @@ struct Ripples : Module {
 		NUM_LIGHTS
 	};
 
-	ripples::RipplesEngine engines[16];
+	/** Processing 4 channels each */
+	ripples::RipplesEngine engines[4];
 
 	Ripples() {
 		config(NUM_PARAMS, NUM_INPUTS, NUM_OUTPUTS, NUM_LIGHTS);
@@ -61,7 +62,7 @@ struct Ripples : Module {
 
 	void onSampleRateChange() override {
 		// TODO In Rack v2, replace with args.sampleRate
-		for (int c = 0; c < 16; c++) {
+		for (int c = 0; c < 4; c++) {
 			engines[c].setSampleRate(APP->engine->getSampleRate());
 		}
 	}
@@ -76,19 +77,19 @@ struct Ripples : Module {
 		frame.fm_knob = params[FM_PARAM].getValue();
 		frame.gain_cv_present = inputs[GAIN_INPUT].isConnected();
 
-		for (int c = 0; c < channels; c++) {
-			frame.res_cv = inputs[RES_INPUT].getPolyVoltage(c);
-			frame.freq_cv = inputs[FREQ_INPUT].getPolyVoltage(c);
-			frame.fm_cv = inputs[FM_INPUT].getPolyVoltage(c);
-			frame.input = inputs[IN_INPUT].getVoltage(c);
-			frame.gain_cv = inputs[GAIN_INPUT].getPolyVoltage(c);
+		for (int c = 0; c < channels; c += 4) {
+			frame.res_cv = inputs[RES_INPUT].getPolyVoltageSimd<simd::float_4>(c);
+			frame.freq_cv = inputs[FREQ_INPUT].getPolyVoltageSimd<simd::float_4>(c);
+			frame.fm_cv = inputs[FM_INPUT].getPolyVoltageSimd<simd::float_4>(c);
+			frame.input = inputs[IN_INPUT].getVoltageSimd<simd::float_4>(c);
+			frame.gain_cv = inputs[GAIN_INPUT].getPolyVoltageSimd<simd::float_4>(c);
 
-			engines[c].process(frame);
+			engines[c / 4].process(frame, std::min(channels - c, 4));
 
-			outputs[BP2_OUTPUT].setVoltage(frame.bp2, c);
-			outputs[LP2_OUTPUT].setVoltage(frame.lp2, c);
-			outputs[LP4_OUTPUT].setVoltage(frame.lp4, c);
-			outputs[LP4VCA_OUTPUT].setVoltage(frame.lp4vca, c);
+			outputs[BP2_OUTPUT].setVoltageSimd(frame.bp2, c);
+			outputs[LP2_OUTPUT].setVoltageSimd(frame.lp2, c);
+			outputs[LP4_OUTPUT].setVoltageSimd(frame.lp4, c);
+			outputs[LP4VCA_OUTPUT].setVoltageSimd(frame.lp4vca, c);
 		}
 
 		outputs[BP2_OUTPUT].setChannels(channels);
@@ -25,35 +25,7 @@ template <typename T>
 class AAFilter
 {
 public:
-    void Init(float sample_rate)
-    {
-        InitFilter(sample_rate);
-    }
-
-    T ProcessUp(T in)
-    {
-        return up_filter_.Process(in);
-    }
-
-    T ProcessDown(T in)
-    {
-        return down_filter_.Process(in);
-    }
-
-    int GetOversamplingFactor(void)
-    {
-        return oversampling_factor_;
-    }
-
-protected:
-    struct CascadedSOS
-    {
-        float sample_rate;
-        int oversampling_factor;
-        int num_sections;
-        const SOSCoefficients* coeffs;
-    };
-
+    // Factor selected for the lowest supported sample rate
     /*[[[cog
     from scipy import signal
     import math
@@ -105,6 +77,55 @@ protected:
         cascade = (fs, factor, n, wc, sos)
         cascades.append(cascade)
 
+    cog.outl('static constexpr int kMaxOversamplingFactor = {};'
+        .format(max(cascade[1] for cascade in cascades)))
+    ]]]*/
+    static constexpr int kMaxOversamplingFactor = 15;
+    //[[[end]]]
+
+    void Init(float sample_rate)
+    {
+        InitFilter(sample_rate);
+    }
+
+    T ProcessUp(T in)
+    {
+        return up_filter_.Process(in);
+    }
+
+    T ProcessDown(T in)
+    {
+        return down_filter_.Process(in);
+    }
+
+    // Filters `in` followed by zeros, writing one oversampled frame to `out`
+    void ProcessUp(T in, T* out)
+    {
+        up_filter_.ProcessUpsample(in, out, oversampling_factor_);
+    }
+
+    // Filters one oversampled frame from `in` and returns its last sample.
+    // The contents of `in` are clobbered.
+    T ProcessDown(T* in)
+    {
+        return down_filter_.ProcessDownsample(in, oversampling_factor_);
+    }
+
+    int GetOversamplingFactor(void)
+    {
+        return oversampling_factor_;
+    }
+
+protected:
+    struct CascadedSOS
+    {
+        float sample_rate;
+        int oversampling_factor;
+        int num_sections;
+        const SOSCoefficients* coeffs;
+    };
+
+    /*[[[cog
     cog.outl('static constexpr int kMaxNumSections = {};'
         .format(max_num_sections))
     ]]]*/
@@ -115,6 +136,19 @@ protected:
     SOSFilter<T, kMaxNumSections> down_filter_;
     int oversampling_factor_;
 
+public:
+    SOSFilter<T, kMaxNumSections>& up_filter()
+    {
+        return up_filter_;
+    }
+
+    SOSFilter<T, kMaxNumSections>& down_filter()
+    {
+        return down_filter_;
+    }
+
+protected:
+
     void InitFilter(float sample_rate)
     {
         if (false) {}
@@ -112,29 +112,34 @@ static const float kVtoICollectorVSat = -10.f;
 static const float kOpampSatV = 10.6f;
 
 
+// Processes up to four polyphony channels per call, one channel per SIMD
+// lane, so that every stage runs on four channels at once. A single channel
+// is processed with the four signal paths in the SIMD lanes instead, which
+// is cheaper for monophonic patches. The state of the channel is carried
+// across whenever the engine switches between the two layouts.
 class RipplesEngine
 {
 public:
     struct Frame
     {
-        // Parameters
+        // Parameters, shared by all channels
         float res_knob;     //  0 to 1 linear
         float freq_knob;    //  0 to 1 linear
         float fm_knob;      // -1 to 1 linear
 
         // Inputs
-        float res_cv;
-        float freq_cv;
-        float fm_cv;
-        float input;
-        float gain_cv;
+        simd::float_4 res_cv;
+        simd::float_4 freq_cv;
+        simd::float_4 fm_cv;
+        simd::float_4 input;
+        simd::float_4 gain_cv;
         bool gain_cv_present;
 
         // Outputs
-        float bp2;
-        float lp2;
-        float lp4;
-        float lp4vca;
+        simd::float_4 bp2;
+        simd::float_4 lp2;
+        simd::float_4 lp4;
+        simd::float_4 lp4vca;
     };
 
     RipplesEngine()
@@ -145,12 +150,19 @@ public:
     void setSampleRate(float sample_rate)
     {
         sample_time_ = 1.f / sample_rate;
-        cell_voltage_ = 0.f;
+        mono_ = false;
 
-        aa_filter_.Init(sample_rate);
+        mono_cell_voltage_ = 0.f;
+        mono_aa_filter_.Init(sample_rate);
+        for (int i = 0; i < 4; i++)
+        {
+            cell_voltage_[i] = 0.f;
+            up_filter_[i].Init(sample_rate);
+            down_filter_[i].Init(sample_rate);
+        }
 
         float oversample_rate =
-            sample_rate * aa_filter_.GetOversamplingFactor();
+            sample_rate * mono_aa_filter_.GetOversamplingFactor();
 
         float freq_cut = 1.f / (2.f * M_PI * kFreqAmpR * kFreqAmpC);
         float res_cut  = 1.f / (2.f * M_PI * kResAmpR  * kResAmpC);
@@ -158,27 +170,121 @@ public:
         float ff_cut = 1.f / (2.f * M_PI * kFeedforwardR * kFeedforwardC);
 
         auto cutoffs = simd::float_4(ff_cut, freq_cut, res_cut, gain_cut);
-        rc_filters_.setCutoffFreq(cutoffs / oversample_rate);
+        mono_rc_filters_.setCutoffFreq(cutoffs / oversample_rate);
+        ff_filter_.setCutoffFreq(ff_cut / oversample_rate);
+        freq_filter_.setCutoffFreq(freq_cut / oversample_rate);
+        res_filter_.setCutoffFreq(res_cut / oversample_rate);
+        gain_filter_.setCutoffFreq(gain_cut / oversample_rate);
 
         float vca_cut = 1.f / (2.f * M_PI * kVCAInputR * kVCAInputC);
+        mono_vca_hpf_.setCutoffFreq(vca_cut / oversample_rate);
         vca_hpf_.setCutoffFreq(vca_cut / oversample_rate);
     }
 
-    void process(Frame& frame)
+    // Processes the first `channels` lanes of the frame. The outputs of the
+    // other lanes are meaningless.
+    void process(Frame& frame, int channels)
+    {
+        bool mono = (channels == 1);
+        if (mono != mono_)
+        {
+            SwapLayout(mono);
+        }
+
+        if (mono)
+        {
+            ProcessMono(frame);
+        }
+        else
+        {
+            ProcessPoly(frame);
+        }
+    }
+
+protected:
+    float sample_time_;
+    // Whether the state of lane 0 lives in the mono_* members
+    bool mono_;
+
+    // Monophonic layout: the lanes hold the signal paths of a single channel,
+    // (input, v_oct, i_reso, i_vca) in and (bp2, lp2, lp4, lp4vca) out
+    simd::float_4 mono_cell_voltage_;
+    ripples::AAFilter<simd::float_4> mono_aa_filter_;
+    dsp::TRCFilter<simd::float_4> mono_rc_filters_;
+    dsp::TRCFilter<float> mono_vca_hpf_;
+
+    // Polyphonic layout: the lanes hold channels
+    // Voltage of each filter cell, for each channel
+    simd::float_4 cell_voltage_[4];
+    // Indexed by signal path, like the lanes of the monophonic filters
+    ripples::AAFilter<simd::float_4> up_filter_[4];
+    ripples::AAFilter<simd::float_4> down_filter_[4];
+    dsp::TRCFilter<simd::float_4> ff_filter_;
+    dsp::TRCFilter<simd::float_4> freq_filter_;
+    dsp::TRCFilter<simd::float_4> res_filter_;
+    dsp::TRCFilter<simd::float_4> gain_filter_;
+    dsp::TRCFilter<simd::float_4> vca_hpf_;
+
+    // Moves the state of the first channel to the layout about to be used.
+    // The other lanes of the polyphonic layout keep their state.
+    void SwapLayout(bool mono)
+    {
+        dsp::TRCFilter<simd::float_4>* rc_filters[4] =
+            {&ff_filter_, &freq_filter_, &res_filter_, &gain_filter_};
+
+        for (int i = 0; i < 4; i++)
+        {
+            if (mono)
+            {
+                mono_cell_voltage_[i] = cell_voltage_[i][0];
+                mono_aa_filter_.up_filter().CopyLane(i,
+                    up_filter_[i].up_filter(), 0);
+                mono_aa_filter_.down_filter().CopyLane(i,
+                    down_filter_[i].down_filter(), 0);
+                mono_rc_filters_.xstate[0][i] = rc_filters[i]->xstate[0][0];
+                mono_rc_filters_.ystate[0][i] = rc_filters[i]->ystate[0][0];
+            }
+            else
+            {
+                cell_voltage_[i][0] = mono_cell_voltage_[i];
+                up_filter_[i].up_filter().CopyLane(0,
+                    mono_aa_filter_.up_filter(), i);
+                down_filter_[i].down_filter().CopyLane(0,
+                    mono_aa_filter_.down_filter(), i);
+                rc_filters[i]->xstate[0][0] = mono_rc_filters_.xstate[0][i];
+                rc_filters[i]->ystate[0][0] = mono_rc_filters_.ystate[0][i];
+            }
+        }
+
+        if (mono)
+        {
+            mono_vca_hpf_.xstate[0] = vca_hpf_.xstate[0][0];
+            mono_vca_hpf_.ystate[0] = vca_hpf_.ystate[0][0];
+        }
+        else
+        {
+            vca_hpf_.xstate[0][0] = mono_vca_hpf_.xstate[0];
+            vca_hpf_.ystate[0][0] = mono_vca_hpf_.ystate[0];
+        }
+
+        mono_ = mono;
+    }
+
+    void ProcessMono(Frame& frame)
     {
         // Calculate equivalent frequency CV
         float v_oct = 0.f;
         v_oct += (frame.freq_knob - 1.f) * kFreqKnobVoltage;
-        v_oct += frame.freq_cv;
-        v_oct += frame.fm_cv * frame.fm_knob;
+        v_oct += frame.freq_cv[0];
+        v_oct += frame.fm_cv[0] * frame.fm_knob;
         v_oct = std::min(v_oct, 0.f);
 
         // Calculate resonance control current
-        float i_reso = VtoIConverter(kResAmpR, frame.res_cv, kResInputR,
+        float i_reso = VtoIConverter(kResAmpR, frame.res_cv[0], kResInputR,
             frame.res_knob * kResKnobV, kResKnobR);
 
         // Calculate gain control current
-        float gain_cv = frame.gain_cv;
+        float gain_cv = frame.gain_cv[0];
         float gain_input_r = kGainInputR;
         if (!frame.gain_cv_present)
         {
@@ -188,49 +294,113 @@ public:
         float i_vca = VtoIConverter(kGainAmpR, gain_cv, gain_input_r);
 
         // Pack and upsample inputs
-        int oversampling_factor = aa_filter_.GetOversamplingFactor();
+        int oversampling_factor = mono_aa_filter_.GetOversamplingFactor();
         float timestep = sample_time_ / oversampling_factor;
         // Add noise to input to bootstrap self-oscillation
-        float input = frame.input + 1e-6 * (random::uniform() - 0.5f);
+        float input = frame.input[0] + 1e-6 * (random::uniform() - 0.5f);
         auto inputs = simd::float_4(input, v_oct, i_reso, i_vca);
         inputs *= oversampling_factor;
-        simd::float_4 outputs;
+
+        // The filters don't depend on the core, so run each of them over the
+        // whole oversampled frame at once
+        simd::float_4 buffer[AAFilter<simd::float_4>::kMaxOversamplingFactor];
+        mono_aa_filter_.ProcessUp(inputs, buffer);
 
         for (int i = 0; i < oversampling_factor; i++)
         {
-            inputs = aa_filter_.ProcessUp((i == 0) ? inputs : 0.f);
-            outputs = CoreProcess(inputs, timestep);
-            outputs = aa_filter_.ProcessDown(outputs);
+            buffer[i] = CoreProcessMono(buffer[i], timestep);
         }
 
+        simd::float_4 outputs = mono_aa_filter_.ProcessDown(buffer);
+
         frame.bp2    = outputs[0];
         frame.lp2    = outputs[1];
         frame.lp4    = outputs[2];
         frame.lp4vca = outputs[3];
     }
 
-protected:
-    float sample_time_;
-    simd::float_4 cell_voltage_;
-    ripples::AAFilter<simd::float_4> aa_filter_;
-    dsp::TRCFilter<simd::float_4> rc_filters_;
-    dsp::TRCFilter<float> vca_hpf_;
+    void ProcessPoly(Frame& frame)
+    {
+        // Calculate equivalent frequency CV
+        simd::float_4 v_oct = 0.f;
+        v_oct += (frame.freq_knob - 1.f) * kFreqKnobVoltage;
+        v_oct += frame.freq_cv;
+        v_oct += frame.fm_cv * frame.fm_knob;
+        v_oct = simd::fmin(v_oct, 0.f);
+
+        // Calculate resonance control current
+        simd::float_4 i_reso = VtoIConverter(kResAmpR, frame.res_cv,
+            kResInputR, frame.res_knob * kResKnobV, kResKnobR);
+
+        // Calculate gain control current
+        simd::float_4 gain_cv = frame.gain_cv;
+        float gain_input_r = kGainInputR;
+        if (!frame.gain_cv_present)
+        {
+            gain_cv = kGainNormalV;
+            gain_input_r += kGainNormalR;
+        }
+        simd::float_4 i_vca = VtoIConverter(kGainAmpR, gain_cv, gain_input_r);
+
+        // Pack and upsample inputs
+        int oversampling_factor = up_filter_[0].GetOversamplingFactor();
+        float timestep = sample_time_ / oversampling_factor;
+        // Add noise to input to bootstrap self-oscillation
+        simd::float_4 noise(random::uniform(), random::uniform(),
+            random::uniform(), random::uniform());
+        simd::float_4 input = frame.input + 1e-6f * (noise - 0.5f);
+        simd::float_4 inputs[4] = {input, v_oct, i_reso, i_vca};
+        simd::float_4 outputs[4];
+
+        static constexpr int kMaxFactor =
+            AAFilter<simd::float_4>::kMaxOversamplingFactor;
+        simd::float_4 up[4][kMaxFactor];
+        simd::float_4 down[4][kMaxFactor];
+
+        for (int j = 0; j < 4; j++)
+        {
+            up_filter_[j].ProcessUp(inputs[j] * oversampling_factor, up[j]);
+        }
+
+        for (int i = 0; i < oversampling_factor; i++)
+        {
+            for (int j = 0; j < 4; j++)
+            {
+                inputs[j] = up[j][i];
+            }
+            CoreProcessPoly(inputs, outputs, timestep);
+            for (int j = 0; j < 4; j++)
+            {
+                down[j][i] = outputs[j];
+            }
+        }
 
-    // High-rate processing core
+        for (int j = 0; j < 4; j++)
+        {
+            outputs[j] = down_filter_[j].ProcessDown(down[j]);
+        }
+
+        frame.bp2    = outputs[0];
+        frame.lp2    = outputs[1];
+        frame.lp4    = outputs[2];
+        frame.lp4vca = outputs[3];
+    }
+
+    // High-rate processing core of the monophonic layout
     // inputs: vector containing (input, v_oct, i_reso, i_vca)
     // returns: vector containing (bp2, lp2, lp4, lp4vca)
-    simd::float_4 CoreProcess(simd::float_4 inputs, float timestep)
+    simd::float_4 CoreProcessMono(simd::float_4 inputs, float timestep)
     {
-        rc_filters_.process(inputs);
+        mono_rc_filters_.process(inputs);
 
         // Lowpass the control signals
-        simd::float_4 control = rc_filters_.lowpass();
+        simd::float_4 control = mono_rc_filters_.lowpass();
         float v_oct = control[1];
         float i_reso = control[2];
         float i_vca = control[3];
 
         // Highpass the input signal to generate the resonance feedforward
-        float feedforward = rc_filters_.highpass()[0];
+        float feedforward = mono_rc_filters_.highpass()[0];
 
         // The 2164's input terminal is a virtual ground, so we can model the
         // vca-integrator cell like so:
@@ -254,7 +424,8 @@ protected:
         simd::float_4 rad_per_s = -std::exp2f(v_oct) / kFilterCellRC;
 
         // Emulate the filter core
-        cell_voltage_ = StepRK2(timestep, cell_voltage_, [&](simd::float_4 vout)
+        mono_cell_voltage_ = StepRK2(timestep, mono_cell_voltage_,
+            [&](simd::float_4 vout)
         {
             // vout contains the initial cell voltages (v0, v1 v2, v3)
 
@@ -283,20 +454,105 @@ protected:
             return dvout;
         });
 
-        cell_voltage_ = simd::clamp(cell_voltage_, -kOpampSatV, kOpampSatV);
+        mono_cell_voltage_ =
+            simd::clamp(mono_cell_voltage_, -kOpampSatV, kOpampSatV);
 
-        float lp1 = cell_voltage_[0];
-        float lp2 = cell_voltage_[1];
-        float lp4 = cell_voltage_[3];
+        float lp1 = mono_cell_voltage_[0];
+        float lp2 = mono_cell_voltage_[1];
+        float lp4 = mono_cell_voltage_[3];
         float bp2 = (lp1 + lp2) * kBP2Gain;
-        vca_hpf_.process(lp4);
-        float lp4vca = vca_hpf_.highpass();
+        mono_vca_hpf_.process(lp4);
+        float lp4vca = mono_vca_hpf_.highpass();
         lp4vca = -kVCAOutputR * OTAVCA(0.f, lp4vca * kVCAInputGain, i_vca);
         lp2 *= kLP2Gain;
         lp4 *= kLP4Gain;
         return simd::float_4(bp2, lp2, lp4, lp4vca);
     }
 
+    // High-rate processing core of the polyphonic layout, see
+    // CoreProcessMono()
+    // inputs: (input, v_oct, i_reso, i_vca)
+    // outputs: (bp2, lp2, lp4, lp4vca)
+    void CoreProcessPoly(const simd::float_4* inputs, simd::float_4* outputs,
+        float timestep)
+    {
+        ff_filter_.process(inputs[0]);
+        freq_filter_.process(inputs[1]);
+        res_filter_.process(inputs[2]);
+        gain_filter_.process(inputs[3]);
+
+        // Lowpass the control signals
+        simd::float_4 v_oct = freq_filter_.lowpass();
+        simd::float_4 i_reso = res_filter_.lowpass();
+        simd::float_4 i_vca = gain_filter_.lowpass();
+
+        // Highpass the input signal to generate the resonance feedforward
+        simd::float_4 feedforward = ff_filter_.highpass();
+
+        // Calculate -A / RC, with the same exponential as the monophonic
+        // layout so that both tune the filter identically
+        simd::float_4 gain(std::exp2f(v_oct[0]), std::exp2f(v_oct[1]),
+            std::exp2f(v_oct[2]), std::exp2f(v_oct[3]));
+        simd::float_4 rad_per_s = -gain / kFilterCellRC;
+
+        // The core input is the filter input plus the resonance signal.
+        // Only the feedback term depends on the cell voltages.
+        simd::float_4 vp = feedforward * kFeedforwardGain;
+        simd::float_4 in = inputs[0] * kFilterInputGain;
+
+        // Emulate the filter core with the 2nd order Runge-Kutta method
+        simd::float_4 k1[4];
+        simd::float_4 y1[4];
+        simd::float_4 k2[4];
+        CellDerivatives(cell_voltage_, vp, in, i_reso, rad_per_s, k1);
+        for (int i = 0; i < 4; i++)
+        {
+            y1[i] = cell_voltage_[i] + k1[i] * timestep / 2.f;
+        }
+        CellDerivatives(y1, vp, in, i_reso, rad_per_s, k2);
+        for (int i = 0; i < 4; i++)
+        {
+            cell_voltage_[i] = cell_voltage_[i] + timestep * k2[i];
+            cell_voltage_[i] =
+                simd::clamp(cell_voltage_[i], -kOpampSatV, kOpampSatV);
+        }
+
+        simd::float_4 lp1 = cell_voltage_[0];
+        simd::float_4 lp2 = cell_voltage_[1];
+        simd::float_4 lp4 = cell_voltage_[3];
+        simd::float_4 bp2 = (lp1 + lp2) * kBP2Gain;
+        vca_hpf_.process(lp4);
+        simd::float_4 lp4vca = vca_hpf_.highpass();
+        lp4vca = -kVCAOutputR * OTAVCA(0.f, lp4vca * kVCAInputGain, i_vca);
+        lp2 *= kLP2Gain;
+        lp4 *= kLP4Gain;
+
+        outputs[0] = bp2;
+        outputs[1] = lp2;
+        outputs[2] = lp4;
+        outputs[3] = lp4vca;
+    }
+
+    // dvout/dt = -A/(RC) * (vin + vout) for each cell, where vin is the
+    // previous cell's voltage, or the core input for the first cell.
+    void CellDerivatives(const simd::float_4* vout, simd::float_4 vp,
+        simd::float_4 in, simd::float_4 i_reso, simd::float_4 rad_per_s,
+        simd::float_4* dvout)
+    {
+        simd::float_4 vn = vout[3] * kFeedbackGain;
+        simd::float_4 res = kFilterCellR * OTAVCA(vp, vn, i_reso);
+
+        for (int i = 0; i < 4; i++)
+        {
+            simd::float_4 vin = (i == 0) ? in + res : vout[i - 1];
+            simd::float_4 vsum = vin + vout[i];
+            dvout[i] = rad_per_s * vsum;
+
+            // Generate some even-order harmonics via self-modulation
+            dvout[i] *= (1.f + vsum * kFilterCellSelfModulation);
+        }
+    }
+
     // Solves an ODE system using the 2nd order Runge-Kutta method
     template <typename T, typename F>
     T StepRK2(float dt, T y, F f)
@@ -330,13 +586,31 @@ protected:
         return std::max(iout, 0.f);
     }
 
+    simd::float_4 VtoIConverter(
+        float rfb,
+        simd::float_4 vc, float rc,
+        float vp = 0.f, float rp = 1e12f)
+    {
+        simd::float_4 vnom = -(vc * rfb / rc + vp * rfb / rp);
+        simd::float_4 vout = simd::fmax(vnom, kVtoICollectorVSat);
+
+        float nrc = rp * rfb;
+        float nrp = rc * rfb;
+        float nrfb = rc * rp;
+        simd::float_4 vneg =
+            (vc * nrc + vp * nrp + vout * nrfb) / (nrc + nrp + nrfb);
+
+        simd::float_4 iout = (vneg - vout) / rfb;
+
+        return simd::fmax(iout, 0.f);
+    }
+
     // Model of LM13700 OTA VCA, neglecting linearizing diodes
     // vp: voltage at positive input terminal
     // vn: voltage at negative input terminal
     // i_abc: amplifier bias current
     // returns: OTA output current
-    template <typename T>
-    T OTAVCA(T vp, T vn, T i_abc)
+    float OTAVCA(float vp, float vn, float i_abc)
     {
         // For the derivation of this equation, see this fantastic paper:
         //   http://www.openmusiclabs.com/files/otadist.pdf
@@ -352,14 +626,33 @@ protected:
         const float kVt = kKoverQ * (kTemperature + kKelvin);
         const float kZlim = 2.f * std::sqrt(3.f);
 
-        T vi = vp - vn;
-        T zlim = kZlim;
-        T z = math::clamp(vi / (2 * kVt), -zlim, zlim);
+        float vi = vp - vn;
+        float z = math::clamp(vi / (2 * kVt), -kZlim, kZlim);
+
+        // Pade approximant of tanh(z)
+        float z2 = z * z;
+        float q = 12.f + z2;
+        float p = 12.f * z * q / (36.f * z2 + q * q);
+
+        return i_abc * p;
+    }
+
+    simd::float_4 OTAVCA(simd::float_4 vp, simd::float_4 vn,
+        simd::float_4 i_abc)
+    {
+        const float kTemperature = 40.f; // Silicon temperature in Celsius
+        const float kKoverQ = 8.617333262145e-5;
+        const float kKelvin = 273.15f; // 0C in K
+        const float kVt = kKoverQ * (kTemperature + kKelvin);
+        const float kZlim = 2.f * std::sqrt(3.f);
+
+        simd::float_4 vi = vp - vn;
+        simd::float_4 z = simd::clamp(vi / (2 * kVt), -kZlim, kZlim);
 
         // Pade approximant of tanh(z)
-        T z2 = z * z;
-        T q = 12.f + z2;
-        T p = 12.f * z * q / (36.f * z2 + q * q);
+        simd::float_4 z2 = z * z;
+        simd::float_4 q = 12.f + z2;
+        simd::float_4 p = 12.f * z * q / (36.f * z2 + q * q);
 
         return i_abc * p;
     }
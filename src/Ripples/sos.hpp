@@ -16,103 +16,12 @@
 
 #pragma once
 
-namespace ripples
-{
+#include "../sos.hpp"
 
-struct SOSCoefficients
-{
-    float b[3];
-    float a[2];
-};
-
-template <typename T, int max_num_sections>
-class SOSFilter
+namespace ripples
 {
-public:
-    SOSFilter()
-    {
-        Init(0);
-    }
-
-    SOSFilter(int num_sections)
-    {
-        Init(num_sections);
-    }
-
-    void Init(int num_sections)
-    {
-        num_sections_ = num_sections;
-        Reset();
-    }
-
-    void Init(int num_sections, const SOSCoefficients* sections)
-    {
-        num_sections_ = num_sections;
-        Reset();
-        SetCoefficients(sections);
-    }
-
-    void Reset()
-    {
-        for (int n = 0; n < num_sections_; n++)
-        {
-            x_[n][0] = 0.f;
-            x_[n][1] = 0.f;
-            x_[n][2] = 0.f;
-        }
-
-        x_[num_sections_][0] = 0.f;
-        x_[num_sections_][1] = 0.f;
-        x_[num_sections_][2] = 0.f;
-    }
-
-    void SetCoefficients(const SOSCoefficients* sections)
-    {
-        for (int n = 0; n < num_sections_; n++)
-        {
-            sections_[n].b[0] = sections[n].b[0];
-            sections_[n].b[1] = sections[n].b[1];
-            sections_[n].b[2] = sections[n].b[2];
-
-            sections_[n].a[0] = sections[n].a[0];
-            sections_[n].a[1] = sections[n].a[1];
-        }
-    }
-
-    T Process(T in)
-    {
-        for (int n = 0; n < num_sections_; n++)
-        {
-            // Shift x state
-            x_[n][2] = x_[n][1];
-            x_[n][1] = x_[n][0];
-            x_[n][0] = in;
-
-            T out = 0.f;
-
-            // Add x state
-            out += sections_[n].b[0] * x_[n][0];
-            out += sections_[n].b[1] * x_[n][1];
-            out += sections_[n].b[2] * x_[n][2];
-
-            // Subtract y state
-            out -= sections_[n].a[0] * x_[n+1][0];
-            out -= sections_[n].a[1] * x_[n+1][1];
-            in = out;
-        }
-
-        // Shift final section x state
-        x_[num_sections_][2] = x_[num_sections_][1];
-        x_[num_sections_][1] = x_[num_sections_][0];
-        x_[num_sections_][0] = in;
-
-        return in;
-    }
 
-protected:
-    int num_sections_;
-    SOSCoefficients sections_[max_num_sections];
-    T x_[max_num_sections + 1][3];
-};
+using sos::SOSCoefficients;
+using sos::SOSFilter;
 
 }
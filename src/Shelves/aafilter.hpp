@@ -76,8 +76,11 @@ for fs in common_rates:
 
 cog.outl('static constexpr int kMaxNumSections = {};'
     .format(max_num_sections))
+cog.outl('static constexpr int kMaxOversamplingFactor = {};'
+    .format(max(oversampling_factors.values())))
 ]]]*/
 static constexpr int kMaxNumSections = 8;
+static constexpr int kMaxOversamplingFactor = 15;
 //[[[end]]]
 
 inline int SampleRateID(float sample_rate)
@@ -149,6 +152,19 @@ public:
         return filter_.Process(in);
     }
 
+    // Filters `in` followed by `factor - 1` zeros into `out`
+    void ProcessUpsample(T in, T* out, int factor)
+    {
+        filter_.ProcessUpsample(in, out, factor);
+    }
+
+    // Filters `factor` samples from `in` and returns the last one. The
+    // contents of `in` are clobbered.
+    T ProcessDownsample(T* in, int factor)
+    {
+        return filter_.ProcessDownsample(in, factor);
+    }
+
 protected:
     SOSFilter<T, kMaxNumSections> filter_;
 
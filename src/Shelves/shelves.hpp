@@ -419,19 +419,38 @@ public:
             frame.p2_bp_out_connected ||
             frame.p2_lp_out_connected;
 
+        // The anti-aliasing filters don't depend on the VCFs, so run each of
+        // them over the whole oversampled frame at once
+        simd::float_4 v_oct_up[kMaxOversamplingFactor];
+        simd::float_4 q_cv_up[kMaxOversamplingFactor];
+        simd::float_4 gain_db_up[kMaxOversamplingFactor];
+        simd::float_4 out1_down[kMaxOversamplingFactor];
+        simd::float_4 out2_down[kMaxOversamplingFactor];
+
+        if (f_cv_exists)
+        {
+            up_filter_[0].ProcessUpsample(
+                v_oct * oversampling_, v_oct_up, oversampling_);
+        }
+
+        // We can't skip this one since it contains the input signal
+        up_filter_[1].ProcessUpsample(
+            q_cv * oversampling_, q_cv_up, oversampling_);
+
+        if (gain_cv_exists)
+        {
+            up_filter_[2].ProcessUpsample(
+                gain_db * oversampling_, gain_db_up, oversampling_);
+        }
+
         for (int i = 0; i < oversampling_; i++)
         {
-            // Upsample and apply anti-aliasing filters if needed
             if (f_cv_exists)
             {
-                v_oct = up_filter_[0].Process(
-                    (i == 0) ? (v_oct * oversampling_) : 0.f);
-                f_level = FreqVCALevel(v_oct);
+                f_level = FreqVCALevel(v_oct_up[i]);
             }
 
-            // We can't skip this one since it contains the input signal
-            q_cv = up_filter_[1].Process(
-                (i == 0) ? (q_cv * oversampling_) : 0.f);
+            q_cv = q_cv_up[i];
             if (q_cv_exists)
             {
                 q_level = QVCALevel(q_cv);
@@ -439,9 +458,7 @@ public:
 
             if (gain_cv_exists)
             {
-                gain_db = up_filter_[2].Process(
-                    (i == 0) ? (gain_db * oversampling_) : 0.f);
-                gain_level = GainVCALevel(gain_db);
+                gain_level = GainVCALevel(gain_db_up[i]);
             }
 
             // Unpack input from Q CV vector
@@ -461,19 +478,23 @@ public:
             float sum = 2.f * (low + mid[1] + mid[2] + high);
 
             out1 = simd::float_4(sum, mid_.lp()[1], mid_.bp()[1], mid_.hp()[1]);
-            out1 = simd::clamp(out1, -kClampVoltage, kClampVoltage);
-
-            // Pre-downsample anti-alias filtering
-            out1 = down_filter_[0].Process(out1);
+            out1_down[i] = simd::clamp(out1, -kClampVoltage, kClampVoltage);
 
             if (out2_connected)
             {
                 out2 = simd::float_4(0.f, mid_.lp()[2], mid_.bp()[2], mid_.hp()[2]);
-                out2 = simd::clamp(out2, -kClampVoltage, kClampVoltage);
-                out2 = down_filter_[1].Process(out2);
+                out2_down[i] = simd::clamp(out2, -kClampVoltage, kClampVoltage);
             }
         }
 
+        // Pre-downsample anti-alias filtering
+        out1 = down_filter_[0].ProcessDownsample(out1_down, oversampling_);
+
+        if (out2_connected)
+        {
+            out2 = down_filter_[1].ProcessDownsample(out2_down, oversampling_);
+        }
+
         frame.main_out = out1[0];
 
         clip_hpf_.process(out1[0]);
@@ -0,0 +1,129 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+
+/** Allocates the per-channel state of a polyphonic module on demand, without allocating on the engine thread.
+
+The first slot is allocated by init(), so a mono module never waits.
+When the engine thread asks for more channels than it has slots, a background thread allocates and initializes the missing slots, and publishes each one with an atomic store.
+The engine thread picks them up on a later call of grow(), so new channels start a few blocks late.
+Slots are value-initialized, and only freed by the destructor.
+*/
+template <typename TSlot, int MAX_SLOTS = 16>
+struct SlotAllocator {
+	typedef void (*InitFunction)(void* context, TSlot* slot, int index);
+
+	SlotAllocator() {
+		for (int i = 0; i < MAX_SLOTS; i++)
+			ready[i].store(NULL);
+	}
+
+	~SlotAllocator() {
+		if (thread.joinable()) {
+			{
+				std::lock_guard<std::mutex> lock(sleepMutex);
+				running = false;
+			}
+			sleepCv.notify_all();
+			thread.join();
+		}
+		for (int i = 0; i < MAX_SLOTS; i++)
+			delete ready[i].load();
+	}
+
+	/** Allocates the first slot on the calling thread and starts the background thread.
+	`function` is called once for each new slot, on whichever thread allocates it.
+	*/
+	void init(InitFunction function, void* context) {
+		initFunction = function;
+		initContext = context;
+		allocate(0);
+		allocated.store(1);
+		thread = std::thread([this]() {work();});
+	}
+
+	/** Picks up the slots allocated since the last call, and requests more if fewer than `channels` are available.
+	Returns the number of channels which can be processed, which is at least 1.
+	Must only be called from the engine thread.
+	*/
+	int grow(int channels) {
+		while (count < MAX_SLOTS) {
+			TSlot* slot = ready[count].load(std::memory_order_acquire);
+			if (!slot)
+				break;
+			slots[count++] = slot;
+		}
+		channels = std::min(channels, MAX_SLOTS);
+		if (channels > count && channels > requested.load()) {
+			std::lock_guard<std::mutex> lock(sleepMutex);
+			requested.store(channels);
+			sleepCv.notify_all();
+		}
+		return std::min(channels, count);
+	}
+
+	/** Number of slots picked up by grow(). Must only be called from the engine thread. */
+	int size() const {
+		return count;
+	}
+
+	/** Returns a slot picked up by grow(). Must only be called from the engine thread. */
+	TSlot* operator[](int index) const {
+		return slots[index];
+	}
+
+	/** Returns the slot at `index` if it has been allocated, or NULL. Safe to call from any thread. */
+	TSlot* getAllocated(int index) const {
+		return ready[index].load(std::memory_order_acquire);
+	}
+
+	/** Number of allocated slots. Safe to call from any thread. */
+	int getAllocatedCount() const {
+		return allocated.load();
+	}
+
+private:
+	InitFunction initFunction = NULL;
+	void* initContext = NULL;
+	/** Only accessed by the engine thread. */
+	TSlot* slots[MAX_SLOTS] = {};
+	int count = 0;
+	/** Written once per slot by the allocating thread. */
+	std::atomic<TSlot*> ready[MAX_SLOTS];
+	std::atomic<int> allocated{0};
+	std::atomic<int> requested{1};
+
+	std::thread thread;
+	bool running = true;
+	std::mutex sleepMutex;
+	std::condition_variable sleepCv;
+
+	void allocate(int index) {
+		TSlot* slot = new TSlot();
+		initFunction(initContext, slot, index);
+		ready[index].store(slot, std::memory_order_release);
+	}
+
+	void work() {
+		while (true) {
+			int target;
+			{
+				std::unique_lock<std::mutex> lock(sleepMutex);
+				sleepCv.wait(lock, [&]() {
+					return !running || requested.load() > allocated.load();
+				});
+				if (!running)
+					return;
+				target = requested.load();
+			}
+			for (int i = allocated.load(); i < target; i++) {
+				allocate(i);
+				allocated.store(i + 1);
+			}
+		}
+	}
+};
@@ -6,6 +6,8 @@
 // Must match io_buffer.h
 static const int NUM_CHANNELS = 6;
 static const int BLOCK_SIZE = 8;
+// Must match segment_generator.h: up to six chained modules
+static const int MAX_CHAIN_SEGMENTS = 36;
 
 struct LongPressButton {
 	enum Events {
@@ -51,18 +53,25 @@ struct GroupBuilder {
 
 	GroupInfo groups[NUM_CHANNELS];
 	int groupCount = 0;
-
-	bool buildGroups(std::vector<Input>* gateInputs, size_t first, size_t count) {
-		bool any_gates = false;
+	/** Number of leading segments continuing a group of the module to the left */
+	int slaveCount = 0;
+
+	/** Groups the local segments.
+	`gated` tells whether the gate input of each segment is patched, for the local segments followed by `count - NUM_CHANNELS` segments of the modules to the right.
+	If `leftOpen`, the leading ungated segments continue a group of the module to the left.
+	A gated group ending at the last local segment extends to the right until the next gated segment.
+	Returns true if the groups have changed.
+	*/
+	bool buildGroups(const bool* gated, int count, bool leftOpen) {
+		bool any_gates = leftOpen;
 
 		GroupInfo nextGroups[NUM_CHANNELS];
+		int nextSlaveCount = 0;
 
 		int currentGroup = 0;
 		for (int i = 0; i < NUM_CHANNELS; i++) {
-			bool gated = (*gateInputs)[first + i].isConnected();
-
 			if (!any_gates) {
-				if (!gated) {
+				if (!gated[i]) {
 					// No gates at all yet, segments are all single segment groups
 					nextGroups[currentGroup].first_segment = i;
 					nextGroups[currentGroup].segment_count = 1;
@@ -79,9 +88,15 @@ struct GroupBuilder {
 				}
 			}
 			else {
-				if (!gated) {
-					// We've had a gate, this ungated segment is part of the previous group
-					nextGroups[currentGroup - 1].segment_count++;
+				if (!gated[i]) {
+					if (currentGroup == 0) {
+						// We've had a gate in the module to the left, this ungated segment is part of its group
+						nextSlaveCount++;
+					}
+					else {
+						// We've had a gate, this ungated segment is part of the previous group
+						nextGroups[currentGroup - 1].segment_count++;
+					}
 				}
 				else {
 					// This gated input indicates the start of the next group
@@ -93,11 +108,19 @@ struct GroupBuilder {
 			}
 		}
 
+		// The last group continues into the modules to the right
+		if (currentGroup > 0 && nextGroups[currentGroup - 1].gated) {
+			for (int i = NUM_CHANNELS; i < count && !gated[i]; i++) {
+				nextGroups[currentGroup - 1].segment_count++;
+			}
+		}
+
 		bool changed = false;
 
-		if (currentGroup != groupCount) {
+		if (currentGroup != groupCount || nextSlaveCount != slaveCount) {
 			changed = true;
 			groupCount = currentGroup;
+			slaveCount = nextSlaveCount;
 		}
 
 		for (int i = 0; i < groupCount; i++) {
@@ -116,6 +139,36 @@ struct GroupBuilder {
 	}
 };
 
+/** Sent to the module to the right once per block.
+Describes the group left open at the right edge of the sender, which continues into the leading ungated segments of the receiver.
+*/
+struct ChainToRight {
+	bool open;
+	/** Index in the open group of the receiver's first segment */
+	int segmentOffset;
+	/** Number of looping segments of the open group before the receiver */
+	int loopCount;
+	int channels;
+	/** Active segment and phase of the open group during the last block */
+	int segment[16][BLOCK_SIZE];
+	float phase[16][BLOCK_SIZE];
+};
+
+struct ChainSegment {
+	stages::segment::Configuration configuration;
+	bool gated;
+	float primary[16];
+	float secondary;
+};
+
+/** Sent to the module to the left once per block.
+Describes the segments of the sender and of the modules to its right, so that groups of the receiver can extend into them.
+*/
+struct ChainToLeft {
+	int count;
+	ChainSegment segments[MAX_CHAIN_SEGMENTS - NUM_CHANNELS];
+};
+
 struct Stages : Module {
 	enum ParamIds {
 		ENUMS(SHAPE_PARAMS, NUM_CHANNELS),
@@ -140,19 +193,29 @@ struct Stages : Module {
 
 	stages::segment::Configuration configurations[NUM_CHANNELS];
 	bool configuration_changed[NUM_CHANNELS];
-	stages::SegmentGenerator segment_generator[NUM_CHANNELS];
+	/** One generator per group and polyphony channel. All channels share the group configuration. */
+	stages::SegmentGenerator segment_generator[16][NUM_CHANNELS];
 	float lightOscillatorPhase;
+	int polyChannels = 1;
 
 	// Buttons
 	LongPressButton typeButtons[NUM_CHANNELS];
 
 	// Buffers
-	float envelopeBuffer[NUM_CHANNELS][BLOCK_SIZE] = {};
-	stmlib::GateFlags last_gate_flags[NUM_CHANNELS] = {};
-	stmlib::GateFlags gate_flags[NUM_CHANNELS][BLOCK_SIZE] = {};
+	float envelopeBuffer[16][NUM_CHANNELS][BLOCK_SIZE] = {};
+	stmlib::GateFlags last_gate_flags[16][NUM_CHANNELS] = {};
+	stmlib::GateFlags gate_flags[16][NUM_CHANNELS][BLOCK_SIZE] = {};
 	int blockIndex = 0;
 	GroupBuilder groupBuilder;
 
+	// Chaining
+	/** Segments of the modules to the right, as of the last configuration */
+	stages::segment::Configuration remoteConfigurations[MAX_CHAIN_SEGMENTS - NUM_CHANNELS] = {};
+	bool remoteGated[MAX_CHAIN_SEGMENTS - NUM_CHANNELS] = {};
+	int remoteCount = 0;
+	/** Position of each looping local segment in its group, counting from 1, or 0 if not looping */
+	int loopOrdinals[NUM_CHANNELS] = {};
+
 	Stages() {
 		config(NUM_PARAMS, NUM_INPUTS, NUM_OUTPUTS, NUM_LIGHTS);
 		for (int c = 0; c < NUM_CHANNELS; c++) {
@@ -164,12 +227,27 @@ struct Stages : Module {
 			configOutput(ENVELOPE_OUTPUTS + c, string::f("Stage %d envelope", c + 1));
 		}
 
+		// Adjacent Stages modules exchange their state once per block
+		leftExpander.producerMessage = new ChainToRight();
+		leftExpander.consumerMessage = new ChainToRight();
+		rightExpander.producerMessage = new ChainToLeft();
+		rightExpander.consumerMessage = new ChainToLeft();
+
 		onReset();
 	}
 
+	~Stages() {
+		delete (ChainToRight*) leftExpander.producerMessage;
+		delete (ChainToRight*) leftExpander.consumerMessage;
+		delete (ChainToLeft*) rightExpander.producerMessage;
+		delete (ChainToLeft*) rightExpander.consumerMessage;
+	}
+
 	void onReset() override {
 		for (size_t i = 0; i < NUM_CHANNELS; ++i) {
-			segment_generator[i].Init();
+			for (int c = 0; c < 16; c++) {
+				segment_generator[c][i].Init();
+			}
 
 			configurations[i].type = stages::segment::TYPE_RAMP;
 			configurations[i].loop = false;
@@ -218,67 +296,188 @@ struct Stages : Module {
 	}
 
 	void stepBlock() {
-		// Get parameters
-		float primaries[NUM_CHANNELS];
-		float secondaries[NUM_CHANNELS];
+		// Receive the state of the neighbors as of their last block
+		Module* leftModule = leftExpander.module;
+		Module* rightModule = rightExpander.module;
+		bool chainedLeft = leftModule && leftModule->model == modelStages;
+		bool chainedRight = rightModule && rightModule->model == modelStages;
+		const ChainToRight* fromLeft = chainedLeft ? (const ChainToRight*) leftExpander.consumerMessage : NULL;
+		const ChainToLeft* fromRight = chainedRight ? (const ChainToLeft*) rightExpander.consumerMessage : NULL;
+		bool leftOpen = fromLeft && fromLeft->open;
+
+		// Get parameters of the local segments, followed by those of the modules to the right
+		int chainCount = NUM_CHANNELS + (fromRight ? fromRight->count : 0);
+		float primaries[16][NUM_CHANNELS];
+		float secondaries[MAX_CHAIN_SEGMENTS];
+		bool gated[MAX_CHAIN_SEGMENTS];
+		stages::segment::Configuration chainConfigurations[MAX_CHAIN_SEGMENTS];
 		for (int i = 0; i < NUM_CHANNELS; i++) {
-			primaries[i] = clamp(params[LEVEL_PARAMS + i].getValue() + inputs[LEVEL_INPUTS + i].getVoltage() / 8.f, 0.f, 1.f);
+			for (int c = 0; c < 16; c++) {
+				primaries[c][i] = clamp(params[LEVEL_PARAMS + i].getValue() + inputs[LEVEL_INPUTS + i].getPolyVoltage(c) / 8.f, 0.f, 1.f);
+			}
 			secondaries[i] = params[SHAPE_PARAMS + i].getValue();
+			gated[i] = inputs[GATE_INPUTS + i].isConnected();
+			chainConfigurations[i] = configurations[i];
 		}
+		bool remoteChanged = (chainCount - NUM_CHANNELS != remoteCount);
+		remoteCount = chainCount - NUM_CHANNELS;
+		for (int i = NUM_CHANNELS; i < chainCount; i++) {
+			const ChainSegment& segment = fromRight->segments[i - NUM_CHANNELS];
+			secondaries[i] = segment.secondary;
+			gated[i] = segment.gated;
+			chainConfigurations[i] = segment.configuration;
+			stages::segment::Configuration& last = remoteConfigurations[i - NUM_CHANNELS];
+			if (segment.configuration.type != last.type || segment.configuration.loop != last.loop || segment.gated != remoteGated[i - NUM_CHANNELS]) {
+				remoteChanged = true;
+			}
+			last = segment.configuration;
+			remoteGated[i - NUM_CHANNELS] = segment.gated;
+		}
+		auto primary = [&](int c, int segment) {
+			return (segment < NUM_CHANNELS) ? primaries[c][segment] : fromRight->segments[segment - NUM_CHANNELS].primary[c];
+		};
 
 		// See if the group associations have changed since the last group
-		bool groups_changed = groupBuilder.buildGroups(&inputs, GATE_INPUTS, NUM_CHANNELS);
+		bool groups_changed = groupBuilder.buildGroups(gated, chainCount, leftOpen);
 
 		// Process block
-		stages::SegmentGenerator::Output out[BLOCK_SIZE] = {};
+		stages::SegmentGenerator::Output out[16][BLOCK_SIZE] = {};
+		stages::SegmentGenerator* generators[16];
+		const stmlib::GateFlags* channelGateFlags[16];
+		stages::SegmentGenerator::Output* channelOut[16];
+		ChainToRight toRight = {};
 		for (int i = 0; i < groupBuilder.groupCount; i++) {
 			GroupInfo& group = groupBuilder.groups[i];
+			int localCount = std::min(group.segment_count, NUM_CHANNELS - group.first_segment);
 
 			// Check if the config needs applying to the segment generator for this group
 			bool apply_config = groups_changed;
+			if (group.segment_count > localCount)
+				apply_config |= remoteChanged;
 			int numberOfLoopsInGroup = 0;
 			for (int j = 0; j < group.segment_count; j++) {
 				int segment = group.first_segment + j;
-				numberOfLoopsInGroup += configurations[segment].loop ? 1 : 0;
-				apply_config |= configuration_changed[segment];
-				configuration_changed[segment] = false;
+				numberOfLoopsInGroup += chainConfigurations[segment].loop ? 1 : 0;
+				if (segment < NUM_CHANNELS) {
+					apply_config |= configuration_changed[segment];
+					configuration_changed[segment] = false;
+				}
 			}
 
 			if (numberOfLoopsInGroup > 2) {
-				// Too many segments are looping, turn them all off
-				apply_config = true;
+				// Too many segments are looping, turn them all off.
+				// Segments of the modules to the right keep their setting but are configured without a loop.
 				for (int j = 0; j < group.segment_count; j++) {
-					configurations[group.first_segment + j].loop = false;
+					int segment = group.first_segment + j;
+					chainConfigurations[segment].loop = false;
+					if (segment < NUM_CHANNELS && configurations[segment].loop) {
+						configurations[segment].loop = false;
+						apply_config = true;
+					}
 				}
 			}
 
 			if (apply_config) {
-				segment_generator[i].Configure(group.gated, &configurations[group.first_segment], group.segment_count);
+				// Configure inactive channels too, so they are ready when the channel count grows
+				for (int c = 0; c < 16; c++) {
+					segment_generator[c][i].Configure(group.gated, &chainConfigurations[group.first_segment], group.segment_count);
+				}
 			}
 
-			// Set the segment parameters on the generator we're about to process
-			for (int j = 0; j < group.segment_count; j++) {
-				segment_generator[i].set_segment_parameters(j, primaries[group.first_segment + j], secondaries[group.first_segment + j]);
+			for (int c = 0; c < polyChannels; c++) {
+				// Set the segment parameters on the generator we're about to process
+				for (int j = 0; j < group.segment_count; j++) {
+					int segment = group.first_segment + j;
+					segment_generator[c][i].set_segment_parameters(j, primary(c, segment), secondaries[segment]);
+				}
+				generators[c] = &segment_generator[c][i];
+				channelGateFlags[c] = gate_flags[c][group.first_segment];
+				channelOut[c] = out[c];
 			}
 
-			segment_generator[i].Process(gate_flags[group.first_segment], out, BLOCK_SIZE);
+			// Multi-segment envelopes are evaluated four channels at a time
+			stages::SegmentGenerator::ProcessChannels(generators, channelGateFlags, channelOut, polyChannels, BLOCK_SIZE);
 
-			for (int j = 0; j < BLOCK_SIZE; j++) {
-				for (int k = 1; k < group.segment_count; k++) {
-					int segment = group.first_segment + k;
-					if (k == out[j].segment) {
-						// Set the phase output for the active segment
-						envelopeBuffer[segment][j] = 1.f - out[j].phase;
+			for (int c = 0; c < polyChannels; c++) {
+				for (int j = 0; j < BLOCK_SIZE; j++) {
+					for (int k = 1; k < localCount; k++) {
+						int segment = group.first_segment + k;
+						if (k == out[c][j].segment) {
+							// Set the phase output for the active segment
+							envelopeBuffer[c][segment][j] = 1.f - out[c][j].phase;
+						}
+						else {
+							// Non active segments have 0.f output
+							envelopeBuffer[c][segment][j] = 0.f;
+						}
 					}
-					else {
-						// Non active segments have 0.f output
-						envelopeBuffer[segment][j] = 0.f;
+					// First group segment gets the actual output
+					envelopeBuffer[c][group.first_segment][j] = out[c][j].value;
+				}
+			}
+
+			int loopOrdinal = 0;
+			for (int k = 0; k < localCount; k++) {
+				int segment = group.first_segment + k;
+				loopOrdinal += configurations[segment].loop ? 1 : 0;
+				loopOrdinals[segment] = configurations[segment].loop ? loopOrdinal : 0;
+			}
+
+			// A gated group reaching the right edge continues in the module to the right
+			if (group.gated && group.first_segment + localCount == NUM_CHANNELS) {
+				toRight.open = true;
+				toRight.segmentOffset = localCount;
+				toRight.loopCount = loopOrdinal;
+				toRight.channels = polyChannels;
+				for (int c = 0; c < polyChannels; c++) {
+					for (int j = 0; j < BLOCK_SIZE; j++) {
+						toRight.segment[c][j] = out[c][j].segment;
+						toRight.phase[c][j] = out[c][j].phase;
 					}
 				}
-				// First group segment gets the actual output
-				envelopeBuffer[group.first_segment][j] = out[j].value;
 			}
 		}
+
+		// Leading segments continuing the group of the module to the left output its phase
+		int slaveCount = leftOpen ? groupBuilder.slaveCount : 0;
+		int loopOrdinal = leftOpen ? fromLeft->loopCount : 0;
+		for (int k = 0; k < slaveCount; k++) {
+			int groupSegment = fromLeft->segmentOffset + k;
+			for (int c = 0; c < polyChannels; c++) {
+				for (int j = 0; j < BLOCK_SIZE; j++) {
+					bool active = (c < fromLeft->channels) && (fromLeft->segment[c][j] == groupSegment);
+					envelopeBuffer[c][k][j] = active ? 1.f - fromLeft->phase[c][j] : 0.f;
+				}
+			}
+			loopOrdinal += configurations[k].loop ? 1 : 0;
+			loopOrdinals[k] = configurations[k].loop ? loopOrdinal : 0;
+		}
+		if (leftOpen && slaveCount == NUM_CHANNELS) {
+			// The group of the module to the left runs through this module
+			toRight = *fromLeft;
+			toRight.segmentOffset += NUM_CHANNELS;
+			toRight.loopCount = loopOrdinal;
+		}
+
+		// Send the state of this block to the neighbors
+		if (chainedRight) {
+			*((ChainToRight*) rightModule->leftExpander.producerMessage) = toRight;
+			rightModule->leftExpander.requestMessageFlip();
+		}
+		if (chainedLeft) {
+			ChainToLeft* toLeft = (ChainToLeft*) leftModule->rightExpander.producerMessage;
+			toLeft->count = std::min(chainCount, MAX_CHAIN_SEGMENTS - NUM_CHANNELS);
+			for (int i = 0; i < toLeft->count; i++) {
+				ChainSegment& segment = toLeft->segments[i];
+				segment.configuration = chainConfigurations[i];
+				segment.gated = gated[i];
+				segment.secondary = secondaries[i];
+				for (int c = 0; c < 16; c++) {
+					segment.primary[c] = primary(c, i);
+				}
+			}
+			leftModule->rightExpander.requestMessageFlip();
+		}
 	}
 
 	void toggleMode(int i) {
@@ -292,29 +491,27 @@ struct Stages : Module {
 
 		// ensure that we don't have too many looping segments in the group
 		if (configurations[segment].loop) {
-			int segment_count = 0;
 			for (int i = 0; i < groupBuilder.groupCount; i++) {
-				segment_count += groupBuilder.groups[i].segment_count;
+				GroupInfo& group = groupBuilder.groups[i];
+				if (segment < group.first_segment || segment >= group.first_segment + group.segment_count)
+					continue;
 
-				if (segment_count > segment) {
-					GroupInfo& group = groupBuilder.groups[i];
+				// See how many loop items we have, in this module
+				int localCount = std::min(group.segment_count, NUM_CHANNELS - group.first_segment);
+				int numberOfLoopsInGroup = 0;
 
-					// See how many loop items we have
-					int numberOfLoopsInGroup = 0;
-
-					for (int j = 0; j < group.segment_count; j++) {
-						numberOfLoopsInGroup += configurations[group.first_segment + j].loop ? 1 : 0;
-					}
+				for (int j = 0; j < localCount; j++) {
+					numberOfLoopsInGroup += configurations[group.first_segment + j].loop ? 1 : 0;
+				}
 
-					// If we've got too many loop items, clear down to the one looping segment
-					if (numberOfLoopsInGroup > 2) {
-						for (int j = 0; j < group.segment_count; j++) {
-							configurations[group.first_segment + j].loop = (group.first_segment + j) == segment;
-						}
+				// If we've got too many loop items, clear down to the one looping segment
+				if (numberOfLoopsInGroup > 2) {
+					for (int j = 0; j < localCount; j++) {
+						configurations[group.first_segment + j].loop = (group.first_segment + j) == segment;
 					}
-
-					break;
 				}
+
+				break;
 			}
 		}
 	}
@@ -335,11 +532,22 @@ struct Stages : Module {
 			}
 		}
 
+		// Polyphony is set by the gate and level inputs, and only changes between blocks
+		if (blockIndex == 0) {
+			polyChannels = 1;
+			for (int i = 0; i < NUM_CHANNELS; i++) {
+				polyChannels = std::max(polyChannels, inputs[GATE_INPUTS + i].getChannels());
+				polyChannels = std::max(polyChannels, inputs[LEVEL_INPUTS + i].getChannels());
+			}
+		}
+
 		// Input
 		for (int i = 0; i < NUM_CHANNELS; i++) {
-			bool gate = (inputs[GATE_INPUTS + i].getVoltage() >= 1.7f);
-			last_gate_flags[i] = stmlib::ExtractGateFlags(last_gate_flags[i], gate);
-			gate_flags[i][blockIndex] = last_gate_flags[i];
+			for (int c = 0; c < polyChannels; c++) {
+				bool gate = (inputs[GATE_INPUTS + i].getPolyVoltage(c) >= 1.7f);
+				last_gate_flags[c][i] = stmlib::ExtractGateFlags(last_gate_flags[c][i], gate);
+				gate_flags[c][i][blockIndex] = last_gate_flags[c][i];
+			}
 		}
 
 		// Process block
@@ -349,34 +557,30 @@ struct Stages : Module {
 		}
 
 		// Output
-		for (int i = 0; i < groupBuilder.groupCount; i++) {
-			GroupInfo& group = groupBuilder.groups[i];
-
-			int numberOfLoopsInGroup = 0;
-			for (int j = 0; j < group.segment_count; j++) {
-				int segment = group.first_segment + j;
-
-				float envelope = envelopeBuffer[segment][blockIndex];
-				outputs[ENVELOPE_OUTPUTS + segment].setVoltage(envelope * 8.f);
-				lights[ENVELOPE_LIGHTS + segment].setSmoothBrightness(envelope, args.sampleTime);
-
-				numberOfLoopsInGroup += configurations[segment].loop ? 1 : 0;
-				float flashlevel = 1.f;
+		for (int segment = 0; segment < NUM_CHANNELS; segment++) {
+			for (int c = 0; c < polyChannels; c++) {
+				outputs[ENVELOPE_OUTPUTS + segment].setVoltage(envelopeBuffer[c][segment][blockIndex] * 8.f, c);
+			}
+			outputs[ENVELOPE_OUTPUTS + segment].setChannels(polyChannels);
+			// Lights follow the first channel
+			float envelope = envelopeBuffer[0][segment][blockIndex];
+			lights[ENVELOPE_LIGHTS + segment].setSmoothBrightness(envelope, args.sampleTime);
 
-				if (configurations[segment].loop && numberOfLoopsInGroup == 1) {
-					flashlevel = abs(sinf(2.0f * M_PI * lightOscillatorPhase));
-				}
-				else if (configurations[segment].loop && numberOfLoopsInGroup > 1) {
-					float advancedPhase = lightOscillatorPhase + 0.25f;
-					if (advancedPhase > 1.0f)
-						advancedPhase -= 1.0f;
+			float flashlevel = 1.f;
 
-					flashlevel = abs(sinf(2.0f * M_PI * advancedPhase));
-				}
+			if (configurations[segment].loop && loopOrdinals[segment] == 1) {
+				flashlevel = abs(sinf(2.0f * M_PI * lightOscillatorPhase));
+			}
+			else if (configurations[segment].loop && loopOrdinals[segment] > 1) {
+				float advancedPhase = lightOscillatorPhase + 0.25f;
+				if (advancedPhase > 1.0f)
+					advancedPhase -= 1.0f;
 
-				lights[TYPE_LIGHTS + segment * 2 + 0].setBrightness((configurations[segment].type == 0 || configurations[segment].type == 1) * flashlevel);
-				lights[TYPE_LIGHTS + segment * 2 + 1].setBrightness((configurations[segment].type == 1 || configurations[segment].type == 2) * flashlevel);
+				flashlevel = abs(sinf(2.0f * M_PI * advancedPhase));
 			}
+
+			lights[TYPE_LIGHTS + segment * 2 + 0].setBrightness((configurations[segment].type == 0 || configurations[segment].type == 1) * flashlevel);
+			lights[TYPE_LIGHTS + segment * 2 + 1].setBrightness((configurations[segment].type == 1 || configurations[segment].type == 2) * flashlevel);
 		}
 	}
 };
@@ -108,8 +108,7 @@ struct Streams : Module {
 	};
 
 	streams::StreamsEngine engines[PORT_MAX_CHANNELS];
-	int prevNumChannels;
-	float brightnesses[NUM_LIGHTS][PORT_MAX_CHANNELS];
+	streams::StreamsUi ui;
 
 	Streams() {
 		config(NUM_PARAMS, NUM_INPUTS, NUM_OUTPUTS, NUM_LIGHTS);
@@ -148,7 +147,7 @@ struct Streams : Module {
 			engines[c].Reset();
 		}
 
-		prevNumChannels = 1;
+		ui.Reset(engines, PORT_MAX_CHANNELS);
 		onSampleRateChange();
 	}
 
@@ -158,10 +157,12 @@ struct Streams : Module {
 		for (int c = 0; c < PORT_MAX_CHANNELS; c++) {
 			engines[c].SetSampleRate(sampleRate);
 		}
+
+		ui.SetSampleRate(sampleRate);
 	}
 
 	json_t* dataToJson() override {
-		streams::UiSettings settings = engines[0].ui_settings();
+		streams::UiSettings settings = ui.ui_settings();
 		json_t* rootJ = json_object();
 		json_object_set_new(rootJ, "function1",    json_integer(settings.function[0]));
 		json_object_set_new(rootJ, "function2",    json_integer(settings.function[1]));
@@ -195,28 +196,22 @@ struct Streams : Module {
 		if (linkedJ)
 			settings.linked       = json_integer_value(linkedJ);
 
-		for (int c = 0; c < PORT_MAX_CHANNELS; c++) {
-			engines[c].ApplySettings(settings);
-		}
+		ui.ApplySettings(settings);
 	}
 
 	void onRandomize() override {
-		for (int c = 0; c < PORT_MAX_CHANNELS; c++) {
-			engines[c].Randomize();
-		}
+		ui.Randomize();
 	}
 
 	void setLinked(bool linked) {
-		streams::UiSettings settings = engines[0].ui_settings();
+		streams::UiSettings settings = ui.ui_settings();
 		settings.linked = linked;
 
-		for (int c = 0; c < PORT_MAX_CHANNELS; c++) {
-			engines[c].ApplySettings(settings);
-		}
+		ui.ApplySettings(settings);
 	}
 
 	int getChannelMode(int channel) {
-		streams::UiSettings settings = engines[0].ui_settings();
+		streams::UiSettings settings = ui.ui_settings();
 		// Search channel mode index in table
 		for (int i = 0; i < streams::kNumChannelModes; i++) {
 			if (settings.function[channel] == streams::kChannelModeTable[i].function
@@ -227,62 +222,63 @@ struct Streams : Module {
 	}
 
 	void setChannelMode(int channel, int mode_id) {
-		streams::UiSettings settings = engines[0].ui_settings();
+		streams::UiSettings settings = ui.ui_settings();
 		settings.function[channel] = streams::kChannelModeTable[mode_id].function;
 		settings.alternate[channel] = streams::kChannelModeTable[mode_id].alternate;
 
-		for (int c = 0; c < PORT_MAX_CHANNELS; c++) {
-			engines[c].ApplySettings(settings);
-		}
+		ui.ApplySettings(settings);
 	}
 
 	void setMonitorMode(int mode_id) {
-		streams::UiSettings settings = engines[0].ui_settings();
+		streams::UiSettings settings = ui.ui_settings();
 		settings.monitor_mode = streams::kMonitorModeTable[mode_id].mode;
 
-		for (int c = 0; c < PORT_MAX_CHANNELS; c++) {
-			engines[c].ApplySettings(settings);
-		}
+		ui.ApplySettings(settings);
 	}
 
 	int function(int channel) {
-		return engines[0].ui_settings().function[channel];
+		return ui.ui_settings().function[channel];
 	}
 
 	int alternate(int channel) {
-		return engines[0].ui_settings().alternate[channel];
+		return ui.ui_settings().alternate[channel];
 	}
 
 	bool linked() {
-		return engines[0].ui_settings().linked;
+		return ui.ui_settings().linked;
 	}
 
 	int monitorMode() {
-		return engines[0].ui_settings().monitor_mode;
+		return ui.ui_settings().monitor_mode;
 	}
 
 	void process(const ProcessArgs& args) override {
 		int numChannels = std::max(inputs[CH1_SIGNAL_INPUT].getChannels(), inputs[CH2_SIGNAL_INPUT].getChannels());
 		numChannels = std::max(numChannels, 1);
 
-		if (numChannels > prevNumChannels) {
-			for (int c = prevNumChannels; c < numChannels; c++) {
-				engines[c].SyncUI(engines[0]);
-			}
-		}
+		// The buttons, pots and settings are shared by every channel, so the UI
+		// runs once before the channels' engines.
+		ui.SetNumVoices(numChannels);
+
+		streams::StreamsUi::Frame uiFrame = {};
+
+		uiFrame.ch1.shape_knob      = params[CH1_SHAPE_PARAM].getValue();
+		uiFrame.ch1.mod_knob        = params[CH1_MOD_PARAM]  .getValue();
+		uiFrame.ch2.shape_knob      = params[CH2_SHAPE_PARAM].getValue();
+		uiFrame.ch2.mod_knob        = params[CH2_MOD_PARAM]  .getValue();
 
-		prevNumChannels = numChannels;
+		uiFrame.ch1.function_button = params[CH1_FUNCTION_BUTTON_PARAM].getValue();
+		uiFrame.ch2.function_button = params[CH2_FUNCTION_BUTTON_PARAM].getValue();
+		uiFrame.metering_button     = params[METERING_BUTTON_PARAM].getValue();
+
+		ui.Process(uiFrame);
 
 		// Reuse the same frame object for multiple engines because the params
 		// aren't touched.
 		streams::StreamsEngine::Frame frame = {};
 
-		frame.ch1.shape_knob          = params[CH1_SHAPE_PARAM]    .getValue();
-		frame.ch1.mod_knob            = params[CH1_MOD_PARAM]      .getValue();
 		frame.ch1.level_mod_knob      = params[CH1_LEVEL_MOD_PARAM].getValue();
 		frame.ch1.response_knob       = params[CH1_RESPONSE_PARAM] .getValue();
-		frame.ch2.shape_knob          = params[CH2_SHAPE_PARAM]    .getValue();
-		frame.ch2.mod_knob            = params[CH2_MOD_PARAM]      .getValue();
 		frame.ch2.level_mod_knob      = params[CH2_LEVEL_MOD_PARAM].getValue();
 		frame.ch2.response_knob       = params[CH2_RESPONSE_PARAM] .getValue();
 
@@ -291,12 +287,6 @@ struct Streams : Module {
 		frame.ch2.signal_in_connected = inputs[CH2_SIGNAL_INPUT].isConnected();
 		frame.ch2.level_cv_connected  = inputs[CH2_LEVEL_INPUT] .isConnected();
 
-		frame.ch1.function_button     = params[CH1_FUNCTION_BUTTON_PARAM].getValue();
-		frame.ch2.function_button     = params[CH2_FUNCTION_BUTTON_PARAM].getValue();
-		frame.metering_button         = params[METERING_BUTTON_PARAM].getValue();
-
-		bool lights_updated = false;
-
 		for (int c = 0; c < numChannels; c++) {
 			frame.ch1.excite_in = inputs[CH1_EXCITE_INPUT].getPolyVoltage(c);
 			frame.ch1.signal_in = inputs[CH1_SIGNAL_INPUT].getPolyVoltage(c);
@@ -309,42 +299,17 @@ struct Streams : Module {
 
 			outputs[CH1_SIGNAL_OUTPUT].setVoltage(frame.ch1.signal_out, c);
 			outputs[CH2_SIGNAL_OUTPUT].setVoltage(frame.ch2.signal_out, c);
-
-			if (frame.lights_updated) {
-				brightnesses[CH1_LIGHT_1_G][c] = frame.ch1.led_green[0];
-				brightnesses[CH1_LIGHT_2_G][c] = frame.ch1.led_green[1];
-				brightnesses[CH1_LIGHT_3_G][c] = frame.ch1.led_green[2];
-				brightnesses[CH1_LIGHT_4_G][c] = frame.ch1.led_green[3];
-				brightnesses[CH1_LIGHT_1_R][c] = frame.ch1.led_red[0];
-				brightnesses[CH1_LIGHT_2_R][c] = frame.ch1.led_red[1];
-				brightnesses[CH1_LIGHT_3_R][c] = frame.ch1.led_red[2];
-				brightnesses[CH1_LIGHT_4_R][c] = frame.ch1.led_red[3];
-				brightnesses[CH2_LIGHT_1_G][c] = frame.ch2.led_green[0];
-				brightnesses[CH2_LIGHT_2_G][c] = frame.ch2.led_green[1];
-				brightnesses[CH2_LIGHT_3_G][c] = frame.ch2.led_green[2];
-				brightnesses[CH2_LIGHT_4_G][c] = frame.ch2.led_green[3];
-				brightnesses[CH2_LIGHT_1_R][c] = frame.ch2.led_red[0];
-				brightnesses[CH2_LIGHT_2_R][c] = frame.ch2.led_red[1];
-				brightnesses[CH2_LIGHT_3_R][c] = frame.ch2.led_red[2];
-				brightnesses[CH2_LIGHT_4_R][c] = frame.ch2.led_red[3];
-			}
-
-			lights_updated |= frame.lights_updated;
 		}
 
 		outputs[CH1_SIGNAL_OUTPUT].setChannels(numChannels);
 		outputs[CH2_SIGNAL_OUTPUT].setChannels(numChannels);
 
-		if (lights_updated) {
-			// Drive lights according to maximum brightness across engines
-			for (int i = 0; i < NUM_LIGHTS; i++) {
-				float brightness = 0.f;
-
-				for (int c = 0; c < numChannels; c++) {
-					brightness = std::max(brightnesses[i][c], brightness);
-				}
-
-				lights[i].setBrightness(brightness);
+		if (uiFrame.lights_updated) {
+			for (int i = 0; i < 4; i++) {
+				lights[CH1_LIGHT_1_G + 2 * i].setBrightness(uiFrame.ch1.led_green[i]);
+				lights[CH1_LIGHT_1_R + 2 * i].setBrightness(uiFrame.ch1.led_red[i]);
+				lights[CH2_LIGHT_1_G + 2 * i].setBrightness(uiFrame.ch2.led_green[i]);
+				lights[CH2_LIGHT_1_R + 2 * i].setBrightness(uiFrame.ch2.led_red[i]);
 			}
 		}
 	}
@@ -95,43 +95,63 @@ public:
         auto response   = float_4(frame.ch1.response_knob,
                                   frame.ch2.response_knob, 0.f, 0.f);
 
-        float_4 output;
         float timestep = sample_time_ / oversampling_;
 
+        // Upsample and apply anti-aliasing filters. The filters don't depend
+        // on the VCAs, so run each of them over the whole oversampled frame.
+        float_4 a_up[kMaxOversamplingFactor];
+        float_4 d_up[kMaxOversamplingFactor];
+        float_4 down[kMaxOversamplingFactor];
+        up_filter_[0].ProcessUpsample(
+            a_inputs * oversampling_, a_up, oversampling_);
+        up_filter_[1].ProcessUpsample(
+            d_inputs * oversampling_, d_up, oversampling_);
+
         for (int i = 0; i < oversampling_; i++)
         {
-            // Upsample and apply anti-aliasing filters
-            a_inputs = up_filter_[0].Process(
-                (i == 0) ? (a_inputs * oversampling_) : 0.f);
-            d_inputs = up_filter_[1].Process(
-                (i == 0) ? (d_inputs * oversampling_) : 0.f);
-
-            rc_lpf_.process(d_inputs);
+            a_inputs = a_up[i];
+            rc_lpf_.process(d_up[i]);
             d_inputs = rc_lpf_.lowpass();
 
             float_4 signal_in = a_inputs;
             float_4 level_cv = _mm_movehl_ps(a_inputs.v, a_inputs.v);
             float_4 dac_cv = d_inputs;
-            auto level = CalculateLevel(dac_cv, level_cv, level_mod, response);
-            signal_in *= level;
+            float_4 base;
+            auto level_exponent = CalculateLevelExponent(
+                dac_cv, level_cv, level_mod, response, &base);
 
             float_4 pwm_cv = _mm_movehl_ps(d_inputs.v, d_inputs.v);
             pwm_cv *= kPWMCVInputR / (kPWMCVInputR + kPWMCVOutputR);
-            auto rad_per_s = -PinVoltageToLevel(pwm_cv) / kFilterCoreRC;
+            auto pwm_exponent = PinVoltageToLevelExponent(pwm_cv);
+
+            // Only the lower two lanes of each exponent are used, so pack
+            // them together and share a single exp() between the level and
+            // the VCF control.
+            auto exponent = float_4(
+                _mm_movelh_ps(level_exponent.v, pwm_exponent.v));
+            exponent = simd::exp(exponent);
+
+            auto level = simd::ifelse(base > 0.f, exponent, 0.f);
+            level = simd::fmin(level, kVCAMaxLevel);
+            signal_in *= level;
+
+            float_4 pwm_level = _mm_movehl_ps(exponent.v, exponent.v);
+            auto rad_per_s = -pwm_level / kFilterCoreRC;
 
             // Solve each VCF cell using the backward Euler method.
             float_4 v_in = _mm_movelh_ps(signal_in.v, v_out_.v);
             v_out_ = (v_in + v_out_) * simd::exp(rad_per_s * timestep) - v_in;
             v_out_ = simd::clamp(v_out_, -kClampVoltage, kClampVoltage);
 
-            // Pre-downsample anti-alias filtering
-            // output will contain the lower two elements from level and the
+            // down will contain the lower two elements from level and the
             // upper two elements from v_out_
-            output =
+            down[i] =
                 _mm_shuffle_ps(level.v, v_out_.v, _MM_SHUFFLE(3, 2, 1, 0));
-            output = down_filter_.Process(output);
         }
 
+        // Pre-downsample anti-alias filtering
+        float_4 output = down_filter_.ProcessDownsample(down, oversampling_);
+
         frame.ch1.signal_out = output[2];
         frame.ch2.signal_out = output[3];
 
@@ -152,11 +172,12 @@ protected:
     dsp::TRCFilter<float_4> rc_lpf_;
     float_4 v_out_;
 
-    // Calculate level from the VCA control pin voltage
+    // Calculate the exponent of the level from the VCA control pin voltage,
+    // such that level = exp(exponent)
     template <typename T>
-    T PinVoltageToLevel(T v_control)
+    T PinVoltageToLevelExponent(T v_control)
     {
-        return simd::pow(10.f, v_control / (kVCAGainConstant * 20.f));
+        return v_control / (kVCAGainConstant * 20.f) * std::log(10.f);
     }
 
     // Calculate VCA control pin voltage from level
@@ -167,9 +188,12 @@ protected:
         return simd::ifelse(level > 0.f, volts, kClampVoltage);
     }
 
-    // Calculate level from the CV inputs and pots
+    // Calculate the exponent of the level from the CV inputs and pots, such
+    // that level = min(exp(exponent), kVCAMaxLevel) where base > 0, and
+    // level = 0 elsewhere
     template <typename T>
-    T CalculateLevel(T dac_cv, T level_cv, T level_mod, T response)
+    T CalculateLevelExponent(T dac_cv, T level_cv, T level_mod, T response,
+        T* base)
     {
         T power = (kLevelResponseMinR + kLevelResponsePotR) /
                   (kLevelResponseMinR + (kLevelResponsePotR * response));
@@ -178,10 +202,8 @@ protected:
         T i_dac = dac_cv / (kDACCVOutputR + kDACCVInputR);
         T i_in = i_level + i_dac + kVCAOffsetI;
 
-        T base = -i_in / kLevelRefI;
-        T level = simd::pow(base, power);
-        level = simd::ifelse(base > 0.f, level, 0.f);
-        return simd::fmin(level, kVCAMaxLevel);
+        *base = -i_in / kLevelRefI;
+        return power * simd::log(*base);
     }
 
     // The 2164's gain constant is -33mV/dB
@@ -27,6 +27,8 @@ namespace streams
 
 using namespace rack;
 
+// Per-voice DSP: the two processors, fed by this voice's ADC samples. The
+// settings of the processors are set by a DigitalUi shared by every voice.
 class DigitalEngine
 {
 public:
@@ -35,14 +37,6 @@ public:
     template <int block_size>
     struct ChannelFrame
     {
-        // Parameters
-        float shape_knob;
-        float mod_knob;
-        float level_mod_knob;
-        float response_knob;
-
-        bool function_button;
-
         // Inputs
         float excite_in[block_size];
         float signal_in[block_size];
@@ -51,10 +45,6 @@ public:
         // Outputs
         float dac_out[block_size];
         float pwm_out[block_size];
-
-        // Lights
-        float led_green[4];
-        float led_red[4];
     };
 
     template <int block_size>
@@ -62,7 +52,6 @@ public:
     {
         ChannelFrame<block_size> ch1;
         ChannelFrame<block_size> ch2;
-        bool metering_button;
     };
 
     DigitalEngine()
@@ -76,62 +65,23 @@ public:
         cv_scaler_.Init(&adc_);
         processor_[0].Init(0);
         processor_[1].Init(1);
-        ui_.Init(&adc_, &cv_scaler_, &processor_[0]);
         pwm_value_[0] = 0;
         pwm_value_[1] = 0;
-
-        for (int i = 0; i < 4; i++)
-        {
-            led_lpf_[i].reset();
-            led_lpf_[i].setLambda(kLambdaLEDs);
-        }
     }
 
-    const UiSettings& ui_settings(void)
+    Processor* processors(void)
     {
-        return ui_.settings();
+        return processor_;
     }
 
-    void ApplySettings(const UiSettings& settings)
+    const CvScaler* cv_scaler(void) const
     {
-        ui_.ApplySettings(settings);
-    }
-
-    void SyncUI(const DigitalEngine& other)
-    {
-        ui_.SyncUI(other.ui_);
-
-        for (int i = 0; i < 4; i++)
-        {
-            led_lpf_[i].reset();
-        }
-    }
-
-    void Randomize(void)
-    {
-        UiSettings settings;
-
-        settings.alternate[0] = random::u32() & 1;
-        settings.alternate[1] = random::u32() & 1;
-        int modulus0 = (settings.alternate[0]) ?
-            1 + PROCESSOR_FUNCTION_FILTER_CONTROLLER :
-            1 + PROCESSOR_FUNCTION_COMPRESSOR;
-        int modulus1 = (settings.alternate[1]) ?
-            1 + PROCESSOR_FUNCTION_FILTER_CONTROLLER :
-            1 + PROCESSOR_FUNCTION_COMPRESSOR;
-        settings.function[0]  = random::u32() % modulus0;
-        settings.function[1]  = random::u32() % modulus1;
-        settings.monitor_mode = ui_.settings().monitor_mode;
-        settings.linked       = false;
-
-        ApplySettings(settings);
+        return &cv_scaler_;
     }
 
     template <int block_size>
     void Process(Frame<block_size>& frame)
     {
-        ProcessUI(frame);
-
         for (int i = 0; i < block_size; i++)
         {
             float ch1_signal_adc = clamp(frame.ch1.signal_in[i], 0.f, kVdda);
@@ -175,19 +125,102 @@ public:
     }
 
 protected:
-    using float_4 = simd::float_4;
-
     AdcEmulator adc_;
     CvScaler cv_scaler_;
     Processor processor_[2];
-    Ui ui_;
     uint16_t pwm_value_[2];
-    dsp::TExponentialFilter<float_4> led_lpf_[4];
+
+    static constexpr float kVdda = 3.3f;
+    static constexpr int kPWMPeriod = 65535;
+    static constexpr float kDacVref = 2.5f;
+    static constexpr float kVoltsPerLSB = kDacVref / 65536.f;
+};
+
+// The buttons, pots, settings and LEDs. These are handled once per module and
+// apply to every voice.
+class DigitalUi
+{
+public:
+    struct ChannelFrame
+    {
+        // Parameters
+        float shape_knob;
+        float mod_knob;
+
+        bool function_button;
+
+        // Lights
+        float led_green[4];
+        float led_red[4];
+    };
+
+    struct Frame
+    {
+        ChannelFrame ch1;
+        ChannelFrame ch2;
+        bool metering_button;
+    };
+
+    DigitalUi() { }
+
+    void Reset(DigitalEngine* const* engines, int num_engines)
+    {
+        adc_.Init();
+        voices_.Init();
+
+        for (int i = 0; i < num_engines; i++)
+        {
+            voices_.Add(engines[i]->processors(), engines[i]->cv_scaler());
+        }
+
+        ui_.Init(&adc_, &voices_);
+
+        for (int i = 0; i < 4; i++)
+        {
+            led_lpf_[i].reset();
+            led_lpf_[i].setLambda(kLambdaLEDs);
+        }
+    }
+
+    void SetNumVoices(int num_voices)
+    {
+        ui_.SetNumVoices(num_voices);
+    }
+
+    const UiSettings& ui_settings(void)
+    {
+        return ui_.settings();
+    }
+
+    void ApplySettings(const UiSettings& settings)
+    {
+        ui_.ApplySettings(settings);
+    }
+
+    void Randomize(void)
+    {
+        UiSettings settings;
+
+        settings.alternate[0] = random::u32() & 1;
+        settings.alternate[1] = random::u32() & 1;
+        int modulus0 = (settings.alternate[0]) ?
+            1 + PROCESSOR_FUNCTION_FILTER_CONTROLLER :
+            1 + PROCESSOR_FUNCTION_COMPRESSOR;
+        int modulus1 = (settings.alternate[1]) ?
+            1 + PROCESSOR_FUNCTION_FILTER_CONTROLLER :
+            1 + PROCESSOR_FUNCTION_COMPRESSOR;
+        settings.function[0]  = random::u32() % modulus0;
+        settings.function[1]  = random::u32() % modulus1;
+        settings.monitor_mode = ui_.settings().monitor_mode;
+        settings.linked       = false;
+
+        ApplySettings(settings);
+    }
 
     template <int block_size>
-    void ProcessUI(Frame<block_size>& frame)
+    void Process(Frame& frame)
     {
-        float timestep = block_size * 1.f / kSampleRate;
+        float timestep = block_size * 1.f / DigitalEngine::kSampleRate;
 
         adc_.pots_[0] = std::round(0xFFFF * frame.ch1.shape_knob);
         adc_.pots_[1] = std::round(0xFFFF * frame.ch1.mod_knob);
@@ -217,11 +250,13 @@ protected:
         }
     }
 
-    static constexpr int kUiPollRate = 4000;
-    static constexpr float kVdda = 3.3f;
-    static constexpr int kPWMPeriod = 65535;
-    static constexpr float kDacVref = 2.5f;
-    static constexpr float kVoltsPerLSB = kDacVref / 65536.f;
+protected:
+    using float_4 = simd::float_4;
+
+    AdcEmulator adc_;
+    Voices voices_;
+    Ui ui_;
+    dsp::TExponentialFilter<float_4> led_lpf_[4];
 
     // The VU meter flickers when monitoring LEVEL or OUT when there is an
     // audio signal at the LEVEL input. Due to human persistence of vision,
@@ -230,7 +265,7 @@ protected:
     // due to the low UI refresh rate. We solve this by applying a lowpass
     // filter to the LED brightness. This lambda value is simply hand-tuned
     // to match hardware.
-    static constexpr float kLambdaLEDs = 1.5e-3 * kSampleRate;
+    static constexpr float kLambdaLEDs = 1.5e-3 * DigitalEngine::kSampleRate;
 };
 
 }
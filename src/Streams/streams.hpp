@@ -27,19 +27,16 @@ namespace streams
 
 using namespace rack;
 
+// A single voice of the module. The UI is handled separately by StreamsUi.
 class StreamsEngine
 {
 public:
     struct ChannelFrame
     {
         // Parameters
-        float shape_knob;
-        float mod_knob;
         float level_mod_knob;
         float response_knob;
 
-        bool function_button;
-
         // Inputs
         float excite_in;
         float signal_in;
@@ -50,18 +47,12 @@ public:
 
         // Outputs
         float signal_out;
-
-        // Lights
-        float led_green[4];
-        float led_red[4];
     };
 
     struct Frame
     {
         ChannelFrame ch1;
         ChannelFrame ch2;
-        bool metering_button;
-        bool lights_updated;
     };
 
     StreamsEngine()
@@ -87,30 +78,13 @@ public:
         analog_engine_.SetSampleRate(sample_rate);
     }
 
-    void Randomize(void)
+    DigitalEngine* digital_engine(void)
     {
-        digital_engine_.Randomize();
-    }
-
-    void ApplySettings(const UiSettings& settings)
-    {
-        digital_engine_.ApplySettings(settings);
-    }
-
-    const UiSettings& ui_settings(void)
-    {
-        return digital_engine_.ui_settings();
-    }
-
-    void SyncUI(const StreamsEngine& other)
-    {
-        digital_engine_.SyncUI(other.digital_engine_);
+        return &digital_engine_;
     }
 
     void Process(Frame& frame)
     {
-        frame.lights_updated = false;
-
         float ch1_signal_in = frame.ch1.signal_in_connected ?
                               frame.ch1.signal_in : kSignalInNormalV;
         float ch2_signal_in = frame.ch2.signal_in_connected ?
@@ -140,19 +114,6 @@ public:
         Rsmp::OutputFrame d_output = resampler_.Process(d_input,
         [&](Rsmp::OutputFrame* output, const Rsmp::InputFrame* input)
         {
-            d_frame.ch1.shape_knob          = frame.ch1.shape_knob;
-            d_frame.ch1.mod_knob            = frame.ch1.mod_knob;
-            d_frame.ch1.level_mod_knob      = frame.ch1.level_mod_knob;
-            d_frame.ch1.response_knob       = frame.ch1.response_knob;
-            d_frame.ch2.shape_knob          = frame.ch2.shape_knob;
-            d_frame.ch2.mod_knob            = frame.ch2.mod_knob;
-            d_frame.ch2.level_mod_knob      = frame.ch2.level_mod_knob;
-            d_frame.ch2.response_knob       = frame.ch2.response_knob;
-
-            d_frame.ch1.function_button     = frame.ch1.function_button;
-            d_frame.ch2.function_button     = frame.ch2.function_button;
-            d_frame.metering_button         = frame.metering_button;
-
             for (int i = 0; i < kBlockSize; i++)
             {
                 d_frame.ch1.signal_in[i]    = input[i].samples[0];
@@ -172,24 +133,6 @@ public:
                 output[i].samples[2] = d_frame.ch2.dac_out[i];
                 output[i].samples[3] = d_frame.ch2.pwm_out[i];
             }
-
-            frame.ch1.led_green[0] = d_frame.ch1.led_green[0];
-            frame.ch1.led_green[1] = d_frame.ch1.led_green[1];
-            frame.ch1.led_green[2] = d_frame.ch1.led_green[2];
-            frame.ch1.led_green[3] = d_frame.ch1.led_green[3];
-            frame.ch1.led_red[0]   = d_frame.ch1.led_red[0];
-            frame.ch1.led_red[1]   = d_frame.ch1.led_red[1];
-            frame.ch1.led_red[2]   = d_frame.ch1.led_red[2];
-            frame.ch1.led_red[3]   = d_frame.ch1.led_red[3];
-            frame.ch2.led_green[0] = d_frame.ch2.led_green[0];
-            frame.ch2.led_green[1] = d_frame.ch2.led_green[1];
-            frame.ch2.led_green[2] = d_frame.ch2.led_green[2];
-            frame.ch2.led_green[3] = d_frame.ch2.led_green[3];
-            frame.ch2.led_red[0]   = d_frame.ch2.led_red[0];
-            frame.ch2.led_red[1]   = d_frame.ch2.led_red[1];
-            frame.ch2.led_red[2]   = d_frame.ch2.led_red[2];
-            frame.ch2.led_red[3]   = d_frame.ch2.led_red[3];
-            frame.lights_updated   = true;
         });
 
         AnalogEngine::Frame a_frame;
@@ -234,4 +177,120 @@ protected:
     float adc_feedback_[2];
 };
 
+// The buttons, pots, settings and LEDs, shared by every voice. The UI is
+// polled at the rate of the digital engine's blocks.
+class StreamsUi
+{
+public:
+    static constexpr int kMaxVoices = Voices::kMaxVoices;
+
+    struct ChannelFrame
+    {
+        // Parameters
+        float shape_knob;
+        float mod_knob;
+
+        bool function_button;
+
+        // Lights
+        float led_green[4];
+        float led_red[4];
+    };
+
+    struct Frame
+    {
+        ChannelFrame ch1;
+        ChannelFrame ch2;
+        bool metering_button;
+        bool lights_updated;
+    };
+
+    StreamsUi()
+    {
+        SetSampleRate(1.f);
+    }
+
+    void Reset(StreamsEngine* engines, int num_engines)
+    {
+        DigitalEngine* digital_engines[kMaxVoices];
+
+        for (int i = 0; i < num_engines; i++)
+        {
+            digital_engines[i] = engines[i].digital_engine();
+        }
+
+        digital_ui_.Reset(digital_engines, num_engines);
+        phase_ = 0.f;
+    }
+
+    void SetSampleRate(float sample_rate)
+    {
+        phase_increment_ = DigitalEngine::kSampleRate / sample_rate;
+    }
+
+    void SetNumVoices(int num_voices)
+    {
+        digital_ui_.SetNumVoices(num_voices);
+    }
+
+    void Randomize(void)
+    {
+        digital_ui_.Randomize();
+    }
+
+    void ApplySettings(const UiSettings& settings)
+    {
+        digital_ui_.ApplySettings(settings);
+    }
+
+    const UiSettings& ui_settings(void)
+    {
+        return digital_ui_.ui_settings();
+    }
+
+    void Process(Frame& frame)
+    {
+        frame.lights_updated = false;
+
+        phase_ += phase_increment_;
+
+        if (phase_ < kBlockSize)
+        {
+            return;
+        }
+
+        phase_ -= kBlockSize;
+
+        DigitalUi::Frame d_frame;
+
+        d_frame.ch1.shape_knob      = frame.ch1.shape_knob;
+        d_frame.ch1.mod_knob        = frame.ch1.mod_knob;
+        d_frame.ch2.shape_knob      = frame.ch2.shape_knob;
+        d_frame.ch2.mod_knob        = frame.ch2.mod_knob;
+
+        d_frame.ch1.function_button = frame.ch1.function_button;
+        d_frame.ch2.function_button = frame.ch2.function_button;
+        d_frame.metering_button     = frame.metering_button;
+
+        digital_ui_.Process<kBlockSize>(d_frame);
+
+        for (int i = 0; i < 4; i++)
+        {
+            frame.ch1.led_green[i] = d_frame.ch1.led_green[i];
+            frame.ch1.led_red[i]   = d_frame.ch1.led_red[i];
+            frame.ch2.led_green[i] = d_frame.ch2.led_green[i];
+            frame.ch2.led_red[i]   = d_frame.ch2.led_red[i];
+        }
+
+        frame.lights_updated = true;
+    }
+
+protected:
+    static constexpr int kBlockSize = 16;
+
+    DigitalUi digital_ui_;
+    float phase_;
+    float phase_increment_;
+};
+
 }
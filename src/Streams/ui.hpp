@@ -40,6 +40,7 @@
 #include "adc.hpp"
 #include "leds.hpp"
 #include "switches.hpp"
+#include "voices.hpp"
 
 namespace streams
 {
@@ -85,7 +86,7 @@ public:
     Ui() { }
     ~Ui() { }
 
-    void Init(AdcEmulator* adc, CvScaler* cv_scaler, Processor* processor,
+    void Init(AdcEmulator* adc, Voices* voices,
         UiSettings* settings = nullptr)
     {
         queue_.Init();
@@ -93,8 +94,7 @@ public:
         leds_.Init();
         switches_.Init();
         adc_ = adc;
-        cv_scaler_ = cv_scaler;
-        processor_ = processor;
+        voices_ = voices;
 
         for (int i = 0; i < kNumPots; i++)
         {
@@ -128,7 +128,11 @@ public:
 
         for (uint8_t i = 0; i < kNumChannels; ++i)
         {
-            meter_[i].Init();
+            for (int j = 0; j < Voices::kMaxVoices; j++)
+            {
+                meter_[j][i].Init();
+            }
+
             display_mode_[i] = DISPLAY_MODE_MONITOR;
         }
 
@@ -237,7 +241,7 @@ public:
         {
             for (uint8_t i = 0; i < kNumChannels; ++i)
             {
-                processor_[i].Configure();
+                voices_->processor(i).Configure();
             }
         }
     }
@@ -264,7 +268,7 @@ public:
         for (uint8_t i = 0; i < kNumChannels; ++i)
         {
             display_mode_[i] = DISPLAY_MODE_FUNCTION;
-            processor_[i].set_linked(state);
+            voices_->processor(i).set_linked(state);
         }
 
         Link(1 - follower_channel);
@@ -281,7 +285,7 @@ public:
 
     bool linked()
     {
-        return processor_[0].linked();
+        return voices_->processor(0).linked();
     }
 
     const UiSettings& settings()
@@ -313,9 +317,9 @@ public:
 
         for (uint8_t i = 0; i < kNumChannels; ++i)
         {
-            processor_[i].set_alternate(ui_settings_.alternate[i]);
-            processor_[i].set_linked(ui_settings_.linked);
-            processor_[i].set_function(
+            voices_->processor(i).set_alternate(ui_settings_.alternate[i]);
+            voices_->processor(i).set_linked(ui_settings_.linked);
+            voices_->processor(i).set_function(
                 static_cast<ProcessorFunction>(ui_settings_.function[i]));
         }
     }
@@ -330,24 +334,18 @@ public:
         return monitor_mode_;
     }
 
-    void SyncUI(const Ui& other)
+    void SetNumVoices(int num_voices)
     {
-        ApplySettings(other.ui_settings_);
-
-        for (int i = 0; i < kNumChannels; i++)
+        // Start metering newly active voices from silence.
+        for (int i = voices_->num_active(); i < num_voices; i++)
         {
-            press_time_[i] = other.press_time_[i];
-            display_mode_[i] = other.display_mode_[i];
-            pot_value_[i] = other.pot_value_[i];
-            pot_threshold_[i] = other.pot_threshold_[i];
-            meter_[i] = other.meter_[i];
+            for (uint8_t j = 0; j < kNumChannels; ++j)
+            {
+                meter_[i][j].Init();
+            }
         }
 
-        time_us_ = other.time_us_;
-        switches_ = other.switches_;
-        monitor_mode_ = other.monitor_mode_;
-        ui_settings_ = other.ui_settings_;
-        secret_handshake_counter_ = other.secret_handshake_counter_;
+        voices_->set_num_active(num_voices);
     }
 
 private:
@@ -355,15 +353,15 @@ private:
 
     void Link(uint8_t index)
     {
-        if (processor_[0].linked())
+        if (voices_->processor(0).linked())
         {
             for (uint8_t i = 0; i < kNumChannels; ++i)
             {
                 if (i != index)
                 {
                     display_mode_[i] = display_mode_[index];
-                    processor_[i].set_function(processor_[index].function());
-                    processor_[i].set_alternate(processor_[index].alternate());
+                    voices_->processor(i).set_function(voices_->processor(index).function());
+                    voices_->processor(i).set_alternate(voices_->processor(index).alternate());
                 }
             }
         }
@@ -418,8 +416,8 @@ private:
             {
                 for (uint8_t i = 0; i < kNumChannels; ++i)
                 {
-                    processor_[i].set_alternate(false);
-                    processor_[i].set_function(PROCESSOR_FUNCTION_LORENZ_GENERATOR);
+                    voices_->processor(i).set_alternate(false);
+                    voices_->processor(i).set_function(PROCESSOR_FUNCTION_LORENZ_GENERATOR);
                 }
 
                 SaveState();
@@ -443,13 +441,13 @@ private:
                 case SWITCH_MODE_1:
                 case SWITCH_MODE_2:
                 {
-                    processor_[e.control_id].set_alternate(
-                        !processor_[e.control_id].alternate());
+                    voices_->processor(e.control_id).set_alternate(
+                        !voices_->processor(e.control_id).alternate());
 
-                    if (processor_[e.control_id].function() >
+                    if (voices_->processor(e.control_id).function() >
                         PROCESSOR_FUNCTION_COMPRESSOR)
                     {
-                        processor_[e.control_id].set_function(PROCESSOR_FUNCTION_ENVELOPE);
+                        voices_->processor(e.control_id).set_function(PROCESSOR_FUNCTION_ENVELOPE);
                     }
 
                     display_mode_[e.control_id] = DISPLAY_MODE_FUNCTION;
@@ -475,9 +473,9 @@ private:
                 {
                     if (display_mode_[e.control_id] == DISPLAY_MODE_FUNCTION)
                     {
-                        ProcessorFunction index = processor_[e.control_id].function();
+                        ProcessorFunction index = voices_->processor(e.control_id).function();
                         index = static_cast<ProcessorFunction>(index + 1);
-                        ProcessorFunction limit = processor_[e.control_id].alternate()
+                        ProcessorFunction limit = voices_->processor(e.control_id).alternate()
                             ? PROCESSOR_FUNCTION_FILTER_CONTROLLER
                             : PROCESSOR_FUNCTION_COMPRESSOR;
 
@@ -486,7 +484,7 @@ private:
                             index = static_cast<ProcessorFunction>(0);
                         }
 
-                        processor_[e.control_id].set_function(index);
+                        voices_->processor(e.control_id).set_function(index);
                     }
                     else
                     {
@@ -512,24 +510,24 @@ private:
 
     void OnPotMoved(const Event& e)
     {
-        processor_[0].set_global(e.control_id, e.data);
-        processor_[1].set_global(e.control_id, e.data);
-        processor_[e.control_id >> 1].set_parameter(e.control_id & 1, e.data);
+        voices_->processor(0).set_global(e.control_id, e.data);
+        voices_->processor(1).set_global(e.control_id, e.data);
+        voices_->processor(e.control_id >> 1).set_parameter(e.control_id & 1, e.data);
 
         for (uint8_t i = 0; i < kNumChannels; ++i)
         {
-            processor_[i].Configure();
+            voices_->processor(i).Configure();
         }
     }
 
     void SaveState()
     {
         ui_settings_.monitor_mode = monitor_mode_;
-        ui_settings_.linked = processor_[0].linked();
-        ui_settings_.function[0] = processor_[0].function();
-        ui_settings_.function[1] = processor_[1].function();
-        ui_settings_.alternate[0] = processor_[0].alternate();
-        ui_settings_.alternate[1] = processor_[1].alternate();
+        ui_settings_.linked = voices_->processor(0).linked();
+        ui_settings_.function[0] = voices_->processor(0).function();
+        ui_settings_.function[1] = voices_->processor(1).function();
+        ui_settings_.alternate[0] = voices_->processor(0).alternate();
+        ui_settings_.alternate[1] = voices_->processor(1).alternate();
     }
 
     void PaintLeds(uint32_t timestep_us)
@@ -544,10 +542,10 @@ private:
             {
                 case DISPLAY_MODE_FUNCTION:
                 {
-                    bool alternate = processor_[i].alternate();
+                    bool alternate = voices_->processor(i).alternate();
                     uint8_t intensity = 255;
 
-                    if (processor_[i].linked())
+                    if (voices_->processor(i).linked())
                     {
                         uint8_t phase = (time_us_ / 1000) >> 1;
                         phase += i * 128;
@@ -556,7 +554,7 @@ private:
                         intensity = intensity * intensity >> 8;
                     }
 
-                    uint8_t function = processor_[i].function();
+                    uint8_t function = voices_->processor(i).function();
 
                     if (function == PROCESSOR_FUNCTION_FILTER_CONTROLLER)
                     {
@@ -576,14 +574,14 @@ private:
                     }
                     else
                     {
-                        uint8_t index = (processor_[i].last_gain() >> 4) * 5 >> 4;
+                        uint8_t index = (voices_->processor(i).last_gain() >> 4) * 5 >> 4;
 
                         if (index > 3)
                         {
                             index = 3;
                         }
 
-                        int16_t color = processor_[i].last_frequency();
+                        int16_t color = voices_->processor(i).last_frequency();
                         color = color - 128;
                         color *= 2;
 
@@ -624,34 +622,47 @@ private:
         }
     }
 
+    // With several voices, each meter shows whichever voice is loudest.
     void PaintMonitor(uint8_t channel, uint32_t timestep_us)
     {
         switch (monitor_mode_)
         {
             case MONITOR_MODE_EXCITE_IN:
-                PaintAdaptive(channel, cv_scaler_->excite_sample(channel), 0, timestep_us);
-                break;
-
             case MONITOR_MODE_AUDIO_IN:
-                PaintAdaptive(channel, cv_scaler_->audio_sample(channel), 0, timestep_us);
+                PaintAdaptive(channel, timestep_us);
                 break;
 
             case MONITOR_MODE_VCA_CV:
-                leds_.PaintPositiveBar(channel, 32768 + cv_scaler_->gain_sample(channel));
-                break;
+            {
+                int32_t gain = voices_->cv_scaler(0).gain_sample(channel);
+
+                for (int i = 1; i < voices_->num_active(); i++)
+                {
+                    gain = std::max(gain,
+                        voices_->cv_scaler(i).gain_sample(channel));
+                }
+
+                leds_.PaintPositiveBar(channel, 32768 + gain);
+            }
+            break;
 
             case MONITOR_MODE_OUTPUT:
-                if (processor_[channel].function() == PROCESSOR_FUNCTION_COMPRESSOR)
+                if (voices_->processor(channel).function() == PROCESSOR_FUNCTION_COMPRESSOR)
                 {
-                    leds_.PaintNegativeBar(channel, processor_[channel].gain_reduction());
+                    int32_t reduction =
+                        voices_->processor(0, channel).gain_reduction();
+
+                    for (int i = 1; i < voices_->num_active(); i++)
+                    {
+                        reduction = std::min(reduction,
+                            voices_->processor(i, channel).gain_reduction());
+                    }
+
+                    leds_.PaintNegativeBar(channel, reduction);
                 }
                 else
                 {
-                    PaintAdaptive(
-                        channel,
-                        cv_scaler_->audio_sample(channel),
-                        cv_scaler_->gain_sample(channel),
-                        timestep_us);
+                    PaintAdaptive(channel, timestep_us);
                 }
 
                 break;
@@ -661,19 +672,43 @@ private:
         }
     }
 
-    void PaintAdaptive(uint8_t channel, int32_t sample, int32_t gain,
-        uint32_t timestep_us)
+    void PaintAdaptive(uint8_t channel, uint32_t timestep_us)
     {
-        meter_[channel].Process(sample, timestep_us);
+        int loudest = 0;
+        int32_t loudest_level = 0;
+        int32_t loudest_sample = 0;
+        int32_t loudest_gain = 0;
+
+        for (int i = 0; i < voices_->num_active(); i++)
+        {
+            const CvScaler& cv_scaler = voices_->cv_scaler(i);
+            int32_t sample = (monitor_mode_ == MONITOR_MODE_EXCITE_IN) ?
+                cv_scaler.excite_sample(channel) :
+                cv_scaler.audio_sample(channel);
+            int32_t gain = (monitor_mode_ == MONITOR_MODE_OUTPUT) ?
+                cv_scaler.gain_sample(channel) : 0;
+
+            meter_[i][channel].Process(sample, timestep_us);
+            int32_t level = wav_db[meter_[i][channel].peak() >> 7] + gain;
+
+            if (i == 0 || level > loudest_level)
+            {
+                loudest = i;
+                loudest_level = level;
+                loudest_sample = sample;
+                loudest_gain = gain;
+            }
+        }
 
-        if (meter_[channel].cv())
+        if (meter_[loudest][channel].cv())
         {
-            sample = sample * lut_2164_gain[-gain >> 9] >> 15;
+            int32_t sample =
+                loudest_sample * lut_2164_gain[-loudest_gain >> 9] >> 15;
             leds_.PaintCv(channel, sample * 5 >> 2);
         }
         else
         {
-            leds_.PaintPositiveBar(channel, wav_db[meter_[channel].peak() >> 7] + gain);
+            leds_.PaintPositiveBar(channel, loudest_level);
         }
     }
 
@@ -681,8 +716,7 @@ private:
     uint32_t time_us_;
 
     AdcEmulator* adc_;
-    CvScaler* cv_scaler_;
-    Processor* processor_;
+    Voices* voices_;
     LedsEmulator leds_;
     SwitchesEmulator switches_;
     uint32_t press_time_[kNumSwitches];
@@ -697,7 +731,7 @@ private:
     int32_t pot_value_[kNumPots];
     int32_t pot_threshold_[kNumPots];
 
-    AudioCvMeter meter_[kNumChannels];
+    AudioCvMeter meter_[Voices::kMaxVoices][kNumChannels];
 
     const int32_t kLongPressDuration = 1000;
 
@@ -0,0 +1,181 @@
+// Mutable Instruments Streams emulation for VCV Rack
+// Copyright (C) 2020 Tyler Coy
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <stmlib/stmlib.h>
+#include "cv_scaler.hpp"
+#include <streams/processor.h>
+
+namespace streams
+{
+
+// The polyphonic voices driven by a single UI. Every voice runs its own pair
+// of processors, but they all share the same settings, so changes made by the
+// UI are forwarded to the same channel of each voice.
+class Voices
+{
+public:
+    static constexpr int kMaxVoices = 16;
+
+    class ProcessorProxy
+    {
+    public:
+        ProcessorProxy(Voices* voices, uint8_t channel) :
+            voices_(voices),
+            channel_(channel)
+        {
+        }
+
+        void set_function(ProcessorFunction function)
+        {
+            for (int i = 0; i < voices_->num_voices_; i++)
+            {
+                voices_->processor(i, channel_).set_function(function);
+            }
+        }
+
+        void set_alternate(bool alternate)
+        {
+            for (int i = 0; i < voices_->num_voices_; i++)
+            {
+                voices_->processor(i, channel_).set_alternate(alternate);
+            }
+        }
+
+        void set_linked(bool linked)
+        {
+            for (int i = 0; i < voices_->num_voices_; i++)
+            {
+                voices_->processor(i, channel_).set_linked(linked);
+            }
+        }
+
+        void set_parameter(uint16_t index, uint16_t value)
+        {
+            for (int i = 0; i < voices_->num_voices_; i++)
+            {
+                voices_->processor(i, channel_).set_parameter(index, value);
+            }
+        }
+
+        void set_global(uint16_t index, uint16_t value)
+        {
+            for (int i = 0; i < voices_->num_voices_; i++)
+            {
+                voices_->processor(i, channel_).set_global(index, value);
+            }
+        }
+
+        void Configure()
+        {
+            for (int i = 0; i < voices_->num_voices_; i++)
+            {
+                voices_->processor(i, channel_).Configure();
+            }
+        }
+
+        // Settings are identical across voices, so read them from the first.
+        ProcessorFunction function() const
+        {
+            return voices_->processor(0, channel_).function();
+        }
+
+        bool alternate() const
+        {
+            return voices_->processor(0, channel_).alternate();
+        }
+
+        bool linked() const
+        {
+            return voices_->processor(0, channel_).linked();
+        }
+
+        uint8_t last_frequency() const
+        {
+            return voices_->processor(0, channel_).last_frequency();
+        }
+
+        uint8_t last_gain() const
+        {
+            return voices_->processor(0, channel_).last_gain();
+        }
+
+    private:
+        Voices* voices_;
+        uint8_t channel_;
+    };
+
+    Voices()
+    {
+        Init();
+    }
+
+    void Init(void)
+    {
+        num_voices_ = 0;
+        num_active_ = 1;
+    }
+
+    // Adds a voice, given its pair of processors and the scaler of its ADC.
+    void Add(Processor* processors, const CvScaler* cv_scaler)
+    {
+        processors_[num_voices_] = processors;
+        cv_scalers_[num_voices_] = cv_scaler;
+        num_voices_++;
+    }
+
+    ProcessorProxy processor(uint8_t channel)
+    {
+        return ProcessorProxy(this, channel);
+    }
+
+    Processor& processor(int voice, uint8_t channel) const
+    {
+        return processors_[voice][channel];
+    }
+
+    const CvScaler& cv_scaler(int voice) const
+    {
+        return *cv_scalers_[voice];
+    }
+
+    int num_voices(void) const
+    {
+        return num_voices_;
+    }
+
+    // Only the active voices are metered.
+    int num_active(void) const
+    {
+        return num_active_;
+    }
+
+    void set_num_active(int num_active)
+    {
+        num_active_ = num_active;
+    }
+
+private:
+    Processor* processors_[kMaxVoices];
+    const CvScaler* cv_scalers_[kMaxVoices];
+    int num_voices_;
+    int num_active_;
+
+    DISALLOW_COPY_AND_ASSIGN(Voices);
+};
+
+}
@@ -4,6 +4,7 @@
 #include "tides2/poly_slope_generator.h"
 #include "tides2/ramp/ramp_extractor.h"
 #include "tides2/io_buffer.h"
+#include "Tides2/slope_generator_batch.hpp"
 
 
 static const float kRootScaled[3] = {
@@ -76,9 +77,9 @@ struct Tides2 : Module {
 		NUM_LIGHTS
 	};
 
-	tides2::PolySlopeGenerator poly_slope_generator;
-	tides2::RampExtractor ramp_extractor;
-	stmlib::HysteresisQuantizer ratio_index_quantizer;
+	tides2::PolySlopeGenerator poly_slope_generator[16];
+	tides2::RampExtractor ramp_extractor[16];
+	stmlib::HysteresisQuantizer ratio_index_quantizer[16];
 
 	// State
 	int range;
@@ -89,13 +90,15 @@ struct Tides2 : Module {
 	dsp::BooleanTrigger rampTrigger;
 
 	// Buffers
-	tides2::PolySlopeGenerator::OutputSample out[tides2::kBlockSize] = {};
-	stmlib::GateFlags trig_flags[tides2::kBlockSize] = {};
-	stmlib::GateFlags clock_flags[tides2::kBlockSize] = {};
-	stmlib::GateFlags previous_trig_flag = stmlib::GATE_FLAG_LOW;
-	stmlib::GateFlags previous_clock_flag = stmlib::GATE_FLAG_LOW;
-
-	bool must_reset_ramp_extractor = true;
+	tides2::PolySlopeGenerator::OutputSample out[16][tides2::kBlockSize] = {};
+	stmlib::GateFlags trig_flags[16][tides2::kBlockSize] = {};
+	stmlib::GateFlags clock_flags[16][tides2::kBlockSize] = {};
+	stmlib::GateFlags previous_trig_flag[16] = {};
+	stmlib::GateFlags previous_clock_flag[16] = {};
+
+	bool must_reset_ramp_extractor[16];
+	/** Number of channels rendered by the current block */
+	int channels = 1;
 	tides2::OutputMode previous_output_mode = tides2::OUTPUT_MODE_GATES;
 	uint8_t frame = 0;
 
@@ -131,8 +134,11 @@ struct Tides2 : Module {
 			configOutput(OUT_OUTPUTS + c, string::f("Channel %d", c + 1));
 		}
 
-		poly_slope_generator.Init();
-		ratio_index_quantizer.Init();
+		for (int c = 0; c < 16; c++) {
+			poly_slope_generator[c].Init();
+			ratio_index_quantizer[c].Init();
+			must_reset_ramp_extractor[c] = true;
+		}
 		onReset();
 		onSampleRateChange();
 	}
@@ -150,7 +156,9 @@ struct Tides2 : Module {
 	}
 
 	void onSampleRateChange() override {
-		ramp_extractor.Init(APP->engine->getSampleRate(), 40.f / APP->engine->getSampleRate());
+		for (int c = 0; c < 16; c++) {
+			ramp_extractor[c].Init(APP->engine->getSampleRate(), 40.f / APP->engine->getSampleRate());
+		}
 	}
 
 	json_t* dataToJson() override {
@@ -190,69 +198,115 @@ struct Tides2 : Module {
 		}
 
 		// Input gates
-		trig_flags[frame] = stmlib::ExtractGateFlags(previous_trig_flag, inputs[TRIG_INPUT].getVoltage() >= 1.7f);
-		previous_trig_flag = trig_flags[frame];
+		for (int c = 0; c < channels; c++) {
+			trig_flags[c][frame] = stmlib::ExtractGateFlags(previous_trig_flag[c], inputs[TRIG_INPUT].getPolyVoltage(c) >= 1.7f);
+			previous_trig_flag[c] = trig_flags[c][frame];
 
-		clock_flags[frame] = stmlib::ExtractGateFlags(previous_clock_flag, inputs[CLOCK_INPUT].getVoltage() >= 1.7f);
-		previous_clock_flag = clock_flags[frame];
+			clock_flags[c][frame] = stmlib::ExtractGateFlags(previous_clock_flag[c], inputs[CLOCK_INPUT].getPolyVoltage(c) >= 1.7f);
+			previous_clock_flag[c] = clock_flags[c][frame];
+		}
 
 		// Process block
 		if (++frame >= tides2::kBlockSize) {
 			frame = 0;
 
 			tides2::Range range_mode = (range < 2) ? tides2::RANGE_CONTROL : tides2::RANGE_AUDIO;
-			float note = clamp(params[FREQUENCY_PARAM].getValue() + 12.f * inputs[V_OCT_INPUT].getVoltage(), -96.f, 96.f);
-			float fm = clamp(params[FREQUENCY_CV_PARAM].getValue() * inputs[FREQUENCY_INPUT].getVoltage() * 12.f, -96.f, 96.f);
-			float transposition = note + fm;
-
-			float ramp[tides2::kBlockSize];
-			float frequency;
-
-			if (inputs[CLOCK_INPUT].isConnected()) {
-				if (must_reset_ramp_extractor) {
-					ramp_extractor.Reset();
+			bool use_ramp = !inputs[TRIG_INPUT].isConnected() && inputs[CLOCK_INPUT].isConnected();
+
+			float ramp[16][tides2::kBlockSize];
+			float frequency[16];
+			float slope[16];
+			float shape[16];
+			float smoothness[16];
+			float shift[16];
+			const stmlib::GateFlags* gate_flags[16];
+			const float* ramps[16];
+			tides2::PolySlopeGenerator::OutputSample* outs[16];
+
+			for (int c = 0; c < channels; c++) {
+				float note = clamp(params[FREQUENCY_PARAM].getValue() + 12.f * inputs[V_OCT_INPUT].getPolyVoltage(c), -96.f, 96.f);
+				float fm = clamp(params[FREQUENCY_CV_PARAM].getValue() * inputs[FREQUENCY_INPUT].getPolyVoltage(c) * 12.f, -96.f, 96.f);
+				float transposition = note + fm;
+
+				if (inputs[CLOCK_INPUT].isConnected()) {
+					if (must_reset_ramp_extractor[c]) {
+						ramp_extractor[c].Reset();
+					}
+
+					tides2::Ratio r = ratio_index_quantizer[c].Lookup(kRatios, 0.5f + transposition * 0.0105f, 20);
+					frequency[c] = ramp_extractor[c].Process(
+					                 range_mode == tides2::RANGE_AUDIO,
+					                 range_mode == tides2::RANGE_AUDIO && ramp_mode == tides2::RAMP_MODE_AR,
+					                 r,
+					                 clock_flags[c],
+					                 ramp[c],
+					                 tides2::kBlockSize);
+					must_reset_ramp_extractor[c] = false;
+				}
+				else {
+					frequency[c] = kRootScaled[range] / args.sampleRate * stmlib::SemitonesToRatio(transposition);
+					must_reset_ramp_extractor[c] = true;
 				}
 
-				tides2::Ratio r = ratio_index_quantizer.Lookup(kRatios, 0.5f + transposition * 0.0105f, 20);
-				frequency = ramp_extractor.Process(
-				              range_mode == tides2::RANGE_AUDIO,
-				              range_mode == tides2::RANGE_AUDIO && ramp_mode == tides2::RAMP_MODE_AR,
-				              r,
-				              clock_flags,
-				              ramp,
-				              tides2::kBlockSize);
-				must_reset_ramp_extractor = false;
-			}
-			else {
-				frequency = kRootScaled[range] / args.sampleRate * stmlib::SemitonesToRatio(transposition);
-				must_reset_ramp_extractor = true;
-			}
+				// Get parameters
+				slope[c] = clamp(params[SLOPE_PARAM].getValue() + dsp::cubic(params[SLOPE_CV_PARAM].getValue()) * inputs[SLOPE_INPUT].getPolyVoltage(c) / 10.f, 0.f, 1.f);
+				shape[c] = clamp(params[SHAPE_PARAM].getValue() + dsp::cubic(params[SHAPE_CV_PARAM].getValue()) * inputs[SHAPE_INPUT].getPolyVoltage(c) / 10.f, 0.f, 1.f);
+				smoothness[c] = clamp(params[SMOOTHNESS_PARAM].getValue() + dsp::cubic(params[SMOOTHNESS_CV_PARAM].getValue()) * inputs[SMOOTHNESS_INPUT].getPolyVoltage(c) / 10.f, 0.f, 1.f);
+				shift[c] = clamp(params[SHIFT_PARAM].getValue() + dsp::cubic(params[SHIFT_CV_PARAM].getValue()) * inputs[SHIFT_INPUT].getPolyVoltage(c) / 10.f, 0.f, 1.f);
 
-			// Get parameters
-			float slope = clamp(params[SLOPE_PARAM].getValue() + dsp::cubic(params[SLOPE_CV_PARAM].getValue()) * inputs[SLOPE_INPUT].getVoltage() / 10.f, 0.f, 1.f);
-			float shape = clamp(params[SHAPE_PARAM].getValue() + dsp::cubic(params[SHAPE_CV_PARAM].getValue()) * inputs[SHAPE_INPUT].getVoltage() / 10.f, 0.f, 1.f);
-			float smoothness = clamp(params[SMOOTHNESS_PARAM].getValue() + dsp::cubic(params[SMOOTHNESS_CV_PARAM].getValue()) * inputs[SMOOTHNESS_INPUT].getVoltage() / 10.f, 0.f, 1.f);
-			float shift = clamp(params[SHIFT_PARAM].getValue() + dsp::cubic(params[SHIFT_CV_PARAM].getValue()) * inputs[SHIFT_INPUT].getVoltage() / 10.f, 0.f, 1.f);
+				gate_flags[c] = trig_flags[c];
+				ramps[c] = use_ramp ? ramp[c] : NULL;
+				outs[c] = out[c];
+			}
 
 			if (output_mode != previous_output_mode) {
-				poly_slope_generator.Reset();
+				for (int c = 0; c < 16; c++) {
+					poly_slope_generator[c].Reset();
+				}
 				previous_output_mode = output_mode;
 			}
 
-			// Render generator
-			poly_slope_generator.Render(
-			  ramp_mode,
-			  output_mode,
-			  range_mode,
-			  frequency,
-			  slope,
-			  shape,
-			  smoothness,
-			  shift,
-			  trig_flags,
-			  !inputs[TRIG_INPUT].isConnected() && inputs[CLOCK_INPUT].isConnected() ? ramp : NULL,
-			  out,
-			  tides2::kBlockSize);
+			// Render generators, four channels at a time when the modes have a SIMD implementation
+			int c = 0;
+			if (tides2::SlopeGeneratorBatch::Supports(ramp_mode, range_mode)) {
+				for (; c < channels; c += tides2::SlopeGeneratorBatch::kMaxVoices) {
+					tides2::PolySlopeGenerator* voices[tides2::SlopeGeneratorBatch::kMaxVoices];
+					int n = std::min(channels - c, tides2::SlopeGeneratorBatch::kMaxVoices);
+					for (int i = 0; i < n; i++) {
+						voices[i] = &poly_slope_generator[c + i];
+					}
+					tides2::SlopeGeneratorBatch::Render(
+					  voices,
+					  n,
+					  ramp_mode,
+					  output_mode,
+					  range_mode,
+					  &frequency[c],
+					  &slope[c],
+					  &shape[c],
+					  &smoothness[c],
+					  &shift[c],
+					  &gate_flags[c],
+					  &ramps[c],
+					  &outs[c],
+					  tides2::kBlockSize);
+				}
+			}
+			for (; c < channels; c++) {
+				poly_slope_generator[c].Render(
+				  ramp_mode,
+				  output_mode,
+				  range_mode,
+				  frequency[c],
+				  slope[c],
+				  shape[c],
+				  smoothness[c],
+				  shift[c],
+				  gate_flags[c],
+				  ramps[c],
+				  outs[c],
+				  tides2::kBlockSize);
+			}
 
 			// Set lights
 			lights[RANGE_LIGHT + 0].value = (range == 0 || range == 1);
@@ -261,13 +315,24 @@ struct Tides2 : Module {
 			lights[OUTPUT_MODE_LIGHT + 1].value = (output_mode == tides2::OUTPUT_MODE_FREQUENCY || output_mode == tides2::OUTPUT_MODE_SLOPE_PHASE);
 			lights[RAMP_MODE_LIGHT + 0].value = (ramp_mode == tides2::RAMP_MODE_AD || ramp_mode == tides2::RAMP_MODE_LOOPING);
 			lights[RAMP_MODE_LIGHT + 1].value = (ramp_mode == tides2::RAMP_MODE_AR || ramp_mode == tides2::RAMP_MODE_LOOPING);
+
+			// The channel count only changes between blocks, so that gates are never missed.
+			// Added channels output silence until their first block is rendered.
+			int newChannels = std::max(std::max(inputs[V_OCT_INPUT].getChannels(), inputs[TRIG_INPUT].getChannels()), 1);
+			newChannels = std::max(newChannels, inputs[CLOCK_INPUT].getChannels());
+			for (int c = channels; c < newChannels; c++) {
+				std::memset(out[c], 0, sizeof(out[c]));
+			}
+			channels = newChannels;
 		}
 
 		// Outputs
 		for (int i = 0; i < 4; i++) {
-			float value = out[frame].channel[i];
-			outputs[OUT_OUTPUTS + i].setVoltage(value);
-			lights[OUTPUT_LIGHTS + i].setSmoothBrightness(value, args.sampleTime);
+			for (int c = 0; c < channels; c++) {
+				outputs[OUT_OUTPUTS + i].setVoltage(out[c][frame].channel[i], c);
+			}
+			outputs[OUT_OUTPUTS + i].setChannels(channels);
+			lights[OUTPUT_LIGHTS + i].setSmoothBrightness(out[0][frame].channel[i], args.sampleTime);
 		}
 	}
 };
@@ -0,0 +1,540 @@
+// Mutable Instruments Tides 2 slope generators, rendering four voices per pass.
+//
+// In the control frequency range, the AD and looping ramp modes of
+// PolySlopeGenerator::RenderInternal() are rendered for four voices at once,
+// each lane of a float_4 holding the state of one voice. Branches of the
+// scalar code are replaced by masks, and wavetable lookups are gathered lane
+// by lane. The state of each voice's ramp generator and shapers is loaded
+// before the block and stored back after it, so voices can switch between a
+// batch and the scalar code at any block. The output is the same as calling
+// PolySlopeGenerator::Render() on each voice, bit for bit unless the compiler
+// is allowed to reassociate floating point operations.
+
+#pragma once
+
+#include <rack.hpp>
+#include <cstring>
+
+#include "tides2/poly_slope_generator.h"
+
+namespace tides2 {
+
+typedef rack::simd::float_4 float_4;
+
+#define INSTANTIATE_LANES(x, y, z) \
+  fn[x][y][z] = &SlopeGeneratorBatch::RenderLanes<x, y, z>;
+
+class SlopeGeneratorBatch {
+ public:
+  static const int kMaxVoices = 4;
+
+  static bool Supports(RampMode ramp_mode, Range range) {
+    return range == RANGE_CONTROL && ramp_mode != RAMP_MODE_AR;
+  }
+
+  // Renders n voices with the same modes and with their own parameters.
+  // Equivalent to calling Render() on each voice. Either all or none of the
+  // voices follow an external ramp.
+  static void Render(
+      PolySlopeGenerator* const* voices,
+      int n,
+      RampMode ramp_mode,
+      OutputMode output_mode,
+      Range range,
+      const float* frequency,
+      const float* pw,
+      const float* shape,
+      const float* smoothness,
+      const float* shift,
+      const stmlib::GateFlags* const* gate_flags,
+      const float* const* ramp,
+      PolySlopeGenerator::OutputSample* const* out,
+      size_t size) {
+    static const RenderFnTable table;
+
+    // Unused lanes duplicate the first voice and are never stored back.
+    PolySlopeGenerator* lanes[kMaxVoices];
+    Parameters parameters;
+    const stmlib::GateFlags* lane_gate_flags[kMaxVoices];
+    const float* lane_ramp[kMaxVoices];
+    for (int i = 0; i < kMaxVoices; ++i) {
+      const int source = i < n ? i : 0;
+      lanes[i] = voices[source];
+      parameters.frequency[i] = frequency[source];
+      parameters.pw[i] = pw[source];
+      parameters.shape[i] = shape[source];
+      parameters.smoothness[i] = smoothness[source];
+      parameters.shift[i] = shift[source];
+      lanes[i]->AdjustParameters(
+          ramp_mode,
+          range,
+          ramp[source] != NULL,
+          &parameters.frequency[i],
+          &parameters.pw[i],
+          &parameters.shape[i],
+          &parameters.smoothness[i]);
+      lane_gate_flags[i] = gate_flags[source];
+      lane_ramp[i] = ramp[source];
+    }
+
+    (*table.fn[ramp_mode][output_mode][range])(
+        lanes, n, parameters, lane_gate_flags, lane_ramp, out, size);
+
+    for (int i = 0; i < n; ++i) {
+      voices[i]->Smooth(output_mode, parameters.smoothness[i], out[i], size);
+    }
+  }
+
+ private:
+  typedef PolySlopeGenerator G;
+  static const size_t num_channels = G::num_channels;
+
+  struct Parameters {
+    float frequency[kMaxVoices];
+    float pw[kMaxVoices];
+    float shape[kMaxVoices];
+    float smoothness[kMaxVoices];
+    float shift[kMaxVoices];
+  };
+
+  typedef void (*RenderFn)(
+      PolySlopeGenerator* const* voices,
+      int n,
+      const Parameters& parameters,
+      const stmlib::GateFlags* const* gate_flags,
+      const float* const* ramp,
+      PolySlopeGenerator::OutputSample* const* out,
+      size_t size);
+
+  // Same layout as PolySlopeGenerator::render_fn_table_. Modes without a
+  // SIMD implementation are never dispatched here (see Supports()).
+  struct RenderFnTable {
+    RenderFnTable() {
+      std::fill(&fn[0][0][0], &fn[RAMP_MODE_LAST][0][0], (RenderFn) NULL);
+      INSTANTIATE_LANES(RAMP_MODE_AD, OUTPUT_MODE_GATES, RANGE_CONTROL);
+      INSTANTIATE_LANES(RAMP_MODE_AD, OUTPUT_MODE_AMPLITUDE, RANGE_CONTROL);
+      INSTANTIATE_LANES(RAMP_MODE_AD, OUTPUT_MODE_SLOPE_PHASE, RANGE_CONTROL);
+      INSTANTIATE_LANES(RAMP_MODE_AD, OUTPUT_MODE_FREQUENCY, RANGE_CONTROL);
+      INSTANTIATE_LANES(RAMP_MODE_LOOPING, OUTPUT_MODE_GATES, RANGE_CONTROL);
+      INSTANTIATE_LANES(
+          RAMP_MODE_LOOPING, OUTPUT_MODE_AMPLITUDE, RANGE_CONTROL);
+      INSTANTIATE_LANES(
+          RAMP_MODE_LOOPING, OUTPUT_MODE_SLOPE_PHASE, RANGE_CONTROL);
+      INSTANTIATE_LANES(
+          RAMP_MODE_LOOPING, OUTPUT_MODE_FREQUENCY, RANGE_CONTROL);
+    }
+
+    RenderFn fn[RAMP_MODE_LAST][OUTPUT_MODE_LAST][RANGE_LAST];
+  };
+
+  static inline float_4 Min(float_4 a, float_4 b) {
+    // Same as std::min()
+    return rack::simd::ifelse(b < a, b, a);
+  }
+
+  static inline float_4 Max(float_4 a, float_4 b) {
+    // Same as std::max()
+    return rack::simd::ifelse(a < b, b, a);
+  }
+
+  static inline float_4 Fractional(float_4 x) {
+    // Same as MAKE_INTEGRAL_FRACTIONAL()
+    return x - rack::simd::trunc(x);
+  }
+
+  // Loads the pairs of consecutive samples table[i][offset], table[i][offset + 1].
+  static inline void GatherPairs(
+      const int16_t* const* table,
+      int32_t offset,
+      float_4* a,
+      float_4* b) {
+    int32_t pair[kMaxVoices];
+    for (int i = 0; i < kMaxVoices; ++i) {
+      std::memcpy(&pair[i], &table[i][offset], sizeof(int32_t));
+    }
+    const __m128i pairs = _mm_setr_epi32(pair[0], pair[1], pair[2], pair[3]);
+    *a = float_4(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_slli_epi32(pairs, 16), 16)));
+    *b = float_4(_mm_cvtepi32_ps(_mm_srai_epi32(pairs, 16)));
+  }
+
+  static inline bool Any(float_4 mask) {
+    return rack::simd::movemask(mask) != 0;
+  }
+
+  static inline float_4 GateFlag(
+      const stmlib::GateFlags* const* gate_flags,
+      size_t i,
+      stmlib::GateFlags flag) {
+    return float_4(
+        gate_flags[0][i] & flag,
+        gate_flags[1][i] & flag,
+        gate_flags[2][i] & flag,
+        gate_flags[3][i] & flag) != 0.0f;
+  }
+
+  // stmlib::Interpolate(), only evaluated in the lanes selected by mask.
+  static inline float_4 Interpolate(
+      const float* table,
+      float_4 index,
+      float_4 mask) {
+    index *= 1024.0f;
+    const float_4 index_integral = rack::simd::trunc(index);
+    const float_4 index_fractional = index - index_integral;
+    const int bits = rack::simd::movemask(mask);
+    int32_t i[kMaxVoices];
+    for (int k = 0; k < kMaxVoices; ++k) {
+      i[k] = bits & (1 << k) ? static_cast<int32_t>(index_integral[k]) : 0;
+    }
+    const float_4 a = float_4(table[i[0]], table[i[1]], table[i[2]], table[i[3]]);
+    const float_4 b = float_4(
+        table[i[0] + 1], table[i[1] + 1], table[i[2] + 1], table[i[3] + 1]);
+    return rack::simd::ifelse(mask, a + (b - a) * index_fractional, 0.0f);
+  }
+
+  // RampWaveshaper::Shape(), except in AR mode.
+  static inline float_4 Shape(
+      float_4 input,
+      const int16_t* const* shape,
+      float_4 shape_fractional) {
+    const float_4 ws_index = 1024.0f * input;
+    const float_4 ws_index_integral = rack::simd::trunc(ws_index);
+    const float_4 ws_index_fractional = ws_index - ws_index_integral;
+    const int16_t* s[kMaxVoices];
+    for (int k = 0; k < kMaxVoices; ++k) {
+      s[k] = &shape[k][static_cast<int32_t>(ws_index_integral[k]) & 1023];
+    }
+    // Dividing by a power of two is the same as multiplying by its inverse.
+    const float scale = 1.0f / 32768.0f;
+    float_4 x0, x1, y0, y1;
+    GatherPairs(s, 0, &x0, &x1);
+    GatherPairs(s, 1025, &y0, &y1);
+    x0 *= scale;
+    x1 *= scale;
+    y0 *= scale;
+    y1 *= scale;
+    const float_4 x = x0 + (x1 - x0) * ws_index_fractional;
+    const float_4 y = y0 + (y1 - y0) * ws_index_fractional;
+    return x + (y - x) * shape_fractional;
+  }
+
+  // RampShaper::SkewedRamp() without phase shift.
+  static inline float_4 SkewedRamp(float_4 phase, float_4 frequency, float_4 pw) {
+    const float_4 abs_frequency = rack::simd::fabs(frequency);
+    const float_4 min_pw = abs_frequency * 2.0f;
+    const float_4 max_pw = 1.0f - 2.0f * abs_frequency;
+    pw = rack::simd::ifelse(pw < min_pw, min_pw,
+        rack::simd::ifelse(pw > max_pw, max_pw, pw));
+    const float_4 slope_up = 0.5f / pw;
+    const float_4 slope_down = 0.5f / (1.0f - pw);
+    return rack::simd::ifelse(
+        phase < pw, phase * slope_up, (phase - pw) * slope_down + 0.5f);
+  }
+
+  // RampShaper::SkewedRamp(), where a non-zero phase shift also updates the
+  // shaper's previous phase shift.
+  static inline float_4 SkewedRamp(
+      float_4 phase,
+      float_4 phase_shift,
+      float_4 frequency,
+      float_4 pw,
+      float_4* previous_phase_shift) {
+    const float_4 shifted = phase_shift != 0.0f;
+    float_4 shifted_phase = phase + phase_shift;
+    shifted_phase = rack::simd::ifelse(
+        shifted_phase >= 1.0f,
+        shifted_phase - 1.0f,
+        rack::simd::ifelse(
+            shifted_phase < 0.0f, shifted_phase + 1.0f, shifted_phase));
+    phase = rack::simd::ifelse(shifted, shifted_phase, phase);
+    frequency = rack::simd::ifelse(
+        shifted, frequency + (phase_shift - *previous_phase_shift), frequency);
+    *previous_phase_shift = rack::simd::ifelse(
+        shifted, phase_shift, *previous_phase_shift);
+    return SkewedRamp(phase, frequency, pw);
+  }
+
+  template<RampMode ramp_mode>
+  static inline float_4 Fold(float_4 unipolar, float_4 fold_amount) {
+    const float_4 active = fold_amount > 0.0f;
+    if (ramp_mode == RAMP_MODE_LOOPING) {
+      const float_4 bipolar = 2.0f * unipolar - 1.0f;
+      const float_4 folded = Any(active) ? Interpolate(
+          lut_bipolar_fold,
+          0.5f + bipolar * (0.03f + 0.46f * fold_amount),
+          active) : 0.0f;
+      return 5.0f * (bipolar + (folded - bipolar) * fold_amount);
+    } else {
+      const float_4 folded = Any(active) ? Interpolate(
+          lut_unipolar_fold,
+          unipolar * fold_amount,
+          active) : 0.0f;
+      return 8.0f * (unipolar + (folded - unipolar) * fold_amount);
+    }
+  }
+
+  template<RampMode ramp_mode>
+  static inline float_4 Scale(float_4 unipolar) {
+    if (ramp_mode == RAMP_MODE_LOOPING) {
+      return 10.0f * unipolar - 5.0f;
+    } else {
+      return 8.0f * unipolar;
+    }
+  }
+
+  // PolySlopeGenerator::RenderInternal(), RampGenerator::Step() and
+  // RampShaper::Slope()/EOA()/EOR(), for the AD and looping modes in the
+  // control range.
+  template<RampMode ramp_mode, OutputMode output_mode, Range range>
+  static void RenderLanes(
+      PolySlopeGenerator* const* voices,
+      int n,
+      const Parameters& parameters,
+      const stmlib::GateFlags* const* gate_flags,
+      const float* const* ramp,
+      PolySlopeGenerator::OutputSample* const* out,
+      size_t size) {
+    const bool is_phasor = !(range == RANGE_AUDIO && \
+        ramp_mode == RAMP_MODE_LOOPING);
+    const bool use_ramp = ramp[0] != NULL;
+
+    // Ramps stepped by RampGenerator::Step().
+    const size_t num_ramps = output_mode == OUTPUT_MODE_FREQUENCY
+        ? num_channels : 1;
+
+    if (output_mode == OUTPUT_MODE_FREQUENCY) {
+      for (int i = 0; i < n; ++i) {
+        G* g = voices[i];
+        const int ratio_index = g->ratio_index_quantizer_.Process(
+            parameters.shift[i]);
+        if (range == RANGE_CONTROL) {
+          g->ramp_generator_.set_next_ratio(
+              G::control_ratio_table_[ratio_index]);
+        } else {
+          g->ramp_generator_.set_next_ratio(G::audio_ratio_table_[ratio_index]);
+        }
+      }
+    }
+
+    // Load the parameter interpolators.
+    float_4 f0, pw, shift, shape, fold;
+    float_4 f0_target, pw_target, shift_target, shape_target, fold_target;
+    for (int i = 0; i < kMaxVoices; ++i) {
+      const G* g = voices[i];
+      f0[i] = g->frequency_;
+      pw[i] = g->pw_;
+      shift[i] = g->shift_;
+      shape[i] = g->shape_;
+      fold[i] = g->fold_;
+      f0_target[i] = parameters.frequency[i];
+      pw_target[i] = parameters.pw[i];
+      shift_target[i] = 2.0f * parameters.shift[i] - 1.0f;
+      shape_target[i] = is_phasor
+          ? parameters.shape[i] * 5.9999f + 5.0f
+          : parameters.shape[i] * 3.9999f;
+      fold_target[i] = std::max(
+          2.0f * (parameters.smoothness[i] - 0.5f), 0.0f);
+    }
+    const float_4 f0_increment = (f0_target - f0) / static_cast<float>(size);
+    const float_4 pw_increment = (pw_target - pw) / static_cast<float>(size);
+    const float_4 shift_increment = \
+        (shift_target - shift) / static_cast<float>(size);
+    const float_4 shape_increment = \
+        (shape_target - shape) / static_cast<float>(size);
+    const float_4 fold_increment = \
+        (fold_target - fold) / static_cast<float>(size);
+
+    // Load the ramp generators and shapers.
+    float_4 master_phase;
+    float_4 phase[num_channels];
+    float_4 frequency[num_channels];
+    float_4 wrap_counter[num_channels];
+    float_4 ratio[num_channels];
+    float_4 q[num_channels];
+    float_4 next_ratio[num_channels];
+    float_4 next_q[num_channels];
+    float_4 previous_phase_shift[num_channels];
+    for (int i = 0; i < kMaxVoices; ++i) {
+      const RampGenerator<num_channels>& r = voices[i]->ramp_generator_;
+      master_phase[i] = r.master_phase_;
+      for (size_t j = 0; j < num_channels; ++j) {
+        phase[j][i] = r.phase_[j];
+        frequency[j][i] = r.frequency_[j];
+        wrap_counter[j][i] = static_cast<float>(r.wrap_counter_[j]);
+        ratio[j][i] = r.ratio_[j].ratio;
+        q[j][i] = static_cast<float>(r.ratio_[j].q);
+        next_ratio[j][i] = r.next_ratio_[j].ratio;
+        next_q[j][i] = static_cast<float>(r.next_ratio_[j].q);
+        previous_phase_shift[j][i] = \
+            voices[i]->ramp_shaper_[j].previous_phase_shift_;
+      }
+    }
+
+    const int16_t* gates_table[kMaxVoices];
+    std::fill(&gates_table[0], &gates_table[kMaxVoices], &lut_wavetable[8200]);
+
+    for (size_t i = 0; i < size; ++i) {
+      f0 += f0_increment;
+      pw += pw_increment;
+      shift += shift_increment;
+      shape += shape_increment;
+      fold += fold_increment;
+      const float_4 step = shift * (1.0f / (num_channels - 1));
+      const float_4 partial_step = shift * (1.0f / num_channels);
+
+      // Increment ramps.
+      const float_4 ramp_value = use_ramp
+          ? float_4(ramp[0][i], ramp[1][i], ramp[2][i], ramp[3][i])
+          : 0.0f;
+      const float_4 rising = use_ramp
+          ? float_4::zero()
+          : GateFlag(gate_flags, i, stmlib::GATE_FLAG_RISING);
+
+      if (ramp_mode == RAMP_MODE_AD) {
+        for (size_t j = 0; j < num_ramps; ++j) {
+          frequency[j] = Min(f0 * next_ratio[j], 0.25f);
+          if (use_ramp) {
+            phase[j] = ramp_value * next_ratio[j];
+          } else {
+            phase[j] = rack::simd::ifelse(rising, 0.0f, phase[j]);
+            phase[j] += frequency[j];
+          }
+          phase[j] = Min(phase[j], 1.0f);
+        }
+      } else {
+        float_4 wrap;
+        if (use_ramp) {
+          for (size_t j = 0; j < num_ramps; ++j) {
+            frequency[j] = Min(f0 * ratio[j], 0.25f);
+          }
+          wrap = ramp_value < master_phase;
+          master_phase = ramp_value;
+        } else {
+          master_phase = rack::simd::ifelse(rising, 0.0f, master_phase);
+          for (size_t j = 0; j < num_ramps; ++j) {
+            ratio[j] = rack::simd::ifelse(rising, next_ratio[j], ratio[j]);
+            q[j] = rack::simd::ifelse(rising, next_q[j], q[j]);
+            wrap_counter[j] = rack::simd::ifelse(rising, 0.0f, wrap_counter[j]);
+            frequency[j] = Min(f0 * ratio[j], 0.25f);
+          }
+          master_phase = rack::simd::ifelse(
+              rising, master_phase, master_phase + f0);
+          wrap = master_phase >= 1.0f;
+          master_phase = rack::simd::ifelse(
+              wrap, master_phase - 1.0f, master_phase);
+        }
+        for (size_t j = 0; j < num_ramps; ++j) {
+          wrap_counter[j] = rack::simd::ifelse(
+              wrap, wrap_counter[j] + 1.0f, wrap_counter[j]);
+          const float_4 next = wrap & (wrap_counter[j] >= q[j]);
+          ratio[j] = rack::simd::ifelse(next, next_ratio[j], ratio[j]);
+          q[j] = rack::simd::ifelse(next, next_q[j], q[j]);
+          wrap_counter[j] = rack::simd::ifelse(next, 0.0f, wrap_counter[j]);
+          phase[j] = Fractional((master_phase + wrap_counter[j]) * ratio[j]);
+        }
+      }
+
+      // Compute shape.
+      const float_4 shape_integral = rack::simd::trunc(shape);
+      const float_4 shape_fractional = shape - shape_integral;
+      const int16_t* shape_table[kMaxVoices];
+      for (int k = 0; k < kMaxVoices; ++k) {
+        shape_table[k] = &lut_wavetable[
+            static_cast<int32_t>(shape_integral[k]) * 1025];
+      }
+
+      float_4 channel[num_channels];
+      if (output_mode == OUTPUT_MODE_GATES) {
+        const float_4 raw = SkewedRamp(phase[0], frequency[0], pw);
+        const float_4 slope = Shape(raw, shape_table, shape_fractional);
+        channel[0] = Fold<ramp_mode>(slope, fold) * shift;
+        channel[1] = Scale<ramp_mode>(is_phasor
+            ? Shape(raw, gates_table, 0.0f)
+            : raw);
+        // RampShaper::EOA() and EOR()
+        channel[2] = rack::simd::ifelse(phase[0] >= pw, 1.0f, 0.0f) * 8.0f;
+        if (ramp_mode == RAMP_MODE_LOOPING) {
+          const float_4 eor_pw = Min(0.5f, 96.0f * frequency[0]);
+          channel[3] = rack::simd::ifelse(phase[0] < eor_pw, 1.0f, 0.0f);
+        } else {
+          channel[3] = rack::simd::ifelse(phase[0] >= 1.0f, 1.0f, 0.0f);
+        }
+        channel[3] *= 8.0f;
+      } else if (output_mode == OUTPUT_MODE_AMPLITUDE) {
+        const float_4 raw = SkewedRamp(phase[0], frequency[0], pw);
+        const float_4 shaped = Shape(raw, shape_table, shape_fractional);
+        const float_4 slope = Fold<ramp_mode>(shaped, fold) * \
+            rack::simd::ifelse(shift < 0.0f, -1.0f, 1.0f);
+        const float_4 channel_index = rack::simd::fabs(shift * 5.1f);
+        for (size_t j = 0; j < num_channels; ++j) {
+          const float c = static_cast<float>(j + 1);
+          const float_4 gain = Max(
+              1.0f - rack::simd::fabs(c - channel_index), 0.0f);
+          channel[j] = slope * gain;
+        }
+      } else if (output_mode == OUTPUT_MODE_SLOPE_PHASE) {
+        const float_4 pw_step = rack::simd::ifelse(
+            shift > 0.0f, 1.0f - pw, pw) * step;
+        float_4 phase_shift = 0.0f;
+        for (size_t j = 0; j < num_channels; ++j) {
+          float_4 slope;
+          if (ramp_mode == RAMP_MODE_AD) {
+            slope = SkewedRamp(
+                phase[0], frequency[0], pw + pw_step * float(j));
+          } else if (j == 0) {
+            slope = SkewedRamp(phase[0], frequency[0], pw);
+          } else {
+            slope = SkewedRamp(
+                phase[0],
+                phase_shift,
+                frequency[0],
+                pw,
+                &previous_phase_shift[j]);
+          }
+          channel[j] = Fold<ramp_mode>(
+              Shape(slope, shape_table, shape_fractional), fold);
+          phase_shift -= partial_step;
+        }
+      } else if (output_mode == OUTPUT_MODE_FREQUENCY) {
+        for (size_t j = 0; j < num_channels; ++j) {
+          channel[j] = Fold<ramp_mode>(
+              Shape(
+                  SkewedRamp(phase[j], frequency[j], pw),
+                  shape_table,
+                  shape_fractional),
+              fold);
+        }
+      }
+
+      // Transpose from one vector per output to one vector per voice.
+      _MM_TRANSPOSE4_PS(channel[0].v, channel[1].v, channel[2].v, channel[3].v);
+      for (int k = 0; k < n; ++k) {
+        channel[k].store(out[k][i].channel);
+      }
+    }
+
+    // Store the state back.
+    for (int i = 0; i < n; ++i) {
+      G* g = voices[i];
+      g->frequency_ = f0[i];
+      g->pw_ = pw[i];
+      g->shift_ = shift[i];
+      g->shape_ = shape[i];
+      g->fold_ = fold[i];
+
+      RampGenerator<num_channels>& r = g->ramp_generator_;
+      r.master_phase_ = master_phase[i];
+      for (size_t j = 0; j < num_ramps; ++j) {
+        r.phase_[j] = phase[j][i];
+        r.frequency_[j] = frequency[j][i];
+        r.wrap_counter_[j] = static_cast<int>(wrap_counter[j][i]);
+        r.ratio_[j].ratio = ratio[j][i];
+        r.ratio_[j].q = static_cast<int>(q[j][i]);
+      }
+      for (size_t j = 0; j < num_channels; ++j) {
+        g->ramp_shaper_[j].previous_phase_shift_ = previous_phase_shift[j][i];
+      }
+    }
+  }
+};
+
+}  // namespace tides2
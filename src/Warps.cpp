@@ -34,9 +34,16 @@ struct Warps : Module {
 
 	int frame = 0;
 	warps::Modulator modulator;
-	warps::ShortFrame inputFrames[60] = {};
-	warps::ShortFrame outputFrames[60] = {};
+	warps::FloatFrame inputFrames[warps::kMaxBlockSize] = {};
+	warps::FloatFrame outputFrames[warps::kMaxBlockSize] = {};
 	dsp::SchmittTrigger stateTrigger;
+	/** Frames processed per block. The filter bank requires a multiple of 12. */
+	int blockSize = 60;
+	/** Runs the modulator at the engine sample rate.
+	Otherwise it runs as if the engine ran at 96 kHz, the rate its filters were designed for, like versions <=1.5.0.
+	*/
+	bool rateAdaptive = true;
+	float modulatorSampleRate = 96000.f;
 
 	Warps() {
 		config(NUM_PARAMS, NUM_INPUTS, NUM_OUTPUTS, NUM_LIGHTS);
@@ -63,6 +70,13 @@ struct Warps : Module {
 	}
 
 	void process(const ProcessArgs& args) override {
+		// Reinitialize if the sample rate or mode has changed
+		float sampleRate = rateAdaptive ? args.sampleRate : 96000.f;
+		if (sampleRate != modulatorSampleRate) {
+			modulator.Init(sampleRate);
+			modulatorSampleRate = sampleRate;
+		}
+
 		// State trigger
 		warps::Parameters* p = modulator.mutable_parameters();
 		if (stateTrigger.process(params[STATE_PARAM].getValue())) {
@@ -72,7 +86,7 @@ struct Warps : Module {
 		lights[CARRIER_RED_LIGHT].value = (p->carrier_shape == 2 || p->carrier_shape == 3) ? 1.0 : 0.0;
 
 		// Buffer loop
-		if (++frame >= 60) {
+		if (++frame >= blockSize) {
 			frame = 0;
 
 			p->channel_drive[0] = clamp(params[LEVEL1_PARAM].getValue() + inputs[LEVEL1_INPUT].getVoltage() / 5.0f, 0.0f, 1.0f);
@@ -94,21 +108,24 @@ struct Warps : Module {
 			p->frequency_shift_cv = clamp(inputs[ALGORITHM_INPUT].getVoltage() / 5.0f, -1.0f, 1.0f);
 			p->phase_shift = p->modulation_algorithm;
 			p->note = 60.0 * params[LEVEL1_PARAM].getValue() + 12.0 * inputs[LEVEL1_INPUT].getNormalVoltage(2.0) + 12.0;
-			p->note += log2f(96000.0f * args.sampleTime) * 12.0f;
+			if (!rateAdaptive)
+				p->note += log2f(96000.0f * args.sampleTime) * 12.0f;
 
-			modulator.Process(inputFrames, outputFrames, 60);
+			modulator.Process(inputFrames, outputFrames, blockSize);
 		}
 
-		inputFrames[frame].l = clamp((int)(inputs[CARRIER_INPUT].getVoltage() / 16.0 * 0x8000), -0x8000, 0x7fff);
-		inputFrames[frame].r = clamp((int)(inputs[MODULATOR_INPUT].getVoltage() / 16.0 * 0x8000), -0x8000, 0x7fff);
-		outputs[MODULATOR_OUTPUT].setVoltage((float)outputFrames[frame].l / 0x8000 * 5.0);
-		outputs[AUX_OUTPUT].setVoltage((float)outputFrames[frame].r / 0x8000 * 5.0);
+		inputFrames[frame].l = inputs[CARRIER_INPUT].getVoltage() / 16.f;
+		inputFrames[frame].r = inputs[MODULATOR_INPUT].getVoltage() / 16.f;
+		outputs[MODULATOR_OUTPUT].setVoltage(outputFrames[frame].l * 5.f);
+		outputs[AUX_OUTPUT].setVoltage(outputFrames[frame].r * 5.f);
 	}
 
 	json_t* dataToJson() override {
 		json_t* rootJ = json_object();
 		warps::Parameters* p = modulator.mutable_parameters();
 		json_object_set_new(rootJ, "shape", json_integer(p->carrier_shape));
+		json_object_set_new(rootJ, "rateAdaptive", json_boolean(rateAdaptive));
+		json_object_set_new(rootJ, "blockSize", json_integer(blockSize));
 		return rootJ;
 	}
 
@@ -118,6 +135,18 @@ struct Warps : Module {
 		if (shapeJ) {
 			p->carrier_shape = json_integer_value(shapeJ);
 		}
+
+		// Legacy <=1.5.0 patches ran as if at 96 kHz
+		json_t* rateAdaptiveJ = json_object_get(rootJ, "rateAdaptive");
+		rateAdaptive = rateAdaptiveJ ? json_boolean_value(rateAdaptiveJ) : false;
+
+		json_t* blockSizeJ = json_object_get(rootJ, "blockSize");
+		if (blockSizeJ)
+			setBlockSize(json_integer_value(blockSizeJ));
+	}
+
+	void setBlockSize(int size) {
+		blockSize = clamp(size / 12 * 12, 12, (int) warps::kMaxBlockSize);
 	}
 
 	void onReset() override {
@@ -161,6 +190,27 @@ struct WarpsWidget : ModuleWidget {
 		addChild(createLight<SmallLight<GreenRedLight>>(Vec(21, 167), module, Warps::CARRIER_GREEN_LIGHT));
 		addChild(createLightCentered<Rogan6PSLight<RedGreenBlueLight>>(Vec(73.556641, 96.560532), module, Warps::ALGORITHM_LIGHT));
 	}
+
+	void appendContextMenu(Menu* menu) override {
+		Warps* module = dynamic_cast<Warps*>(this->module);
+		assert(module);
+
+		menu->addChild(new MenuSeparator);
+
+		menu->addChild(createBoolPtrMenuItem("Adapt to engine sample rate", "", &module->rateAdaptive));
+
+		static const std::vector<int> blockSizes = {12, 24, 48, 60, 96};
+		std::vector<std::string> blockSizeLabels;
+		for (int size : blockSizes)
+			blockSizeLabels.push_back(string::f("%d samples", size));
+		menu->addChild(createIndexSubmenuItem("Block size", blockSizeLabels,
+			[=]() {
+				auto it = std::find(blockSizes.begin(), blockSizes.end(), module->blockSize);
+				return it - blockSizes.begin();
+			},
+			[=](size_t i) {module->setBlockSize(blockSizes[i]);}
+		));
+	}
 };
 
 
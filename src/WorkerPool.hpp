@@ -0,0 +1,165 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+#if defined(__x86_64__) || defined(__i386__)
+	#include <xmmintrin.h>
+#endif
+
+
+/** A small pool of worker threads for splitting per-voice DSP work of a single module.
+
+The thread calling dispatch() publishes `count` jobs which are claimed by workers through a single atomic counter, so no lock is taken while the pool is busy.
+Workers spin (yielding) between jobs and only fall back to a condition variable after being idle for a while.
+The calling thread helps with any unclaimed jobs in wait(), so results are always complete even if no workers are running.
+*/
+struct WorkerPool {
+	typedef void (*JobFunction)(void* context, int index);
+
+	WorkerPool() {}
+
+	~WorkerPool() {
+		setThreads(0);
+	}
+
+	/** Starts or stops workers. Must not be called from the thread calling dispatch(), which may keep dispatching meanwhile.
+	Never runs jobs itself, since only the dispatching thread may read the batch fields outside of a claim.
+	Stopped workers finish the jobs they claimed before exiting, and wait() runs any jobs left unclaimed.
+	*/
+	void setThreads(int threads) {
+		std::lock_guard<std::mutex> lock(threadsMutex);
+		if (threads == (int) workers.size())
+			return;
+		// Stop all workers
+		threadCount.store(0);
+		running = false;
+		wake();
+		for (std::thread& worker : workers)
+			worker.join();
+		workers.clear();
+		// Start new workers
+		running = true;
+		for (int i = 0; i < threads; i++)
+			workers.emplace_back([this]() {work();});
+		threadCount.store(threads);
+	}
+
+	/** Number of running workers. Safe to call from any thread. */
+	int getThreads() const {
+		return threadCount.load();
+	}
+
+	/** Publishes `count` jobs without waiting for them to finish.
+	Calls wait() first if the previous batch is still in flight.
+	*/
+	void dispatch(JobFunction function, void* context, int count) {
+		wait();
+		jobFunction = function;
+		jobContext = context;
+		jobCount = count;
+		jobsDone.store(0);
+		// Bump the generation and reset the job index in a single store
+		uint64_t generation = (next.load() >> 32) + 1;
+		next.store(generation << 32);
+		pending = true;
+		wake();
+	}
+
+	/** Runs unclaimed jobs on the calling thread and blocks until all jobs of the last batch have finished. */
+	void wait() {
+		if (!pending)
+			return;
+		uint64_t generation = next.load() >> 32;
+		while (claim(generation)) {}
+		while (jobsDone.load(std::memory_order_acquire) < jobCount) {
+			std::this_thread::yield();
+		}
+		pending = false;
+	}
+
+	/** Runs `count` jobs and blocks until they have finished. */
+	void run(JobFunction function, void* context, int count) {
+		dispatch(function, context, count);
+		wait();
+	}
+
+private:
+	/** Only accessed by setThreads(). */
+	std::vector<std::thread> workers;
+	std::mutex threadsMutex;
+	std::atomic<int> threadCount{0};
+	std::atomic<bool> running{true};
+	/** High 32 bits: batch generation. Low 32 bits: index of the next unclaimed job. */
+	std::atomic<uint64_t> next{0};
+	std::atomic<int> jobsDone{0};
+	JobFunction jobFunction = NULL;
+	void* jobContext = NULL;
+	int jobCount = 0;
+	/** Only accessed by the dispatching thread. */
+	bool pending = false;
+
+	std::mutex sleepMutex;
+	std::condition_variable sleepCv;
+	std::atomic<int> sleepers{0};
+
+	/** Claims and runs one job of the given generation. Returns false if there is nothing left to claim. */
+	bool claim(uint64_t generation) {
+		uint64_t value = next.load(std::memory_order_acquire);
+		while (true) {
+			if ((value >> 32) != generation)
+				return false;
+			int index = value & 0xffffffff;
+			if (index >= jobCount)
+				return false;
+			if (next.compare_exchange_weak(value, value + 1, std::memory_order_acq_rel))
+				break;
+		}
+		// The batch fields can't change until jobsDone reaches jobCount, which requires this job to finish.
+		int index = value & 0xffffffff;
+		jobFunction(jobContext, index);
+		jobsDone.fetch_add(1, std::memory_order_release);
+		return true;
+	}
+
+	void wake() {
+		if (sleepers.load() > 0) {
+			std::lock_guard<std::mutex> lock(sleepMutex);
+			sleepCv.notify_all();
+		}
+	}
+
+	void work() {
+#if defined(__x86_64__) || defined(__i386__)
+		// Match the engine threads: flush denormals to zero
+		_mm_setcsr(_mm_getcsr() | 0x8040);
+#endif
+		uint64_t generation = next.load() >> 32;
+		auto idleStart = std::chrono::steady_clock::now();
+		while (running) {
+			uint64_t newGeneration = next.load(std::memory_order_acquire) >> 32;
+			if (newGeneration != generation) {
+				generation = newGeneration;
+				while (claim(generation)) {}
+				idleStart = std::chrono::steady_clock::now();
+				continue;
+			}
+
+			// Spin for a few engine blocks before going to sleep
+			if (std::chrono::steady_clock::now() - idleStart < std::chrono::milliseconds(5)) {
+				std::this_thread::yield();
+				continue;
+			}
+
+			std::unique_lock<std::mutex> lock(sleepMutex);
+			sleepers++;
+			sleepCv.wait(lock, [&]() {
+				return !running || (next.load() >> 32) != generation;
+			});
+			sleepers--;
+			idleStart = std::chrono::steady_clock::now();
+		}
+	}
+};
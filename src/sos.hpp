@@ -0,0 +1,238 @@
+// Cascaded second-order sections IIR filter
+// Copyright (C) 2020 Tyler Coy
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+// Shared by the Ripples, Shelves, and Streams anti-aliasing filters.
+//
+// Sections are evaluated in transposed direct form II, which needs only two
+// state variables per section. The block methods run one section at a time
+// over the whole block so that its coefficients and state stay in registers.
+
+#pragma once
+
+namespace sos
+{
+
+struct SOSCoefficients
+{
+    float b[3];
+    float a[2];
+};
+
+template <typename T, int max_num_sections>
+class SOSFilter
+{
+public:
+    SOSFilter()
+    {
+        Init(0);
+    }
+
+    SOSFilter(int num_sections)
+    {
+        Init(num_sections);
+    }
+
+    void Init(int num_sections)
+    {
+        num_sections_ = num_sections;
+        Reset();
+    }
+
+    void Init(int num_sections, const SOSCoefficients* sections)
+    {
+        num_sections_ = num_sections;
+        Reset();
+        SetCoefficients(sections);
+    }
+
+    void Reset()
+    {
+        for (int n = 0; n < max_num_sections; n++)
+        {
+            s_[n][0] = 0.f;
+            s_[n][1] = 0.f;
+        }
+    }
+
+    void SetCoefficients(const SOSCoefficients* sections)
+    {
+        for (int n = 0; n < num_sections_; n++)
+        {
+            sections_[n].b[0] = sections[n].b[0];
+            sections_[n].b[1] = sections[n].b[1];
+            sections_[n].b[2] = sections[n].b[2];
+
+            sections_[n].a[0] = sections[n].a[0];
+            sections_[n].a[1] = sections[n].a[1];
+        }
+    }
+
+    // Copies lane `from` of the state of `other` to lane `to` of this
+    // filter's state, for SIMD types T. Used to move a channel between
+    // filters whose lanes hold different things.
+    void CopyLane(int to, const SOSFilter& other, int from)
+    {
+        for (int n = 0; n < max_num_sections; n++)
+        {
+            s_[n][0][to] = other.s_[n][0][from];
+            s_[n][1][to] = other.s_[n][1][from];
+        }
+    }
+
+    T Process(T in)
+    {
+        for (int n = 0; n < num_sections_; n++)
+        {
+            const SOSCoefficients& c = sections_[n];
+            T out = c.b[0] * in + s_[n][0];
+            s_[n][0] = c.b[1] * in - c.a[0] * out + s_[n][1];
+            s_[n][1] = c.b[2] * in - c.a[1] * out;
+            in = out;
+        }
+
+        return in;
+    }
+
+    // Filters a block of samples. `in` and `out` may point to the same buffer.
+    void Process(const T* in, T* out, int size)
+    {
+        if (num_sections_ == 0)
+        {
+            for (int i = 0; i < size; i++)
+            {
+                out[i] = in[i];
+            }
+
+            return;
+        }
+
+        ProcessSection(0, in, out, size);
+
+        for (int n = 1; n < num_sections_; n++)
+        {
+            ProcessSection(n, out, out, size);
+        }
+    }
+
+    // Polyphase interpolation: filters `in` followed by `factor - 1` zeros,
+    // writing `factor` samples to `out`. The first section skips the
+    // feedforward terms for the stuffed zeros.
+    void ProcessUpsample(T in, T* out, int factor)
+    {
+        if (num_sections_ == 0)
+        {
+            out[0] = in;
+
+            for (int i = 1; i < factor; i++)
+            {
+                out[i] = 0.f;
+            }
+
+            return;
+        }
+
+        const SOSCoefficients& c = sections_[0];
+        T s0 = s_[0][0];
+        T s1 = s_[0][1];
+
+        T y = c.b[0] * in + s0;
+        s0 = c.b[1] * in - c.a[0] * y + s1;
+        s1 = c.b[2] * in - c.a[1] * y;
+        out[0] = y;
+
+        for (int i = 1; i < factor; i++)
+        {
+            y = s0;
+            s0 = s1 - c.a[0] * y;
+            s1 = -c.a[1] * y;
+            out[i] = y;
+        }
+
+        s_[0][0] = s0;
+        s_[0][1] = s1;
+
+        for (int n = 1; n < num_sections_; n++)
+        {
+            ProcessSection(n, out, out, factor);
+        }
+    }
+
+    // Polyphase decimation: filters `factor` samples from `in` and returns
+    // only the last output. The last section still runs the recursion for
+    // every sample but never stores the outputs that would be discarded.
+    // `in` is used as scratch space.
+    T ProcessDownsample(T* in, int factor)
+    {
+        if (num_sections_ == 0)
+        {
+            return in[factor - 1];
+        }
+
+        int last = num_sections_ - 1;
+
+        for (int n = 0; n < last; n++)
+        {
+            ProcessSection(n, in, in, factor);
+        }
+
+        const SOSCoefficients& c = sections_[last];
+        T s0 = s_[last][0];
+        T s1 = s_[last][1];
+        T y = 0.f;
+
+        for (int i = 0; i < factor; i++)
+        {
+            T x = in[i];
+            y = c.b[0] * x + s0;
+            s0 = c.b[1] * x - c.a[0] * y + s1;
+            s1 = c.b[2] * x - c.a[1] * y;
+        }
+
+        s_[last][0] = s0;
+        s_[last][1] = s1;
+        return y;
+    }
+
+protected:
+    int num_sections_;
+    SOSCoefficients sections_[max_num_sections];
+    T s_[max_num_sections][2];
+
+    void ProcessSection(int n, const T* in, T* out, int size)
+    {
+        const T b0 = sections_[n].b[0];
+        const T b1 = sections_[n].b[1];
+        const T b2 = sections_[n].b[2];
+        const T a0 = sections_[n].a[0];
+        const T a1 = sections_[n].a[1];
+        T s0 = s_[n][0];
+        T s1 = s_[n][1];
+
+        for (int i = 0; i < size; i++)
+        {
+            T x = in[i];
+            T y = b0 * x + s0;
+            s0 = b1 * x - a0 * y + s1;
+            s1 = b2 * x - a1 * y;
+            out[i] = y;
+        }
+
+        s_[n][0] = s0;
+        s_[n][1] = s1;
+    }
+};
+
+}